@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <chrono>
+
+#include "SPICE.hpp"
+
+#include <Eigen/SparseLU>
+
+using namespace spice;
+
+// Matrix of an RC ladder's nodes (tridiagonal, diagonally dominant) with each lane's resistors scaled
+static Eigen::SparseMatrix<double> ladder(size_t n, double scale) {
+	std::vector<Eigen::Triplet<double>> entries;
+	for(size_t ind = 0; ind < n; ind++) {
+		entries.emplace_back(ind, ind, 2/scale + 1e-3);
+		if(ind + 1 < n) {
+			entries.emplace_back(ind, ind + 1, -1/scale);
+			entries.emplace_back(ind + 1, ind, -1/scale);
+		}
+	}
+	
+	Eigen::SparseMatrix<double> mat(n, n);
+	mat.setFromTriplets(entries.begin(), entries.end());
+	mat.makeCompressed();
+	return mat;
+}
+
+static double elapsed_us(std::chrono::steady_clock::time_point start, size_t reps) {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count()/reps;
+}
+
+// Factorize and solve one matrix per lane, together in a LaneLU and one by one with Eigen's SparseLU
+static void compare(size_t n, size_t lanes, size_t reps) {
+	std::vector<Eigen::SparseMatrix<double>> mats;
+	std::vector<const double*> values;
+	for(size_t l = 0; l < lanes; l++)
+		mats.push_back(ladder(n, 1 + 0.1*l));
+	for(size_t l = 0; l < lanes; l++)
+		values.push_back(mats[l].valuePtr());
+	
+	std::vector<double> rhs(n*lanes, 1.0);
+	
+	LaneLU lu(lanes);
+	lu.analyze(mats[0]);
+	
+	auto start = std::chrono::steady_clock::now();
+	for(size_t rep = 0; rep < reps; rep++) {
+		lu.factorize(values);
+		lu.solve(rhs.data());
+	}
+	const double lane_time = elapsed_us(start, reps);
+	
+	Eigen::SparseLU<Eigen::SparseMatrix<double>> slu;
+	slu.analyzePattern(mats[0]);
+	Eigen::VectorXd vec = Eigen::VectorXd::Ones(n);
+	
+	start = std::chrono::steady_clock::now();
+	for(size_t rep = 0; rep < reps; rep++)
+		for(size_t l = 0; l < lanes; l++) {
+			slu.factorize(mats[l]);
+			vec = slu.solve(vec);
+		}
+	const double serial_time = elapsed_us(start, reps);
+	
+	printf("n = %3zu, %2zu lanes: %9.2fus together, %9.2fus one by one (%.2fx)\n", n, lanes, lane_time, serial_time, serial_time/lane_time);
+}
+
+int main(int argc, char **argv) {
+	const size_t reps = argc > 1 ? atoi(argv[1]) : 2000;
+	
+	for(size_t n:{8, 32})
+		for(size_t lanes:{1, 4, 8, 16, 32})
+			compare(n, lanes, reps);
+	
+	return 0;
+}
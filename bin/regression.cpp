@@ -0,0 +1,1041 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <random>
+#include <string>
+#include <limits>
+#include <filesystem>
+#include <stdexcept>
+
+#include "SPICE.hpp"
+#include "Core/BuiltinFunctions.hpp"
+#include "Parser/ExpressionCompiler.hpp"
+
+using namespace spice;
+
+static int failures = 0;
+
+static void check_close(const char *name, double got, double expected, double rel_tol) {
+	const bool ok = std::abs(got - expected) <= rel_tol*std::abs(expected);
+	printf("%s %s: %.9g (expected %.9g)\n", ok ? "PASS" : "FAIL", name, got, expected);
+	
+	if(!ok)
+		failures++;
+}
+
+// 4k/1u RC charging from 0V toward 5V, sampled at 1ms
+static double rc_charge(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(5);
+	Resistor *R1 = c.add_comp<Resistor>(4e3);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-6);
+	
+	gnd->to(volt)->to(R1)->to(C1)->to(gnd);
+	volt->flip();
+	C1->set_initial_cond(0);
+	
+	c.sim_to_time(1e-3);
+	
+	return C1->voltage();
+}
+
+static void timestep_limits() {
+	const double exact = 5*(1 - exp(-0.25));
+	
+	Circuit c_default;
+	check_close("RC with default timestep limits", rc_charge(c_default), exact, 1e-3);
+	
+	Circuit c_auto(0, 0);
+	check_close("RC with estimated timestep limits", rc_charge(c_auto), exact, 5e-3);
+}
+
+// Two parallel capacitors charged through a resistor
+static std::vector<double> parallel_caps(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(c.add_mod<Sine>(1e3, 5));
+	Resistor *R1 = c.add_comp<Resistor>(1e3);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-6);
+	Capacitor *C2 = c.add_comp<Capacitor>(2.2e-6);
+	
+	gnd->to(volt)->to(R1)->to(C1)->to(gnd);
+	volt->flip();
+	C1->top()->to(C2)->to(gnd);
+	
+	c.sim_to_time(1e-3);
+	
+	return {C1->voltage(), C2->current()};
+}
+
+// Capacitor triangle between three resistively loaded nodes
+static std::vector<double> cap_triangle(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(c.add_mod<Sine>(1e3, 5));
+	Resistor *R1 = c.add_comp<Resistor>(1e3);
+	Resistor *R2 = c.add_comp<Resistor>(2e3);
+	Resistor *R3 = c.add_comp<Resistor>(3e3);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-6);
+	Capacitor *C2 = c.add_comp<Capacitor>(2e-6);
+	Capacitor *C3 = c.add_comp<Capacitor>(3e-6);
+	
+	gnd->to(volt)->to(R1)->to(C1)->to(C2)->to(C3)->to(C1->top());
+	volt->flip();
+	C2->top()->to(R2)->to(gnd);
+	C3->top()->to(R3)->to(gnd);
+	
+	c.sim_to_time(1e-3);
+	
+	return {C1->voltage(), C2->voltage(), C3->voltage(), C3->current()};
+}
+
+// Three inductors meeting at a node with no other connections
+static std::vector<double> inductor_star(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(c.add_mod<Sine>(1e3, 5));
+	Resistor *R1 = c.add_comp<Resistor>(10);
+	Resistor *R2 = c.add_comp<Resistor>(20);
+	Resistor *R3 = c.add_comp<Resistor>(30);
+	Inductor *L1 = c.add_comp<Inductor>(1e-3);
+	Inductor *L2 = c.add_comp<Inductor>(2e-3);
+	Inductor *L3 = c.add_comp<Inductor>(3e-3);
+	
+	gnd->to(volt)->to(R1)->to(L1)->to(L2)->to(R2)->to(gnd);
+	volt->flip();
+	L1->bot()->to(L3)->to(R3)->to(gnd);
+	
+	c.sim_to_time(1e-3);
+	
+	return {L1->current(), L2->current(), L3->current(), L3->voltage()};
+}
+
+// Cell with a 10 ohm resistor from its port to ground
+static SubcircuitDef *grounded_resistor_def() {
+	static SubcircuitDef def;
+	if(def.port_nodes().empty()) {
+		Circuit &cell = def.circuit();
+		Node *gnd = cell.add_node(0);
+		Node *port = cell.add_node();
+		def.add_port(port);
+		
+		Resistor *R1 = cell.add_comp<Resistor>(10);
+		port->to(R1)->to(gnd);
+	}
+	
+	return &def;
+}
+
+// Inductor whose only return path runs through a subcircuit instance
+static std::vector<double> inductor_into_instance(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	Node *in = c.add_node(), *mid = c.add_node(), *out = c.add_node();
+	
+	c.add_comp<VSource>(5, in, gnd);
+	c.add_comp<Resistor>(10, in, mid);
+	Inductor *L1 = c.add_comp<Inductor>(1e-3, mid, out);
+	c.add_instance(grounded_resistor_def(), {out});
+	L1->set_initial_cond(0);
+	
+	c.sim_to_time(2e-4);
+	
+	return {L1->current()};
+}
+
+// Same, with an unrelated capacitor so the circuit keeps other states
+static std::vector<double> inductor_into_instance_with_cap(Circuit &c) {
+	Node *gnd = c.add_node(0);
+	Node *in = c.add_node(), *mid = c.add_node(), *out = c.add_node(), *rc = c.add_node();
+	
+	c.add_comp<VSource>(5, in, gnd);
+	c.add_comp<Resistor>(10, in, mid);
+	Inductor *L1 = c.add_comp<Inductor>(1e-3, mid, out);
+	c.add_instance(grounded_resistor_def(), {out});
+	
+	c.add_comp<Resistor>(1e3, in, rc);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-7, rc, gnd);
+	L1->set_initial_cond(0);
+	C1->set_initial_cond(0);
+	
+	c.sim_to_time(2e-4);
+	
+	return {L1->current(), C1->voltage()};
+}
+
+// Results with capacitor loops and inductor cutsets reduced should match integrating every state
+static void reduced_states(const char *name, std::vector<double> (*build)(Circuit&)) {
+	Circuit full;
+	full.reduce_states = false;
+	const std::vector<double> expected = build(full);
+	
+	Circuit reduced;
+	const std::vector<double> got = build(reduced);
+	
+	for(size_t ind = 0; ind < got.size(); ind++)
+		check_close(name, got[ind], expected[ind], 1e-9);
+}
+
+// Switching mixed precision off after a single-precision factorization must refactorize in double precision
+static void mixed_precision_toggle() {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(5);
+	Resistor *R1 = c.add_comp<Resistor>(1e3);
+	Resistor *R2 = c.add_comp<Resistor>(3e3);
+	
+	gnd->to(volt)->to(R1)->to(R2)->to(gnd);
+	volt->flip();
+	
+	c.mixed_precision = true;
+	c.compute_dc_solution();
+	check_close("Divider in mixed precision", R2->voltage(), 3.75, 1e-12);
+	
+	c.mixed_precision = false;
+	c.compute_dc_solution();
+	check_close("Divider after turning mixed precision off", R2->voltage(), 3.75, 1e-12);
+	
+	c.mixed_precision = true;
+	c.compute_dc_solution();
+	check_close("Divider after turning mixed precision back on", R2->voltage(), 3.75, 1e-12);
+}
+
+// Transient in mixed precision refactorizes the single-precision copy as the timestep changes
+static void mixed_precision_transient() {
+	Circuit c_double;
+	const double expected = rc_charge(c_double);
+	
+	Circuit c_mixed;
+	c_mixed.mixed_precision = true;
+	check_close("RC in mixed precision", rc_charge(c_mixed), expected, 1e-9);
+}
+
+// A DC sweep leaves the circuit at its original value and solution
+static void dc_sweep_restore() {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(5);
+	Resistor *R1 = c.add_comp<Resistor>(1e3);
+	Resistor *R2 = c.add_comp<Resistor>(3e3);
+	
+	gnd->to(volt)->to(R1)->to(R2)->to(gnd);
+	volt->flip();
+	
+	c.compute_dc_solution();
+	DCSweepResult sweep = c.dc_sweep(volt, {0, 1});
+	check_close("Divider swept to 1V", sweep.voltage(R2, 1), 0.75, 1e-12);
+	check_close("Divider after sweep", R2->voltage(), 3.75, 1e-12);
+	check_close("Source after sweep", volt->voltage(), 5, 1e-12);
+}
+
+// Diode charging a capacitor from a PWM source, ending while the source is low
+// Returns the capacitor voltage at the end, and its sensitivities to R and C if requested
+static double pwm_rectifier(double r_value, double c_value, double *dv_dr = nullptr, double *dv_dc = nullptr) {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(c.add_mod<PWM>(0, 5, 1e3, 0.5));
+	Diode *D1 = c.add_comp<Diode>(1e-14);
+	Resistor *R1 = c.add_comp<Resistor>(r_value);
+	Capacitor *C1 = c.add_comp<Capacitor>(c_value);
+	
+	gnd->to(volt)->to(D1)->to(R1)->to(gnd);
+	volt->flip();
+	R1->top()->to(C1)->to(gnd);
+	C1->set_initial_cond(0);
+	
+	c.record_trajectory = dv_dr != nullptr;
+	c.sim_to_time(1.7e-3);
+	
+	if(dv_dr) {
+		auto sens = c.transient_sensitivity(C1);
+		*dv_dr = sens[R1];
+		*dv_dc = sens[C1];
+	}
+	
+	return C1->voltage();
+}
+
+// Transient sensitivities of a nonlinear circuit with a discontinuous source should match finite differences
+static void transient_sensitivity() {
+	double dv_dr, dv_dc;
+	pwm_rectifier(1e3, 1e-6, &dv_dr, &dv_dc);
+	
+	const double fd_dr = (pwm_rectifier(1e3*(1 + 1e-4), 1e-6) - pwm_rectifier(1e3*(1 - 1e-4), 1e-6))/(2e-4*1e3);
+	const double fd_dc = (pwm_rectifier(1e3, 1e-6*(1 + 1e-4)) - pwm_rectifier(1e3, 1e-6*(1 - 1e-4)))/(2e-4*1e-6);
+	
+	check_close("PWM rectifier dV/dR", dv_dr, fd_dr, 5e-3);
+	check_close("PWM rectifier dV/dC", dv_dc, fd_dc, 5e-3);
+}
+
+// Ten instances of an RC cell between a sine source and a load, every other one with R1 overridden
+static std::unique_ptr<Circuit> instance_circuit(SubcircuitDef *def, Resistor *cell_r1, double amp, double r1_value, Resistor **load) {
+	std::unique_ptr<Circuit> c(new Circuit());
+	Node *gnd = c->add_node(0);
+	
+	VSource *volt = c->add_comp<VSource>(c->add_mod<Sine>(10e3, amp));
+	Node *prev = c->add_node();
+	gnd->to(volt)->to(prev);
+	volt->flip();
+	
+	for(int ind = 0; ind < 10; ind++) {
+		Node *next = c->add_node();
+		if(ind % 2)
+			c->add_instance(def, {prev, next}, {{cell_r1, r1_value}});
+		else
+			c->add_instance(def, {prev, next});
+		prev = next;
+	}
+	
+	*load = c->add_comp<Resistor>(50);
+	prev->to(*load)->to(gnd);
+	
+	return c;
+}
+
+// Load voltage of an instance chain at 0.2ms
+static double instance_chain(SubcircuitDef *def, Resistor *cell_r1, double amp, double r1_value) {
+	Resistor *load;
+	std::unique_ptr<Circuit> c = instance_circuit(def, cell_r1, amp, r1_value, &load);
+	c->sim_to_time(2e-4);
+	
+	return load->voltage();
+}
+
+// Circuits sharing a subcircuit definition can be simulated at the same time
+static void shared_definition() {
+	SubcircuitDef def;
+	Circuit &cell = def.circuit();
+	Node *gnd = cell.add_node(0);
+	Node *a = cell.add_node(), *b = cell.add_node();
+	def.add_port(a);
+	def.add_port(b);
+	
+	Resistor *R1 = cell.add_comp<Resistor>(100);
+	Capacitor *C1 = cell.add_comp<Capacitor>(10e-9);
+	Resistor *R2 = cell.add_comp<Resistor>(20);
+	a->to(R1)->to(C1)->to(gnd);
+	C1->top()->to(R2)->to(b);
+	
+	const double expected_1 = instance_chain(&def, R1, 1, 150);
+	const double expected_2 = instance_chain(&def, R1, 2, 300);
+	
+	double got_1, got_2;
+	std::thread thread_1([&]() { got_1 = instance_chain(&def, R1, 1, 150); });
+	std::thread thread_2([&]() { got_2 = instance_chain(&def, R1, 2, 300); });
+	thread_1.join();
+	thread_2.join();
+	
+	check_close("Shared definition in parallel (first)", got_1, expected_1, 1e-12);
+	check_close("Shared definition in parallel (second)", got_2, expected_2, 1e-12);
+	
+	// Batched circuits sharing the definition, stepped on their own on several threads
+	Batch batch;
+	batch.group_size = 1;
+	batch.n_threads = 4;
+	std::vector<Resistor*> loads(8);
+	for(size_t ind = 0; ind < loads.size(); ind++)
+		batch.add(instance_circuit(&def, R1, ind % 2 ? 2 : 1, ind % 2 ? 300 : 150, &loads[ind]));
+	batch.sim_to_time(2e-4);
+	
+	for(size_t ind = 0; ind < loads.size(); ind++)
+		check_close("Shared definition in a batch", loads[ind]->voltage(), ind % 2 ? expected_2 : expected_1, 1e-9);
+	check_close("Definition's overridden value", R1->get_value(), 100, 0);
+	
+	// A cell that can't be solved (floating internal node in DC) leaves its definition as it was
+	SubcircuitDef bad_def;
+	Circuit &bad_cell = bad_def.circuit();
+	Node *bad_gnd = bad_cell.add_node(0);
+	Node *p = bad_cell.add_node();
+	bad_def.add_port(p);
+	
+	Resistor *R3 = bad_cell.add_comp<Resistor>(100);
+	Capacitor *C2 = bad_cell.add_comp<Capacitor>(1e-9);
+	Capacitor *C3 = bad_cell.add_comp<Capacitor>(1e-9);
+	p->to(R3)->to(C2)->to(C3)->to(bad_gnd);
+	
+	Circuit c;
+	Node *c_gnd = c.add_node(0);
+	VSource *volt = c.add_comp<VSource>(1);
+	Node *top = c.add_node();
+	c_gnd->to(volt)->to(top);
+	volt->flip();
+	c.add_instance(&bad_def, {top}, {{R3, 200}});
+	
+	bool threw = false;
+	try {
+		c.compute_dc_solution();
+	}
+	catch(const std::runtime_error&) {
+		threw = true;
+	}
+	
+	check_close("Unsolvable cell throws", threw, 1, 0);
+	check_close("Unsolvable cell's overridden value", R3->get_value(), 100, 0);
+}
+
+// RC filter driven by a PWM source, with its resistor and duty cycle given
+static std::unique_ptr<Circuit> pwm_filter(Resistor **r1, PWM **pwm, Capacitor **c1) {
+	std::unique_ptr<Circuit> c(new Circuit());
+	Node *gnd = c->add_node(0);
+	
+	*pwm = c->add_mod<PWM>(0, 5, 20e3, 0.5);
+	VSource *volt = c->add_comp<VSource>(*pwm);
+	*r1 = c->add_comp<Resistor>(1e3);
+	*c1 = c->add_comp<Capacitor>(1e-7);
+	Resistor *R2 = c->add_comp<Resistor>(5e3);
+	
+	gnd->to(volt)->to(*r1)->to(*c1)->to(gnd);
+	volt->flip();
+	(*c1)->top()->to(R2)->to(gnd);
+	
+	return c;
+}
+
+// Lanes of an ensemble (fewer than a block of lanes) should match simulating each variant on its own,
+// up to the difference the shared timesteps make
+static void ensemble_lanes() {
+	Resistor *R1;
+	PWM *pwm;
+	Capacitor *C1;
+	std::unique_ptr<Circuit> proto = pwm_filter(&R1, &pwm, &C1);
+	
+	const size_t lanes = 3;
+	Ensemble ens(*proto, lanes);
+	for(size_t l = 0; l < lanes; l++) {
+		ens.map(l).component(R1)->set_value(500 + 250*l);
+		ens.map(l).modulator(pwm)->set_duty(0.2 + 0.3*l);
+	}
+	ens.sim_to_time(5e-4);
+	
+	for(size_t l = 0; l < lanes; l++) {
+		Resistor *R1_single;
+		PWM *pwm_single;
+		Capacitor *C1_single;
+		std::unique_ptr<Circuit> c = pwm_filter(&R1_single, &pwm_single, &C1_single);
+		R1_single->set_value(500 + 250*l);
+		pwm_single->set_duty(0.2 + 0.3*l);
+		c->sim_to_time(5e-4);
+		
+		check_close("Ensemble lane", ens.map(l).component(C1)->voltage(), C1_single->voltage(), 1e-3);
+	}
+}
+
+// Sine-driven RC filter with the given error limits, sampled at 1ms
+static std::unique_ptr<Circuit> sine_filter(double max_e_rel, Capacitor **c1) {
+	std::unique_ptr<Circuit> c(new Circuit(1e-15, 1e-4, 1e-12, max_e_rel));
+	Node *gnd = c->add_node(0);
+	
+	VSource *volt = c->add_comp<VSource>(c->add_mod<Sine>(1e3, 5));
+	Resistor *R1 = c->add_comp<Resistor>(1e3);
+	*c1 = c->add_comp<Capacitor>(1e-7);
+	
+	gnd->to(volt)->to(R1)->to(*c1)->to(gnd);
+	volt->flip();
+	
+	return c;
+}
+
+// Circuits in a batch are only grouped with circuits stepped the same way, so each gets its own error limits
+static void batch_settings() {
+	const double tolerances[] = {1e-2, 1e-7, 1e-2, 1e-7};
+	
+	Batch batch;
+	std::vector<Capacitor*> caps;
+	for(double tol:tolerances) {
+		Capacitor *C1;
+		batch.add(sine_filter(tol, &C1));
+		caps.push_back(C1);
+	}
+	batch.sim_to_time(1e-3);
+	
+	for(size_t ind = 0; ind < caps.size(); ind++) {
+		Capacitor *C1;
+		std::unique_ptr<Circuit> c = sine_filter(tolerances[ind], &C1);
+		c->sim_to_time(1e-3);
+		
+		check_close("Batch circuit's own error limits", caps[ind]->voltage(), C1->voltage(), 1e-9);
+	}
+}
+
+// Variants run in forked processes should match the same sweep on threads, and leave the prototype as it was
+static void sweep_processes() {
+	Resistor *R1;
+	PWM *pwm;
+	Capacitor *C1;
+	std::unique_ptr<Circuit> proto = pwm_filter(&R1, &pwm, &C1);
+	proto->sim_to_time(2e-4);
+	
+	ParameterSweep sweep(*proto);
+	sweep.add_param(R1, {500, 1000, 2000});
+	sweep.add_voltage(C1);
+	sweep.n_processes = 2;
+	
+	const ParameterSweepResult threads = sweep.run(5e-4);
+	const ParameterSweepResult processes = sweep.run_processes(*proto, 5e-4);
+	
+	for(size_t variant = 0; variant < threads.size(); variant++)
+		check_close("Sweep variant in a process", processes.output(variant, 0), threads.output(variant, 0), 1e-12);
+	
+	check_close("Prototype after sweeping in processes", proto->time(), 2e-4, 1e-12);
+	check_close("Prototype's value after sweeping in processes", R1->get_value(), 1e3, 0);
+	
+	// Processes only run the sweep's own prototype
+	Circuit other;
+	bool threw = false;
+	try {
+		sweep.run_processes(other, 5e-4);
+	}
+	catch(const std::invalid_argument&) {
+		threw = true;
+	}
+	
+	check_close("Sweeping another circuit in processes throws", threw, 1, 0);
+}
+
+// Port impedances of a freshly built circuit, before anything else generated its matrix
+static void fresh_impedance() {
+	for(int pass = 0; pass < 2; pass++) {
+		Circuit c;
+		Node *gnd = c.add_node(0);
+		Node *port = c.add_node();
+		c.add_comp<Resistor>(50, port, gnd);
+		
+		if(pass == 0)
+			check_close("DC impedance of a fresh circuit", c.dc_impedance({port})(0, 0), 50, 1e-12);
+		else
+			check_close("AC impedance of a fresh circuit", std::abs(c.ac_impedance({port}, {1e3})[0](0, 0)), 50, 1e-12);
+	}
+}
+
+// Behavioral expressions: compiled code, constant folding, tables, and sources built on them
+static void behavioral_sources() {
+	parser::ExpressionCompiler compiler({{"gain", 2.5}});
+	
+	// Inputs are time, then the nodes in the order the expression names them
+	Bytecode square = compiler.compile("2*V(in)**2+1");
+	const double x[2] = {0, 1.5};
+	double grad[2];
+	check_close("Compiled 2*V(in)**2+1", square.eval(x, grad), 5.5, 1e-12);
+	check_close("Compiled 2*V(in)**2+1 derivative", grad[1], 6, 1e-12);
+	
+	Bytecode folded = compiler.compile("gain*2 + sin(pi/2)");
+	check_close("Folded constant expression", folded.eval(x), 6, 1e-12);
+	check_close("Folded constant expression instructions", folded.n_instructions(), 0, 0);
+	
+	Bytecode table = compiler.compile("table(V(a), 0,0, 1,2, 2,2)");
+	const double x_mid[2] = {0, 0.5}, x_flat[2] = {0, 1.5};
+	check_close("Table between points", table.eval(x_mid), 1, 1e-12);
+	check_close("Table on its flat part", table.eval(x_flat), 2, 1e-12);
+	
+	const std::unordered_map<std::string, double> no_params;
+	
+	// Nonlinear VCVS from a fixed input
+	{
+		Circuit c;
+		Node *gnd = c.add_node(0), *in = c.add_node(1.5), *out = c.add_node();
+		c.add_comp<BVSource>(std::string("2*V(in)**2+1"), std::unordered_map<std::string, Node*>{{"in", in}}, no_params, out, gnd);
+		c.add_comp<Resistor>(1e3, out, gnd);
+		c.compute_dc_solution();
+		
+		check_close("BVSource 2*V(in)**2+1", out->voltage(), 5.5, 1e-9);
+	}
+	
+	// VCCS into a resistor
+	{
+		Circuit c;
+		Node *gnd = c.add_node(0), *in = c.add_node(1.5), *out = c.add_node();
+		c.add_comp<BISource>(std::string("1m*V(in)"), std::unordered_map<std::string, Node*>{{"in", in}}, no_params, out, gnd);
+		c.add_comp<Resistor>(2e3, out, gnd);
+		c.compute_dc_solution();
+		
+		check_close("BISource 1m*V(in) into 2k", std::abs(out->voltage()), 3, 1e-9);
+	}
+	
+	// Source following time
+	{
+		Circuit c;
+		Node *gnd = c.add_node(0), *out = c.add_node();
+		c.add_comp<BVSource>(std::string("2*sin(2*pi*1k*time)"), std::unordered_map<std::string, Node*>{}, no_params, out, gnd);
+		c.add_comp<Resistor>(1e3, out, gnd);
+		c.sim_to_time(0.25e-3);
+		
+		check_close("BVSource 2*sin(2*pi*1k*time) at 0.25ms", out->voltage(), 2, 1e-9);
+	}
+}
+
+// RC low-pass at its corner frequency, and the node and component lookups of the result
+static void ac_lowpass() {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(5);
+	volt->ac_mag = 1;
+	Resistor *R1 = c.add_comp<Resistor>(1e3);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-6);
+	
+	gnd->to(volt)->to(R1)->to(C1)->to(gnd);
+	volt->flip();
+	
+	const double corner = 1/(2*M_PI*1e3*1e-6);
+	const ACResult result = c.ac_analysis({corner/10, corner});
+	
+	const std::complex<double> h = result.voltage(C1, 1);
+	check_close("RC low-pass magnitude at the corner", std::abs(h), M_SQRT1_2, 1e-9);
+	check_close("RC low-pass phase at the corner", std::arg(h)*180/M_PI, -45, 1e-9);
+	check_close("RC low-pass node voltage lookup", std::abs(result.voltage(C1->top(), 1) - result.voltage(C1->bot(), 1)), M_SQRT1_2, 1e-9);
+	check_close("RC low-pass current lookup", std::abs(result.current(R1, 0)), std::abs(result.current(C1, 0)), 1e-9);
+	check_close("RC low-pass frequencies", result.freqs()[1], corner, 0);
+}
+
+// 20-section RC ladder between ports a and b, driven by a 250kHz sine through 50 ohms and loaded by 1k
+static void rc_ladder(Circuit &c, Node **a, Node **b) {
+	Node *gnd = c.add_node(0);
+	Node *in = c.add_node();
+	*a = c.add_node();
+	
+	c.add_comp<VSource>(c.add_mod<Sine>(250e3, 1), in, gnd);
+	c.add_comp<Resistor>(50, in, *a);
+	
+	Node *prev = *a;
+	for(int ind = 0; ind < 20; ind++) {
+		Node *next = c.add_node();
+		c.add_comp<Resistor>(100, prev, next);
+		c.add_comp<Capacitor>(1e-12, next, gnd);
+		prev = next;
+	}
+	
+	*b = prev;
+	c.add_comp<Resistor>(1e3, *b, gnd);
+}
+
+// Small network (a - R - m - R - b, C from m to ground) whose capacitor can't be absorbed
+// Returns the number of internal nodes reduce_network() made and the voltage at b
+static std::vector<double> kept_network(bool reduce, bool modulated) {
+	Circuit c(1e-15, 2e-9);
+	Node *gnd = c.add_node(0);
+	Node *in = c.add_node(), *a = c.add_node(), *m = c.add_node(), *b = c.add_node();
+	
+	c.add_comp<VSource>(c.add_mod<Sine>(5e6, 1), in, gnd);
+	c.add_comp<Resistor>(50, in, a);
+	c.add_comp<Resistor>(100, a, m);
+	c.add_comp<Resistor>(100, m, b);
+	c.add_comp<Resistor>(1e3, b, gnd);
+	
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-11, m, gnd);
+	if(modulated)
+		C1->set_value(c.add_mod<Sine>(1e6, 1e-12, 1e-11));
+	else
+		C1->set_initial_cond(0.5);
+	
+	const double n_internal = reduce ? c.reduce_network({a, b}, 2) : 0;
+	c.sim_to_time(3e-7);
+	
+	return {n_internal, b->voltage()};
+}
+
+// A reduced RC ladder should follow the flat one, and capacitors that can't be absorbed keep their nodes
+static void network_reduction() {
+	Circuit flat(1e-15, 2e-9), reduced(1e-15, 2e-9);
+	Node *flat_a, *flat_b, *reduced_a, *reduced_b;
+	rc_ladder(flat, &flat_a, &flat_b);
+	rc_ladder(reduced, &reduced_a, &reduced_b);
+	
+	check_close("Reduced RC ladder internal nodes", reduced.reduce_network({reduced_a, reduced_b}, 2), 4, 0);
+	
+	// Near the source's second peak
+	flat.sim_to_time(5e-6);
+	reduced.sim_to_time(5e-6);
+	check_close("Reduced RC ladder output", reduced_b->voltage(), flat_b->voltage(), 3e-4);
+	check_close("Reduced RC ladder input", reduced_a->voltage(), flat_a->voltage(), 3e-4);
+	
+	for(bool modulated:{false, true}) {
+		const std::vector<double> expected = kept_network(false, modulated);
+		const std::vector<double> got = kept_network(true, modulated);
+		
+		check_close(modulated ? "Modulated capacitor's network internal nodes" : "Initial condition capacitor's network internal nodes", got[0], 0, 0);
+		check_close(modulated ? "Modulated capacitor's network output" : "Initial condition capacitor's network output", got[1], expected[1], 1e-12);
+	}
+}
+
+// Bus of RC cells behind series resistors; each cell (with an inductor branch) is condensed as a subcircuit if asked
+// Returns the voltages along the bus, in DC and then after a transient
+static std::vector<double> cell_bus(bool condense) {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	Node *prev = c.add_node();
+	VSource *volt = c.add_comp<VSource>(1, prev, gnd);
+	
+	std::vector<Node*> bus;
+	for(int cell = 0; cell < 4; cell++) {
+		Node *b = c.add_node();
+		c.add_comp<Resistor>(10 + cell, prev, b);
+		bus.push_back(b);
+		prev = b;
+		
+		std::vector<TwoTerminalComponent*> comps;
+		Node *p = b;
+		for(int ind = 0; ind < 5; ind++) {
+			Node *x = c.add_node();
+			comps.push_back(c.add_comp<Resistor>(100*(1 + ind % 3), p, x));
+			comps.push_back(c.add_comp<Capacitor>(1e-9*(1 + ind % 2), x, gnd));
+			p = x;
+		}
+		
+		Node *y = c.add_node();
+		comps.push_back(c.add_comp<Inductor>(1e-6, p, y));
+		comps.push_back(c.add_comp<Resistor>(1e3, y, gnd));
+		
+		if(condense)
+			c.add_subcircuit(comps);
+	}
+	
+	std::vector<double> result;
+	c.compute_dc_solution();
+	for(Node *b:bus)
+		result.push_back(b->voltage());
+	
+	c.sim_to_time(1e-12);
+	volt->set_value(2);
+	c.sim_to_time(2e-6);
+	for(Node *b:bus)
+		result.push_back(b->voltage());
+	
+	return result;
+}
+
+// Condensed subcircuits should give the same solution as the flat circuit
+static void condensed_subcircuits() {
+	const std::vector<double> expected = cell_bus(false);
+	const std::vector<double> got = cell_bus(true);
+	
+	for(size_t ind = 0; ind < got.size(); ind++)
+		check_close(ind < got.size()/2 ? "Condensed subcircuit bus in DC" : "Condensed subcircuit bus in transient", got[ind], expected[ind], 1e-12);
+}
+
+// RC ladder that gets a resistor and capacitor added halfway through a transient, and the resistor removed later,
+// either re-generating only the changed rows or (with full) the whole matrix
+// Returns the voltages at the edited node and the end of the ladder
+static std::vector<double> edited_ladder(bool full) {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	Node *prev = c.add_node();
+	c.add_comp<VSource>(1, prev, gnd);
+	
+	std::vector<Node*> ladder;
+	for(int ind = 0; ind < 20; ind++) {
+		Node *next = c.add_node();
+		c.add_comp<Resistor>(100, prev, next);
+		c.add_comp<Capacitor>(1e-10, 0.0, next, gnd);
+		ladder.push_back(next);
+		prev = next;
+	}
+	
+	c.sim_to_time(2e-7);
+	
+	Node *edited = ladder[10];
+	Resistor *R1 = c.add_comp<Resistor>(50, edited, gnd);
+	c.add_comp<Capacitor>(2e-10, edited, gnd);
+	if(full)
+		c.topology_changed();
+	c.sim_to_time(4e-7);
+	
+	c.remove_comp(R1);
+	if(full)
+		c.topology_changed();
+	c.sim_to_time(6e-7);
+	
+	return {edited->voltage(), ladder.back()->voltage()};
+}
+
+// Editing a running transient row by row should match re-generating the whole matrix
+static void incremental_edits() {
+	const std::vector<double> expected = edited_ladder(true);
+	const std::vector<double> got = edited_ladder(false);
+	
+	check_close("Edited node after adding and removing parts", got[0], expected[0], 1e-12);
+	check_close("End of the edited ladder", got[1], expected[1], 1e-12);
+}
+
+// RC divider charging a capacitor from a source of the given voltage, from 0V
+static double rc_divider(Circuit &c, double source, VSource **volt, Capacitor **c1) {
+	if(!*volt) {
+		Node *gnd = c.add_node(0);
+		Node *in = c.add_node(), *out = c.add_node();
+		
+		*volt = c.add_comp<VSource>(source, in, gnd);
+		c.add_comp<Resistor>(1e3, in, out);
+		c.add_comp<Resistor>(3e3, out, gnd);
+		*c1 = c.add_comp<Capacitor>(1e-9, out, gnd);
+	}
+	
+	(*volt)->set_value(source);
+	(*c1)->set_initial_cond(0);
+	c.sim_to_time(1e-6);
+	
+	return (*c1)->voltage();
+}
+
+// A circuit run again after reset() (keeping its matrices) should match a fresh one,
+// and switching back to DC analysis should pick up changed values
+static void reset_reuse() {
+	Circuit c;
+	VSource *volt = nullptr;
+	Capacitor *C1 = nullptr;
+	rc_divider(c, 1, &volt, &C1);
+	
+	c.reset();
+	const double got = rc_divider(c, 2, &volt, &C1);
+	
+	Circuit fresh;
+	VSource *fresh_volt = nullptr;
+	Capacitor *fresh_c1 = nullptr;
+	check_close("Transient after reset", got, rc_divider(fresh, 2, &fresh_volt, &fresh_c1), 1e-12);
+	
+	// Divider with a capacitor on its output, run in transient, then solved in DC again with a new source value
+	Circuit divider;
+	Node *gnd = divider.add_node(0);
+	Node *in = divider.add_node(), *out = divider.add_node();
+	VSource *div_volt = divider.add_comp<VSource>(5, in, gnd);
+	divider.add_comp<Resistor>(1e3, in, out);
+	divider.add_comp<Resistor>(3e3, out, gnd);
+	Capacitor *C2 = divider.add_comp<Capacitor>(1e-9, out, gnd);
+	
+	divider.sim_to_time(1e-6);
+	divider.reset();
+	div_volt->set_value(4);
+	divider.compute_dc_solution();
+	check_close("DC solution after reset", C2->voltage(), 3, 1e-12);
+	
+	divider.sim_to_time(1e-6);
+	check_close("Transient after reset from a DC solution", C2->voltage(), 3, 1e-9);
+}
+
+// Orderings written to a cache directory are found again after the in-memory copies are forgotten
+static void ordering_cache() {
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("spice-orderings-" + std::to_string(std::random_device()()));
+	OrderingCache::set_directory(dir.string());
+	OrderingCache::clear();
+	
+	const uint64_t key = 0x123456789abcdefull;
+	const std::vector<int> perm = {3, 0, 4, 1, 2};
+	OrderingCache::store(key, perm);
+	OrderingCache::clear();
+	
+	std::vector<int> found;
+	check_close("Ordering found in the cache directory", OrderingCache::find(key, perm.size(), found), 1, 0);
+	check_close("Ordering read back unchanged", found == perm, 1, 0);
+	
+	OrderingCache::clear();
+	check_close("Ordering of another size not found", OrderingCache::find(key, perm.size() + 1, found), 0, 0);
+	
+	// A circuit built again in a "new process" reuses the ordering of the first one
+	Circuit first;
+	const double expected = rc_charge(first);
+	OrderingCache::clear();
+	
+	const unsigned long hits = OrderingCache::hits();
+	Circuit second;
+	check_close("Transient with a cached ordering", rc_charge(second), expected, 0);
+	check_close("Cached ordering used", OrderingCache::hits() > hits, 1, 0);
+	
+	OrderingCache::set_directory("");
+	OrderingCache::clear();
+	std::filesystem::remove_all(dir);
+}
+
+// Step through 50R into a matched 1ns line, loaded by 50R: the load sees half the step one delay later
+static void matched_line() {
+	Circuit c(1e-13, 1e-10);
+	Node *gnd = c.add_node(0);
+	Node *in = c.add_node(), *a = c.add_node(), *b = c.add_node();
+	PWL *step = c.add_mod<PWL>(std::vector<double>{2e-9, 2e-9}, std::vector<double>{0, 1});
+	c.add_comp<VSource>(step, in, gnd);
+	c.add_comp<Resistor>(50, in, a);
+	c.add_comp<TransmissionLine>(50, 1e-9, a, gnd, b, gnd);
+	c.add_comp<Resistor>(50, b, gnd);
+	
+	c.compute_dc_solution();
+	
+	double before = 0, arrival = 0;
+	while(c.time() < 5e-9) {
+		c.sim_single_step();
+		if(b->voltage() < 0.25)
+			before = std::max(before, std::abs(b->voltage()));
+		else if(arrival == 0)
+			arrival = c.time();
+	}
+	
+	check_close("Matched line output before the step arrives", before, 0, 0);
+	check_close("Matched line step arrival", arrival, 3e-9, 1e-12);
+	check_close("Matched line output after the step", b->voltage(), 0.5, 1e-12);
+	check_close("Matched line input after the step", a->voltage(), 0.5, 1e-12);
+}
+
+// Ramp up to 2 at x=1, vertical step to 5, ramp down to 1 at x=3, then held
+// Table, builtin::table, a compiled table() and a PWL (in microseconds) should agree at and between the corners
+static void piecewise_linear() {
+	const std::vector<double> xs = {0, 1, 1, 3, 4}, ys = {0, 2, 5, 1, 1};
+	const std::vector<double> at = {-1, 0, 0.5, 0.999, 1, 2, 3, 3.5, 5};
+	const std::vector<double> expected = {0, 0, 1, 1.998, 5, 3, 1, 1, 1};
+	
+	Table table(xs, ys);
+	std::vector<double> batch(at.size());
+	table.at(at.data(), batch.data(), at.size());
+	
+	parser::ExpressionCompiler compiler;
+	Bytecode compiled = compiler.compile("table(V(a), 0,0, 1,2, 1,5, 3,1, 4,1)");
+	
+	Circuit c;
+	Node *gnd = c.add_node(0), *in = c.add_node();
+	std::vector<double> times;
+	for(double x:xs)
+		times.push_back(x*1e-6);
+	PWL *pwl = c.add_mod<PWL>(times, ys);
+	c.add_comp<VSource>(pwl, in, gnd);
+	c.add_comp<Resistor>(1e3, in, gnd);
+	c.compute_dc_solution();
+	
+	char name[64];
+	for(size_t ind = 0; ind < at.size(); ind++) {
+		snprintf(name, sizeof(name), "Table at %g", at[ind]);
+		check_close(name, table.at(at[ind]), expected[ind], 1e-12);
+		snprintf(name, sizeof(name), "Batched table at %g", at[ind]);
+		check_close(name, batch[ind], expected[ind], 1e-12);
+		snprintf(name, sizeof(name), "builtin::table at %g", at[ind]);
+		check_close(name, builtin::table(at[ind], 0,0, 1,2, 1,5, 3,1, 4,1), expected[ind], 1e-12);
+		snprintf(name, sizeof(name), "Compiled table at %g", at[ind]);
+		const double x[2] = {0, at[ind]};
+		check_close(name, compiled.eval(x), expected[ind], 1e-12);
+		
+		if(at[ind] > 0) {
+			c.sim_to_time(at[ind]*1e-6);
+			snprintf(name, sizeof(name), "PWL at %gus", at[ind]);
+			check_close(name, in->voltage(), expected[ind], 1e-9);
+		}
+	}
+}
+
+// Samples written in each format read back through value_at, at and between the sample times
+// Sample k is at 1us + k us; sample times are breakpoints only when asked for
+static void sample_streams() {
+	const std::vector<double> samples = {-1.5, 0.25, 2, 0.5};
+	const std::string path = (std::filesystem::temp_directory_path() / ("spice-samples-" + std::to_string(std::random_device()()) + ".smp")).string();
+	const char *type_names[] = {"Int16", "Int32", "Float32", "Float64"};
+	
+	char name[96];
+	for(SampleStream::Type type:{SampleStream::Int16, SampleStream::Int32, SampleStream::Float32, SampleStream::Float64}) {
+		SampleStream::write_file(path, samples, 1e6, type, 1e-6, 1e-3, 0.1);
+		
+		Circuit c;
+		Node *gnd = c.add_node(0), *in = c.add_node();
+		SampleStream *stream = c.add_mod<SampleStream>(path);
+		c.add_comp<VSource>(stream, in, gnd);
+		c.add_comp<Resistor>(1e3, in, gnd);
+		
+		snprintf(name, sizeof(name), "%s stream size", type_names[type]);
+		check_close(name, stream->size(), samples.size(), 0);
+		
+		for(size_t ind = 0; ind < samples.size(); ind++) {
+			snprintf(name, sizeof(name), "%s sample %zu", type_names[type], ind);
+			check_close(name, stream->value_at(1e-6*(ind + 1)), samples[ind], 1e-6);
+		}
+		
+		snprintf(name, sizeof(name), "%s between samples", type_names[type]);
+		check_close(name, stream->value_at(2.25e-6), 0.25 + 0.25*(2 - 0.25), 1e-6);
+		snprintf(name, sizeof(name), "%s before the recording", type_names[type]);
+		check_close(name, stream->value_at(0), samples.front(), 1e-6);
+		snprintf(name, sizeof(name), "%s after the recording", type_names[type]);
+		check_close(name, stream->value_at(9e-6), samples.back(), 1e-6);
+		
+		snprintf(name, sizeof(name), "%s without sample breakpoints", type_names[type]);
+		check_close(name, stream->next_change_time(), std::numeric_limits<double>::max(), 0);
+		
+		stream->sample_breakpoints = true;
+		c.compute_dc_solution();
+		snprintf(name, sizeof(name), "%s breakpoint before the recording", type_names[type]);
+		check_close(name, stream->next_change_time(), 1e-6, 1e-12);
+		
+		c.sim_to_time(2.5e-6);
+		snprintf(name, sizeof(name), "%s breakpoint after 2.5us", type_names[type]);
+		check_close(name, stream->next_change_time(), 3e-6, 1e-12);
+		snprintf(name, sizeof(name), "%s source at 2.5us", type_names[type]);
+		check_close(name, in->voltage(), stream->value_at(2.5e-6), 1e-9);
+		
+		c.sim_to_time(4e-6);
+		snprintf(name, sizeof(name), "%s breakpoint at the last sample", type_names[type]);
+		check_close(name, stream->next_change_time(), std::numeric_limits<double>::max(), 0);
+	}
+	
+	std::remove(path.c_str());
+}
+
+// PWM into a series RLC, cloned mid-transient: the clone should continue exactly like the original
+static void clone_continuation() {
+	Circuit c;
+	Node *gnd = c.add_node(0);
+	
+	VSource *volt = c.add_comp<VSource>(c.add_mod<PWM>(0, 5, 20e3, 0.3));
+	Resistor *R1 = c.add_comp<Resistor>(10);
+	Inductor *L1 = c.add_comp<Inductor>(1e-3);
+	Capacitor *C1 = c.add_comp<Capacitor>(1e-6);
+	
+	gnd->to(volt)->to(R1)->to(L1)->to(C1)->to(gnd);
+	volt->flip();
+	
+	c.sim_to_time(0.33e-3);
+	
+	CloneMap map;
+	std::unique_ptr<Circuit> copy = c.clone(&map);
+	
+	c.sim_to_time(1e-3);
+	copy->sim_to_time(1e-3);
+	
+	check_close("Clone time", copy->time(), c.time(), 0);
+	check_close("Clone capacitor voltage", map.component(C1)->voltage(), C1->voltage(), 1e-12);
+	check_close("Clone inductor current", map.component(L1)->current(), L1->current(), 1e-12);
+}
+
+int main() {
+	timestep_limits();
+	
+	reduced_states("Parallel capacitors", parallel_caps);
+	reduced_states("Capacitor triangle", cap_triangle);
+	reduced_states("Inductor star", inductor_star);
+	reduced_states("Inductor into an instance", inductor_into_instance);
+	reduced_states("Inductor into an instance, with a capacitor", inductor_into_instance_with_cap);
+	
+	mixed_precision_toggle();
+	mixed_precision_transient();
+	dc_sweep_restore();
+	transient_sensitivity();
+	shared_definition();
+	ensemble_lanes();
+	batch_settings();
+	sweep_processes();
+	fresh_impedance();
+	behavioral_sources();
+	ac_lowpass();
+	network_reduction();
+	condensed_subcircuits();
+	incremental_edits();
+	reset_reuse();
+	ordering_cache();
+	matched_line();
+	piecewise_linear();
+	sample_streams();
+	clone_continuation();
+	
+	if(failures) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	
+	return 0;
+}
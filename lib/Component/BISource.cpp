@@ -0,0 +1,13 @@
+#include "Component/BISource.hpp"
+
+namespace spice {
+
+Expression BISource::dc_i_expr() const {
+	return linear_expr();
+}
+
+Component *BISource::clone() const {
+	return new BISource(*this);
+}
+
+}
@@ -0,0 +1,20 @@
+/*
+	It's a behavioral current source (current is an expression of node voltages and time)
+*/
+
+#pragma once
+
+#include "Core/BehavioralComponent.hpp"
+
+namespace spice {
+
+class BISource: public BehavioralComponent {
+	// Inherit constructor
+	using BehavioralComponent::BehavioralComponent;
+	
+	virtual Component *clone() const;
+	
+	virtual Expression dc_i_expr() const;
+};
+
+}
@@ -0,0 +1,13 @@
+#include "Component/BVSource.hpp"
+
+namespace spice {
+
+Expression BVSource::dc_v_expr() const {
+	return linear_expr();
+}
+
+Component *BVSource::clone() const {
+	return new BVSource(*this);
+}
+
+}
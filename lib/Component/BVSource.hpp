@@ -0,0 +1,20 @@
+/*
+	It's a behavioral voltage source (voltage is an expression of node voltages and time)
+*/
+
+#pragma once
+
+#include "Core/BehavioralComponent.hpp"
+
+namespace spice {
+
+class BVSource: public BehavioralComponent {
+	// Inherit constructor
+	using BehavioralComponent::BehavioralComponent;
+	
+	virtual Component *clone() const;
+	
+	virtual Expression dc_v_expr() const;
+};
+
+}
@@ -17,9 +17,10 @@ Expression Capacitor::tran_i_expr() const {
 	// Convert to Norton
 	//   I = Vcap*C/dt
 	//   R = dt/C
-	return {{-1, {this->var,     &this->value}, {parent_circuit->dt()}},
-	        { 1, {node_top->v(), &this->value}, {parent_circuit->dt()}},
-	        {-1, {node_bot->v(), &this->value}, {parent_circuit->dt()}}};
+	Expression expr = scaled_state(-1, {&this->value}, {parent_circuit->dt()});
+	expr.push_back({ 1, {node_top->v(), &this->value}, {parent_circuit->dt()}});
+	expr.push_back({-1, {node_bot->v(), &this->value}, {parent_circuit->dt()}});
+	return expr;
 }
 
 Expression Capacitor::dc_v_expr() const {
@@ -42,8 +43,17 @@ Expression Capacitor::dydt_expr() const {
 	        {-1, {node_bot->v()}, {parent_circuit->dt()}}};
 }
 
+std::complex<double> Capacitor::ac_admittance(double omega) const {
+	// Y = jwC
+	return {0, omega*value};
+}
+
 void Capacitor::gen_initial_cond() {
 	initial_cond = voltage();
 }
 
+Component *Capacitor::clone() const {
+	return new Capacitor(*this);
+}
+
 }
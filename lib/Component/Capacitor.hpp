@@ -12,11 +12,14 @@ class Capacitor: public IntegratingComponent {
 	// Inherit constructor
 	using IntegratingComponent::IntegratingComponent;
 	
+	virtual Component *clone() const;
+	
 	virtual Expression tran_v_expr() const;
 	virtual Expression tran_i_expr() const;
 	virtual Expression dc_v_expr() const;
 	virtual Expression dc_i_expr() const;
 	virtual Expression dydt_expr() const;
+	virtual std::complex<double> ac_admittance(double omega) const;
 	
 	virtual void gen_initial_cond();
 };
@@ -0,0 +1,38 @@
+#include "Component/Diode.hpp"
+
+#include <cmath>
+
+namespace spice {
+
+void Diode::eval(double v, double &i, double &g) const {
+	const double vt = emission_coeff*thermal_voltage;
+	const double e = std::exp(v/vt);
+	
+	// I = Is*(e^(V/(n*Vt)) - 1)
+	i = value*(e - 1) + gmin*v;
+	g = value*e/vt + gmin;
+}
+
+double Diode::limit_voltage(double v_new, double v_old) const {
+	// SPICE pnjlim: limit steps in forward bias to a logarithmic change in voltage
+	// above the point where the exponential's curvature is largest
+	const double vt = emission_coeff*thermal_voltage;
+	const double v_crit = vt*std::log(vt/(std::sqrt(2.0)*value));
+	
+	if(v_new > v_crit && std::abs(v_new - v_old) > 2*vt) {
+		if(v_old > 0) {
+			const double arg = 1 + (v_new - v_old)/vt;
+			return arg > 0 ? v_old + vt*std::log(arg) : v_crit;
+		}
+		
+		return vt*std::log(v_new/vt);
+	}
+	
+	return v_new;
+}
+
+Component *Diode::clone() const {
+	return new Diode(*this);
+}
+
+}
@@ -0,0 +1,29 @@
+/*
+	It's a diode (Shockley equation, value is the saturation current)
+*/
+
+#pragma once
+
+#include "Core/NonlinearComponent.hpp"
+
+namespace spice {
+
+class Diode: public NonlinearComponent {
+	// Inherit constructor
+	using NonlinearComponent::NonlinearComponent;
+	
+	virtual Component *clone() const;
+	
+	virtual void eval(double v, double &i, double &g) const;
+	virtual double limit_voltage(double v_new, double v_old) const;
+	
+public:
+	// Emission coefficient and thermal voltage (kT/q)
+	double emission_coeff = 1;
+	double thermal_voltage = 0.025852;
+	
+	// Small conductance in parallel with the junction so the matrix stays non-singular when it's off
+	double gmin = 1e-12;
+};
+
+}
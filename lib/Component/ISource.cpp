@@ -1,9 +1,19 @@
 #include "Component/ISource.hpp"
 
+#include <cmath>
+
 namespace spice {
 
 Expression ISource::dc_i_expr() const {
 	return {{1, {&this->value}, {}}};
 }
 
+std::complex<double> ISource::ac_source() const {
+	return std::polar(ac_mag, ac_phase*M_PI/180);
+}
+
+Component *ISource::clone() const {
+	return new ISource(*this);
+}
+
 }
@@ -12,7 +12,16 @@ class ISource: public TwoTerminalComponent {
 	// Inherit constructor
 	using TwoTerminalComponent::TwoTerminalComponent;
 	
+	virtual Component *clone() const;
+	
 	virtual Expression dc_i_expr() const;
+	
+	virtual std::complex<double> ac_source() const;
+	
+public:
+	// Small-signal magnitude and phase (degrees) in AC analysis
+	double ac_mag = 0;
+	double ac_phase = 0;
 };
 
 }
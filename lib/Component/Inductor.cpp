@@ -14,9 +14,10 @@ Expression Inductor::tran_i_expr() const {
 	// Current source in parallel with a resistor
 	//   Isource is old inductor current
 	//   R = L/dt
-	return {{ 1, {this->var}},
-	        { 1, {node_top->v(), parent_circuit->dt()}, {&this->value}},
-	        {-1, {node_bot->v(), parent_circuit->dt()}, {&this->value}}};
+	Expression expr = scaled_state(1);
+	expr.push_back({ 1, {node_top->v(), parent_circuit->dt()}, {&this->value}});
+	expr.push_back({-1, {node_bot->v(), parent_circuit->dt()}, {&this->value}});
+	return expr;
 }
 
 Expression Inductor::dc_v_expr() const {
@@ -39,8 +40,21 @@ Expression Inductor::dydt_expr() const {
 	        {-1, {node_bot->v()}, {&this->value}}};
 }
 
+bool Inductor::ac_voltage_defined() const {
+	return true;
+}
+
+std::complex<double> Inductor::ac_impedance(double omega) const {
+	// Z = jwL
+	return {0, omega*value};
+}
+
 void Inductor::gen_initial_cond() {
 	initial_cond = current();
 }
 
+Component *Inductor::clone() const {
+	return new Inductor(*this);
+}
+
 }
@@ -12,12 +12,18 @@ class Inductor: public IntegratingComponent {
 	// Inherit constructor
 	using IntegratingComponent::IntegratingComponent;
 	
+	virtual Component *clone() const;
+	
 	virtual Expression tran_v_expr() const;
 	virtual Expression tran_i_expr() const;
 	virtual Expression dc_v_expr() const;
 	virtual Expression dc_i_expr() const;
 	virtual Expression dydt_expr() const;
 	
+	// Impedance form so it stays a short at DC
+	virtual bool ac_voltage_defined() const;
+	virtual std::complex<double> ac_impedance(double omega) const;
+	
 	virtual void gen_initial_cond();
 };
 
@@ -9,4 +9,12 @@ Expression Resistor::dc_i_expr() const {
 	        {-1, {node_bot->v()}, {&this->value}}};
 }
 
+std::complex<double> Resistor::ac_admittance(double) const {
+	return 1/value;
+}
+
+Component *Resistor::clone() const {
+	return new Resistor(*this);
+}
+
 }
@@ -12,7 +12,10 @@ class Resistor: public TwoTerminalComponent {
 	// Inherit constructor
 	using TwoTerminalComponent::TwoTerminalComponent;
 	
+	virtual Component *clone() const;
+	
 	virtual Expression dc_i_expr() const;
+	virtual std::complex<double> ac_admittance(double omega) const;
 };
 
 }
@@ -0,0 +1,227 @@
+#include "Component/TransmissionLine.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/Node.hpp"
+#include "Core/CloneMap.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace spice {
+
+TransmissionLine::End::End(Circuit *c, TransmissionLine *line, Node *top, Node *bottom): TwoTerminalComponent(c, top, bottom), line(line) {}
+
+Expression TransmissionLine::End::dc_i_expr() const {
+	return {};
+}
+
+Expression TransmissionLine::End::tran_i_expr() const {
+	// I = (Vtop - Vbottom)/Z0 - history
+	return {{ 1, {node_top->v()}, {&line->z0}},
+	        {-1, {node_bot->v()}, {&line->z0}},
+	        {-1, {&hist}, {}}};
+}
+
+Component *TransmissionLine::End::clone() const {
+	return new End(*this);
+}
+
+void TransmissionLine::End::rebind(Circuit *c, const CloneMap &map) {
+	TwoTerminalComponent::rebind(c, map);
+	line = map.component(line);
+}
+
+TransmissionLine::Link::Link(Circuit *c, Node *top, Node *bottom): TwoTerminalComponent(c, top, bottom) {}
+
+Expression TransmissionLine::Link::dc_v_expr() const {
+	if(same_potential(node_top, node_bot))
+		return {};
+	return {{0.0}};
+}
+
+Expression TransmissionLine::Link::tran_v_expr() const {
+	return {};
+}
+
+Component *TransmissionLine::Link::clone() const {
+	return new Link(*this);
+}
+
+double TransmissionLine::History::time_at(size_t ind) const {
+	return times[(head + ind) % times.size()];
+}
+
+double TransmissionLine::History::value_at(size_t ind) const {
+	return values[(head + ind) % values.size()];
+}
+
+void TransmissionLine::History::clear() {
+	head = 0;
+	count = 0;
+}
+
+void TransmissionLine::History::push(double t, double v) {
+	// Grow by unrolling the ring into a buffer twice as large
+	if(count == times.size()) {
+		std::vector<double> new_times(std::max<size_t>(16, 2*count)), new_values(new_times.size());
+		for(size_t ind = 0; ind < count; ind++) {
+			new_times[ind] = time_at(ind);
+			new_values[ind] = value_at(ind);
+		}
+		
+		times.swap(new_times);
+		values.swap(new_values);
+		head = 0;
+	}
+	
+	const size_t tail = (head + count) % times.size();
+	times[tail] = t;
+	values[tail] = v;
+	count++;
+}
+
+void TransmissionLine::History::drop_before(double t) {
+	while(count > 1 && time_at(1) <= t) {
+		head = (head + 1) % times.size();
+		count--;
+	}
+}
+
+double TransmissionLine::History::at(double t, bool right) const {
+	if(!count)
+		return 0;
+	
+	// First sample after t (or at t, for the value just before it)
+	// RK substeps don't come in order, so search for it
+	size_t lo = 0, hi = count;
+	while(lo < hi) {
+		const size_t mid = (lo + hi)/2;
+		if(right ? time_at(mid) <= t : time_at(mid) < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	if(hi == 0)
+		return value_at(0);
+	if(hi == count)
+		return value_at(count - 1);
+	
+	const double frac = (t - time_at(hi - 1))/(time_at(hi) - time_at(hi - 1));
+	return value_at(hi - 1) + frac*(value_at(hi) - value_at(hi - 1));
+}
+
+size_t TransmissionLine::History::size() const {
+	return count;
+}
+
+bool TransmissionLine::same_potential(const Node *a, const Node *b) {
+	return a == b || (a->fixed && b->fixed);
+}
+
+TransmissionLine::TransmissionLine(Circuit *parent, double z0, double delay, Node *top1, Node *bot1, Node *top2, Node *bot2):
+	Component(parent), z0(z0), delay(delay) {
+	
+	if(z0 <= 0 || delay <= 0)
+		throw std::invalid_argument("Transmission line needs a positive impedance and delay");
+	
+	ends[0] = parent->add_comp<End>(this, top1, bot1);
+	ends[1] = parent->add_comp<End>(this, top2, bot2);
+	
+	// Usually both ends share a return node, which needs no link
+	links[0] = top1 == top2 ? nullptr : parent->add_comp<Link>(top1, top2);
+	links[1] = bot1 == bot2 ? nullptr : parent->add_comp<Link>(bot1, bot2);
+}
+
+Component *TransmissionLine::clone() const {
+	return new TransmissionLine(*this);
+}
+
+void TransmissionLine::rebind(Circuit *c, const CloneMap &map) {
+	Component::rebind(c, map);
+	for(int ind = 0; ind < 2; ind++) {
+		ends[ind] = map.component(ends[ind]);
+		links[ind] = map.component(links[ind]);
+	}
+}
+
+void TransmissionLine::start() {
+	// Steady state: the DC current enters at one end's top and leaves at the other's
+	const double i_dc = links[0] ? links[0]->current() : 0;
+	const double t = parent_circuit->time();
+	
+	waves[0].clear();
+	waves[1].clear();
+	waves[0].push(t, ends[0]->voltage()/z0 + i_dc);
+	waves[1].push(t, ends[1]->voltage()/z0 - i_dc);
+	breakpoints.clear();
+	
+	update(true);
+}
+
+void TransmissionLine::update(bool right) {
+	const double t = parent_circuit->time() - delay;
+	ends[0]->hist = waves[1].at(t, right);
+	ends[1]->hist = waves[0].at(t, right);
+}
+
+bool TransmissionLine::arrival() const {
+	const double t = parent_circuit->time();
+	return std::any_of(breakpoints.begin(), breakpoints.end(), [&](double bp) {
+		return Circuit::epsilon_equals(bp, t);
+	});
+}
+
+void TransmissionLine::accept(bool discontinuity) {
+	const double t = parent_circuit->time();
+	
+	for(int ind = 0; ind < 2; ind++) {
+		waves[ind].push(t, ends[ind]->voltage()/z0 + ends[ind]->current());
+		waves[ind].drop_before(t - delay);
+	}
+	
+	breakpoints.erase(std::remove_if(breakpoints.begin(), breakpoints.end(), [&](double bp) {
+		return bp <= t + EPSILON;
+	}), breakpoints.end());
+	
+	if(discontinuity)
+		breakpoints.push_back(t + delay);
+}
+
+double TransmissionLine::next_change_time() const {
+	double earliest = parent_circuit->time() + delay;
+	
+	for(double bp:breakpoints)
+		earliest = std::min(earliest, bp);
+	
+	return earliest;
+}
+
+bool TransmissionLine::fully_connected() const {
+	for(int ind = 0; ind < 2; ind++)
+		if(!ends[ind]->fully_connected() || (links[ind] && !links[ind]->fully_connected()))
+			return false;
+	
+	return true;
+}
+
+double TransmissionLine::get_z0() const {
+	return z0;
+}
+
+double TransmissionLine::get_delay() const {
+	return delay;
+}
+
+TwoTerminalComponent *TransmissionLine::port(int ind) const {
+	if(ind < 0 || ind > 1)
+		throw std::out_of_range("Transmission line port index must be 0 or 1");
+	
+	return ends[ind];
+}
+
+size_t TransmissionLine::history_size() const {
+	return waves[0].size();
+}
+
+}
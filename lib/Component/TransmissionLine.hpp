@@ -0,0 +1,132 @@
+/*
+	Lossless transmission line (method of characteristics)
+*/
+
+#pragma once
+
+#include "Core/TwoTerminalComponent.hpp"
+
+#include <vector>
+
+namespace spice {
+
+class TransmissionLine: public Component {
+private:
+	// Each port looks into the line as Z0 in parallel with a current source
+	// set by the wave that left the other port one delay earlier
+	// I = V/Z0 - (Vother/Z0 + Iother)(t - delay)
+	class End: public TwoTerminalComponent {
+	private:
+		TransmissionLine *line;
+		
+		// History current source
+		double hist = 0;
+		
+		End(Circuit *c, TransmissionLine *line, Node *top, Node *bottom);
+		
+		// Open in DC (the links carry the current)
+		virtual Expression dc_i_expr() const;
+		virtual Expression tran_i_expr() const;
+		
+		virtual Component *clone() const;
+		virtual void rebind(Circuit *c, const CloneMap &map);
+		
+		friend class Circuit;
+		friend class TransmissionLine;
+	};
+	
+	// Conductor between the ends: a short in DC and open in transient
+	// Open if both of its nodes are the same (or fixed) so it doesn't make the matrix singular
+	class Link: public TwoTerminalComponent {
+	private:
+		Link(Circuit *c, Node *top, Node *bottom);
+		
+		virtual Expression dc_v_expr() const;
+		virtual Expression tran_v_expr() const;
+		
+		virtual Component *clone() const;
+		
+		friend class Circuit;
+		friend class TransmissionLine;
+	};
+	
+	// Ring buffer of (time, value) samples taken at accepted timesteps
+	class History {
+	private:
+		std::vector<double> times, values;
+		size_t head = 0, count = 0;
+		
+		double time_at(size_t ind) const;
+		double value_at(size_t ind) const;
+	
+	public:
+		void clear();
+		void push(double t, double v);
+		
+		// Drop samples older than t, except the last one before it (needed to interpolate at t)
+		void drop_before(double t);
+		
+		// Linear interpolation, constant outside the recorded range (0 if empty)
+		// A jump is recorded as two samples at the same time; right picks the value after it
+		double at(double t, bool right) const;
+		
+		size_t size() const;
+	};
+	
+	// Nodes that are the same or both fixed (so a link between them would be a loop)
+	static bool same_potential(const Node *a, const Node *b);
+	
+	TransmissionLine(Circuit *parent, double z0, double delay, Node *top1, Node *bot1, Node *top2, Node *bot2);
+	
+	double z0, delay;
+	
+	End *ends[2];
+	
+	// Between the tops and between the bottoms (null if the nodes are the same)
+	Link *links[2];
+	
+	// Waves leaving each end (V/Z0 + I)
+	History waves[2];
+	
+	// Times a discontinuity arrives at the ends
+	std::vector<double> breakpoints;
+	
+	// Fill the histories from the DC solution
+	void start();
+	
+	// Set the history current sources for the present simulation time
+	// (with the values just after any jump arriving at that time if right is set)
+	void update(bool right);
+	
+	// Check if a discontinuity arrives at the present time
+	bool arrival() const;
+	
+	// Record the waves at an accepted timestep
+	// If a discontinuity happened there, it reaches the other end one delay later
+	void accept(bool discontinuity);
+	
+	// Next time the simulation has to stop at: a delay after the last accepted step
+	// (so histories are never extrapolated) or an arriving discontinuity
+	double next_change_time() const;
+	
+	// Clones keep their histories and take over the clones of their ends and links
+	virtual Component *clone() const;
+	virtual void rebind(Circuit *c, const CloneMap &map);
+
+public:
+	virtual bool fully_connected() const;
+	
+	// Characteristic impedance and delay
+	double get_z0() const;
+	double get_delay() const;
+	
+	// Ports, for their voltages and currents (current into the line at the top terminal in transient)
+	TwoTerminalComponent *port(int ind) const;
+	
+	// Number of samples held for each end (bounded by delay/min timestep)
+	size_t history_size() const;
+	
+	friend class Circuit;
+};
+
+}
@@ -1,9 +1,23 @@
 #include "Component/VSource.hpp"
 
+#include <cmath>
+
 namespace spice {
 
 Expression VSource::dc_v_expr() const {
 	return {{1, {&this->value}, {}}};
 }
 
+bool VSource::ac_voltage_defined() const {
+	return true;
+}
+
+std::complex<double> VSource::ac_source() const {
+	return std::polar(ac_mag, ac_phase*M_PI/180);
+}
+
+Component *VSource::clone() const {
+	return new VSource(*this);
+}
+
 }
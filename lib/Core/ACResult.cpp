@@ -0,0 +1,32 @@
+#include "Core/ACResult.hpp"
+#include "Core/TwoTerminalComponent.hpp"
+
+#include <stdexcept>
+
+namespace spice {
+
+const std::vector<double> &ACResult::freqs() const {
+	return _freqs;
+}
+
+std::complex<double> ACResult::voltage(const Node *n, size_t freq_ind) const {
+	auto ni = node_map.find(n);
+	if(ni == node_map.end())
+		throw std::invalid_argument("Node not part of the analyzed circuit");
+	
+	return node_v.at(freq_ind)[ni->second];
+}
+
+std::complex<double> ACResult::voltage(const TwoTerminalComponent *c, size_t freq_ind) const {
+	return voltage(c->top(), freq_ind) - voltage(c->bot(), freq_ind);
+}
+
+std::complex<double> ACResult::current(const TwoTerminalComponent *c, size_t freq_ind) const {
+	auto ci = comp_map.find(c);
+	if(ci == comp_map.end())
+		throw std::invalid_argument("Component not part of the analyzed circuit");
+	
+	return comp_i.at(freq_ind)[ci->second];
+}
+
+}
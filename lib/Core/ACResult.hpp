@@ -0,0 +1,39 @@
+/*
+	Node voltages and component currents from an AC small-signal analysis
+*/
+
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <unordered_map>
+
+namespace spice {
+
+class Node;
+class TwoTerminalComponent;
+
+class ACResult {
+private:
+	std::vector<double> _freqs;
+	
+	// Phasors for each frequency, indexed through the maps below
+	std::vector<std::vector<std::complex<double>>> node_v;
+	std::vector<std::vector<std::complex<double>>> comp_i;
+	
+	std::unordered_map<const Node*, size_t> node_map;
+	std::unordered_map<const TwoTerminalComponent*, size_t> comp_map;
+	
+public:
+	// Analyzed frequencies (Hz)
+	const std::vector<double> &freqs() const;
+	
+	// Phasors at the frequency with index freq_ind
+	std::complex<double> voltage(const Node *n, size_t freq_ind) const;
+	std::complex<double> voltage(const TwoTerminalComponent *c, size_t freq_ind) const;
+	std::complex<double> current(const TwoTerminalComponent *c, size_t freq_ind) const;
+	
+	friend class Circuit;
+};
+
+}
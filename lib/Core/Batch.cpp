@@ -0,0 +1,164 @@
+#include "Core/Batch.hpp"
+#include "Core/CircuitGroup.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/ThreadPool.hpp"
+#include "Core/SubcircuitInstance.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <map>
+#include <tuple>
+
+namespace spice {
+
+// Circuits solved one after the other, each with its own Newton iteration
+class Batch::Group: public CircuitGroup {
+private:
+	virtual void solve_all() {
+		for(Circuit *c:circuits)
+			c->solve_matrix();
+	}
+
+public:
+	Group(std::vector<Circuit*> members) {
+		circuits = std::move(members);
+	}
+};
+
+Batch::Batch() {}
+
+Batch::~Batch() {}
+
+ThreadPool &Batch::thread_pool() {
+	const unsigned int n = n_threads ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+	
+	if(!pool || pool->size() != n)
+		pool.reset(new ThreadPool(n));
+	
+	return *pool;
+}
+
+Circuit *Batch::add(std::unique_ptr<Circuit> c) {
+	if(!c)
+		throw std::invalid_argument("Batch needs a circuit");
+	
+	c->dense_solver = true;
+	c->n_threads = 1;
+	
+	circuits.push_back(std::move(c));
+	groups_pend = true;
+	
+	return circuits.back().get();
+}
+
+size_t Batch::size() const {
+	return circuits.size();
+}
+
+Circuit &Batch::circuit(size_t ind) {
+	return *circuits.at(ind);
+}
+
+double Batch::time() const {
+	double earliest = std::numeric_limits<double>::max();
+	for(auto &c:circuits)
+		earliest = std::min(earliest, c->time());
+	
+	return circuits.empty() ? 0 : earliest;
+}
+
+void Batch::form_groups() {
+	groups.clear();
+	tasks.clear();
+	
+	const size_t none = std::numeric_limits<size_t>::max();
+	
+	// Join circuits sharing a definition (union-find over the circuits' indices)
+	std::vector<size_t> parent(circuits.size());
+	for(size_t ind = 0; ind < circuits.size(); ind++)
+		parent[ind] = ind;
+	
+	auto root = [&](size_t ind) {
+		while(parent[ind] != ind)
+			ind = parent[ind] = parent[parent[ind]];
+		
+		return ind;
+	};
+	
+	std::map<const SubcircuitDef*, size_t> def_user;
+	for(size_t ind = 0; ind < circuits.size(); ind++)
+		for(auto &inst:circuits[ind]->instances) {
+			auto du = def_user.emplace(inst->definition(), ind);
+			if(!du.second)
+				parent[root(ind)] = root(du.first->second);
+		}
+	
+	// Task of each set of circuits sharing definitions (circuits without instances get tasks of their own)
+	std::map<size_t, size_t> cluster_task;
+	auto task = [&](size_t ind) -> Task& {
+		if(circuits[ind]->instances.empty()) {
+			tasks.emplace_back();
+			return tasks.back();
+		}
+		
+		auto ct = cluster_task.emplace(root(ind), tasks.size());
+		if(ct.second)
+			tasks.emplace_back();
+		
+		return tasks[ct.first->second];
+	};
+	
+	// Circuits of the group being filled for each set of settings and definitions
+	typedef std::tuple<const gsl_odeiv2_step_type*, double, double, double, double, size_t> Key;
+	std::map<Key, std::vector<size_t>> open;
+	
+	const size_t n = group_size ? group_size : circuits.size();
+	auto close = [&](std::vector<size_t> &members) {
+		std::vector<Circuit*> group_circuits;
+		for(size_t ind:members)
+			group_circuits.push_back(circuits[ind].get());
+		
+		groups.emplace_back(new Group(std::move(group_circuits)));
+		task(members.front()).groups.push_back(groups.back().get());
+		members.clear();
+	};
+	
+	for(size_t ind = 0; ind < circuits.size(); ind++) {
+		Circuit &c = *circuits[ind];
+		if(c.tlines.size()) {
+			task(ind).singles.push_back(&c);
+			continue;
+		}
+		
+		std::vector<size_t> &members = open[Key(c.stepper_type, c.max_e_abs, c.max_e_rel, c.user_min_ts, c.user_max_ts,
+		                                        c.instances.empty() ? none : root(ind))];
+		members.push_back(ind);
+		if(members.size() == n)
+			close(members);
+	}
+	
+	for(auto &o:open)
+		if(o.second.size())
+			close(o.second);
+	
+	formed_size = group_size;
+	groups_pend = false;
+}
+
+void Batch::sim_to_time(double stop) {
+	if(groups_pend || formed_size != group_size)
+		form_groups();
+	
+	// Groups take different steps, so their run times differ widely
+	thread_pool().parallel_tasks(tasks.size(), [&](size_t ind, unsigned int) {
+		for(Group *g:tasks[ind].groups)
+			g->sim_to_time(stop);
+		
+		for(Circuit *c:tasks[ind].singles)
+			c->sim_to_time(stop);
+	});
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+	Many small, unrelated circuits simulated together without each paying for its own solver setup:
+	every circuit's matrix is factorized densely, and circuits are stepped in lockstep groups,
+	each one block-diagonal diff EQ system with a single driver, with the groups spread over a pool of threads
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+namespace spice {
+
+class Circuit;
+class ThreadPool;
+
+class Batch {
+private:
+	std::vector<std::unique_ptr<Circuit>> circuits;
+	
+	// Circuits stepped in lockstep
+	class Group;
+	std::vector<std::unique_ptr<Group>> groups;
+	
+	// Work for one thread: groups, and circuits with transmission lines, which need steps of their own
+	struct Task {
+		std::vector<Group*> groups;
+		std::vector<Circuit*> singles;
+	};
+	
+	std::vector<Task> tasks;
+	
+	// Split the circuits into groups of up to group_size with the same stepper, error limits,
+	// and timestep limits (in the order added), and the groups into tasks
+	// Circuits sharing a subcircuit definition (directly or through other circuits) end up in one task,
+	// so a definition is only ever used by one thread
+	void form_groups();
+	bool groups_pend = true;
+	size_t formed_size = 0;
+	
+	// Worker threads for running groups
+	std::unique_ptr<ThreadPool> pool;
+	
+	// Return the thread pool, (re-)creating it if n_threads changed
+	ThreadPool &thread_pool();
+
+public:
+	Batch();
+	~Batch();
+	
+	Batch(const Batch&) = delete;
+	
+	// Take over a circuit (which can have any topology), switching it to dense factorization
+	// Return the circuit, which stays valid as long as the batch
+	Circuit *add(std::unique_ptr<Circuit> c);
+	
+	// Number of circuits, and a circuit in the order added
+	size_t size() const;
+	Circuit &circuit(size_t ind);
+	
+	// Number of circuits stepped in lockstep as one system (0 for all of them)
+	// A group shares one driver and its per-step overhead, but all of its circuits step as often as its
+	// fastest one, and every solve touches all of them; 1 steps each circuit on its own
+	size_t group_size = 32;
+	
+	// Number of threads (0 for one per hardware thread)
+	// Groups run in any order; each circuit uses a single thread itself
+	unsigned int n_threads = 0;
+	
+	// Time of the circuit furthest behind
+	double time() const;
+	
+	// Simulate every circuit
+	// The first call computes each circuit's DC solution
+	void sim_to_time(double stop);
+};
+
+}
@@ -0,0 +1,87 @@
+#include "Core/BehavioralComponent.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/Node.hpp"
+#include "Core/CloneMap.hpp"
+#include "Parser/ExpressionCompiler.hpp"
+
+#include <stdexcept>
+#include <cmath>
+
+namespace spice {
+
+BehavioralComponent::BehavioralComponent(Circuit *parent, const std::string &expr, const std::unordered_map<std::string, Node*> &nodes,
+                                         const std::unordered_map<std::string, double> &params, Node *top, Node *bottom):
+	TwoTerminalComponent(parent, top, bottom) {
+	
+	parser::ExpressionCompiler compiler(params);
+	code = compiler.compile(expr);
+	
+	for(const std::string &name:compiler.node_names()) {
+		auto n = nodes.find(name);
+		if(n == nodes.end())
+			throw std::invalid_argument("Unknown node " + name + " in expression " + expr);
+		controls.push_back(n->second);
+	}
+	
+	// Sized once, since the circuit matrix references them
+	x_lin.resize(controls.size() + 1);
+	grad.resize(controls.size() + 1);
+	x_now.resize(controls.size() + 1);
+}
+
+void BehavioralComponent::inputs(double *x) const {
+	x[0] = parent_circuit->time();
+	for(size_t ind = 0; ind < controls.size(); ind++)
+		x[ind + 1] = controls[ind]->voltage();
+}
+
+void BehavioralComponent::linearize(bool update_jacobian) {
+	inputs(x_lin.data());
+	const double value = code.eval(x_lin.data(), update_jacobian ? grad.data() : nullptr);
+	
+	// Companion source so the linear model passes through the present value
+	// (time isn't a matrix variable, so its part stays in the offset)
+	offset = value;
+	for(size_t ind = 1; ind < x_lin.size(); ind++)
+		offset -= grad[ind]*x_lin[ind];
+}
+
+bool BehavioralComponent::converged(double reltol, double vntol, double abstol) const {
+	const std::vector<double> &x = x_now;
+	inputs(x_now.data());
+	
+	double linear = offset;
+	for(size_t ind = 1; ind < x.size(); ind++) {
+		if(std::abs(x[ind] - x_lin[ind]) > reltol*std::max(std::abs(x[ind]), std::abs(x_lin[ind])) + vntol)
+			return false;
+		linear += grad[ind]*x[ind];
+	}
+	
+	const double value = code.eval(x.data());
+	return std::abs(value - linear) <= reltol*std::max(std::abs(value), std::abs(linear)) + abstol;
+}
+
+Expression BehavioralComponent::linear_expr() const {
+	Expression expr;
+	for(size_t ind = 0; ind < controls.size(); ind++)
+		expr.push_back({1, {&grad[ind + 1], controls[ind]->v()}});
+	expr.push_back({1, {&offset}});
+	return expr;
+}
+
+void BehavioralComponent::rebind(Circuit *c, const CloneMap &map) {
+	TwoTerminalComponent::rebind(c, map);
+	for(const Node *&n:controls)
+		n = map.node(n);
+}
+
+double BehavioralComponent::eval() const {
+	inputs(x_now.data());
+	return code.eval(x_now.data());
+}
+
+const Bytecode &BehavioralComponent::get_code() const {
+	return code;
+}
+
+}
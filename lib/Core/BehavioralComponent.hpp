@@ -0,0 +1,63 @@
+/*
+	Generic class for a two-terminal component whose value is an expression of node voltages and time,
+	compiled to bytecode when it's created and linearized on every Newton iteration
+*/
+
+#pragma once
+
+#include "Core/TwoTerminalComponent.hpp"
+#include "Core/Bytecode.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace spice {
+
+class BehavioralComponent: public TwoTerminalComponent {
+protected:
+	Bytecode code;
+	
+	// Nodes whose voltages are the code's inputs (after time, which is input 0)
+	std::vector<const Node*> controls;
+	
+	// Linearized model around x_lin: value = sum(grad*V(controls)) + offset
+	// Referenced by the circuit matrix expressions, updated by linearize()
+	std::vector<double> x_lin;
+	std::vector<double> grad;
+	double offset = 0;
+	
+	// Inputs at the present solution, reused between evaluations
+	mutable std::vector<double> x_now;
+	
+	// Write the present inputs (time and control voltages) to x
+	void inputs(double *x) const;
+	
+	// Linearize the expression around the present solution
+	// Keeps the previous derivatives unless update_jacobian is set (modified Newton)
+	void linearize(bool update_jacobian);
+	
+	// Check if the control voltages stayed where the expression was linearized
+	// and the linearized value agrees with the expression
+	bool converged(double reltol, double vntol, double abstol) const;
+	
+	// Linearized value, for the V/I expression of a voltage or current source
+	Expression linear_expr() const;
+	
+	virtual void rebind(Circuit *c, const CloneMap &map);
+	
+	// Compile expr; V() arguments are looked up in nodes and other identifiers in params
+	// Throws std::invalid_argument if the expression doesn't compile or names an unknown node
+	BehavioralComponent(Circuit *parent, const std::string &expr, const std::unordered_map<std::string, Node*> &nodes,
+	                    const std::unordered_map<std::string, double> &params, Node *top, Node *bottom);
+
+public:
+	// Value of the expression at the present solution
+	double eval() const;
+	
+	const Bytecode &get_code() const;
+	
+	friend class Circuit;
+};
+
+}
@@ -1,11 +1,13 @@
 /*
 	Builtin SPICE functions
 	https://ltwiki.org/?title=B_sources_%28complete_reference%29
-	Missing some of the more weird ones (table, noise...)
+	Missing some of the more weird ones (noise...)
 */
 
 #pragma once
 
+#include "Core/Table.hpp"
+
 #include <cmath>
 #include <string>
 #include <utility>
@@ -17,7 +19,7 @@ struct builtin {
 	builtin() = delete;
 	
 	static const std::unordered_set<std::string> &available_functions() {
-		static const std::unordered_set<std::string> funcs{"sin", "cos", "tan", "arcsin", "asin", "arccos", "acos", "arctan", "atan", "atan2", "hypot", "sinh", "cosh", "tanh", "exp", "ln", "log", "log10", "sgn", "abs", "sqrt", "square", "pow", "pwr", "pwrs", "round", "_int", "floor", "ceil", "min", "max", "limit", "uplim", "dnlim", "uramp", "stp", "u", "buf", "inv"};
+		static const std::unordered_set<std::string> funcs{"sin", "cos", "tan", "arcsin", "asin", "arccos", "acos", "arctan", "atan", "atan2", "hypot", "sinh", "cosh", "tanh", "exp", "ln", "log", "log10", "sgn", "abs", "sqrt", "square", "pow", "pwr", "pwrs", "round", "_int", "floor", "ceil", "min", "max", "limit", "uplim", "dnlim", "uramp", "stp", "u", "buf", "inv", "table"};
 		
 		return funcs;
 	}
@@ -219,6 +221,13 @@ struct builtin {
 		return !buf(x);
 	}
 	
+	// piecewise-linear interpolation in x1, y1, x2, y2, ... (end values held outside)
+	template<typename... Args> static inline double table(double x, Args... pairs) {
+		static_assert(sizeof...(pairs) > 0 && sizeof...(pairs) % 2 == 0, "table needs pairs of x and y values");
+		const double values[] = {(double)pairs...};
+		return Table::lookup(values, sizeof...(pairs)/2, x);
+	}
+	
 	// Adapt boolean behavior to possibly use floating-point arguments (non-standard SPICE functions; used by SPICE translator)
 	template<typename Tx, typename Ty> static inline bool _and(Tx x, Ty y) {
 		return buf(x) && buf(y);
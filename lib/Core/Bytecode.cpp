@@ -0,0 +1,325 @@
+#include "Core/Bytecode.hpp"
+#include "Core/BuiltinFunctions.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace spice {
+
+// Register of an input that the code never reads
+static const uint32_t unused_input = std::numeric_limits<uint32_t>::max();
+
+unsigned int Bytecode::arity(Op op) {
+	switch(op) {
+		case IF:
+		case LIMIT:
+		case UPLIM:
+		case DNLIM:
+			return 3;
+		
+		case ADD: case SUB: case MUL: case DIV: case POW:
+		case GREATER: case LESS: case GREATER_EQUALS: case LESS_EQUALS:
+		case AND: case OR: case XOR:
+		case ATAN2: case HYPOT: case PWR: case PWRS: case MIN: case MAX:
+			return 2;
+		
+		// TABLE's b is a table index rather than a register
+		default:
+			return 1;
+	}
+}
+
+uint32_t Bytecode::new_reg(double value, bool is_constant) {
+	regs.push_back(value);
+	constant.push_back(is_constant);
+	return regs.size() - 1;
+}
+
+uint32_t Bytecode::input(size_t ind) {
+	if(ind >= input_regs.size())
+		input_regs.resize(ind + 1, unused_input);
+	
+	if(input_regs[ind] == unused_input)
+		input_regs[ind] = new_reg(0, false);
+	
+	return input_regs[ind];
+}
+
+uint32_t Bytecode::constant_reg(double value) {
+	return new_reg(value, true);
+}
+
+uint32_t Bytecode::emit(Op op, uint32_t a, uint32_t b, uint32_t c) {
+	const uint32_t operands[] = {a, b, c};
+	const unsigned int n = arity(op);
+	
+	bool folded = true;
+	for(unsigned int ind = 0; ind < n; ind++) {
+		if(operands[ind] >= regs.size())
+			throw std::out_of_range("Bytecode operand isn't a register");
+		folded &= constant[operands[ind]];
+	}
+	
+	if(folded)
+		return constant_reg(exec({op, 0, a, b, c}, regs.data()));
+	
+	const uint32_t dst = new_reg(0, false);
+	code.push_back({op, dst, a, b, c});
+	return dst;
+}
+
+uint32_t Bytecode::emit_table(uint32_t x, std::vector<double> xs, std::vector<double> ys) {
+	tables.emplace_back(std::move(xs), std::move(ys));
+	return emit(TABLE, x, tables.size() - 1);
+}
+
+bool Bytecode::is_constant(uint32_t reg) const {
+	return constant.at(reg);
+}
+
+double Bytecode::value(uint32_t reg) const {
+	return regs.at(reg);
+}
+
+void Bytecode::set_result(uint32_t reg) {
+	if(reg >= regs.size())
+		throw std::out_of_range("Bytecode result isn't a register");
+	
+	result_reg = reg;
+}
+
+double Bytecode::exec(const Instruction &ins, const double *r) const {
+	const double a = r[ins.a];
+	const double b = arity(ins.op) > 1 ? r[ins.b] : 0;
+	const double c = arity(ins.op) > 2 ? r[ins.c] : 0;
+	
+	switch(ins.op) {
+		case ADD:            return a + b;
+		case SUB:            return a - b;
+		case MUL:            return a*b;
+		case DIV:            return a/b;
+		case POW:            return builtin::pow(a, b);
+		case GREATER:        return a > b;
+		case LESS:           return a < b;
+		case GREATER_EQUALS: return a >= b;
+		case LESS_EQUALS:    return a <= b;
+		case AND:            return builtin::_and(a, b);
+		case OR:             return builtin::_or(a, b);
+		case XOR:            return builtin::_xor(a, b);
+		case IF:             return builtin::buf(a) ? b : c;
+		case SIN:            return builtin::sin(a);
+		case COS:            return builtin::cos(a);
+		case TAN:            return builtin::tan(a);
+		case ASIN:           return builtin::asin(a);
+		case ACOS:           return builtin::acos(a);
+		case ATAN:           return builtin::atan(a);
+		case ATAN2:          return builtin::atan2(a, b);
+		case HYPOT:          return builtin::hypot(a, b);
+		case SINH:           return builtin::sinh(a);
+		case COSH:           return builtin::cosh(a);
+		case TANH:           return builtin::tanh(a);
+		case EXP:            return builtin::exp(a);
+		case LOG:            return builtin::log(a);
+		case LOG10:          return builtin::log10(a);
+		case SGN:            return builtin::sgn(a);
+		case ABS:            return builtin::abs(a);
+		case SQRT:           return builtin::sqrt(a);
+		case SQUARE:         return builtin::square(a);
+		case PWR:            return builtin::pwr(a, b);
+		case PWRS:           return builtin::pwrs(a, b);
+		case ROUND:          return builtin::round(a);
+		case INT:            return builtin::_int(a);
+		case FLOOR:          return builtin::floor(a);
+		case CEIL:           return builtin::ceil(a);
+		case MIN:            return builtin::min(a, b);
+		case MAX:            return builtin::max(a, b);
+		case LIMIT:          return builtin::limit(a, b, c);
+		case UPLIM:          return builtin::uplim(a, b, c);
+		case DNLIM:          return builtin::dnlim(a, b, c);
+		case URAMP:          return builtin::uramp(a);
+		case STP:            return builtin::stp(a);
+		case BUF:            return builtin::buf(a);
+		case INV:            return builtin::inv(a);
+		case TABLE:          return tables[ins.b].at(a);
+	}
+	
+	throw std::logic_error("Unknown bytecode operation");
+}
+
+void Bytecode::partials(const Instruction &ins, const double *r, double &da, double &db, double &dc) const {
+	const double a = r[ins.a];
+	const double b = arity(ins.op) > 1 ? r[ins.b] : 0;
+	const double c = arity(ins.op) > 2 ? r[ins.c] : 0;
+	
+	da = db = dc = 0;
+	
+	switch(ins.op) {
+		case ADD:
+			da = 1;
+			db = 1;
+			break;
+		
+		case SUB:
+			da = 1;
+			db = -1;
+			break;
+		
+		case MUL:
+			da = b;
+			db = a;
+			break;
+		
+		case DIV:
+			da = 1/b;
+			db = -a/(b*b);
+			break;
+		
+		case POW:
+			da = b*std::pow(a, b - 1);
+			db = a > 0 ? std::log(a)*std::pow(a, b) : 0;
+			break;
+		
+		case IF:
+			(builtin::buf(a) ? db : dc) = 1;
+			break;
+		
+		case SIN:   da = std::cos(a); break;
+		case COS:   da = -std::sin(a); break;
+		case TAN:   da = 1 + std::tan(a)*std::tan(a); break;
+		case ASIN:  da = 1/std::sqrt(1 - a*a); break;
+		case ACOS:  da = -1/std::sqrt(1 - a*a); break;
+		case ATAN:  da = 1/(1 + a*a); break;
+		case SINH:  da = std::cosh(a); break;
+		case COSH:  da = std::sinh(a); break;
+		case TANH:  da = 1 - std::tanh(a)*std::tanh(a); break;
+		case EXP:   da = std::exp(a); break;
+		case LOG:   da = 1/a; break;
+		case LOG10: da = 1/(a*M_LN10); break;
+		case ABS:   da = builtin::sgn(a); break;
+		case SQRT:  da = 0.5/std::sqrt(a); break;
+		case SQUARE: da = 2*a; break;
+		case URAMP: da = a > 0; break;
+		case TABLE: da = tables[ins.b].slope(a); break;
+		
+		// atan2(y, x) and hypot(y, x)
+		case ATAN2:
+		case HYPOT: {
+			const double r2 = a*a + b*b;
+			if(r2 > 0) {
+				const double h = std::sqrt(r2);
+				da = ins.op == ATAN2 ? b/r2 : a/h;
+				db = ins.op == ATAN2 ? -a/r2 : b/h;
+			}
+			break;
+		}
+		
+		// abs(x)**y and sgn(x)*abs(x)**y
+		case PWR:
+		case PWRS: {
+			const double m = std::abs(a);
+			if(m > 0) {
+				const double p = std::pow(m, b);
+				da = b*p/m*(ins.op == PWR ? builtin::sgn(a) : 1);
+				db = std::log(m)*p*(ins.op == PWRS ? builtin::sgn(a) : 1);
+			}
+			break;
+		}
+		
+		// Whichever operand was picked
+		case MIN:
+			(b < a ? db : da) = 1;
+			break;
+		
+		case MAX:
+			(a < b ? db : da) = 1;
+			break;
+		
+		case LIMIT:
+			if(c < std::max(a, b))
+				dc = 1;
+			else
+				(a < b ? db : da) = 1;
+			break;
+		
+		// Soft limits: y -/+ z*exp(...) inside the zone, x outside it
+		case UPLIM:
+			if(b - a < c) {
+				const double e = std::exp((b - a - c)/c);
+				da = e;
+				db = 1 - e;
+				dc = e*((b - a)/c - 1);
+			}
+			else da = 1;
+			break;
+		
+		case DNLIM:
+			if(a - b < c) {
+				const double e = std::exp((a - b - c)/c);
+				da = e;
+				db = 1 - e;
+				dc = e*(1 - (a - b)/c);
+			}
+			else da = 1;
+			break;
+		
+		// Piecewise constant
+		default:
+			break;
+	}
+}
+
+double Bytecode::eval(const double *inputs, double *grad) const {
+	if(regs.empty())
+		return 0;
+	
+	double *r = regs.data();
+	
+	for(size_t ind = 0; ind < input_regs.size(); ind++)
+		if(input_regs[ind] != unused_input)
+			r[input_regs[ind]] = inputs[ind];
+	
+	for(const Instruction &ins:code)
+		r[ins.dst] = exec(ins, r);
+	
+	if(grad) {
+		// Reverse mode: push the result's adjoint back through the code
+		adjoints.assign(regs.size(), 0);
+		adjoints[result_reg] = 1;
+		
+		for(auto ins = code.rbegin(); ins != code.rend(); ins++) {
+			const double adj = adjoints[ins->dst];
+			if(adj == 0)
+				continue;
+			
+			double da, db, dc;
+			partials(*ins, r, da, db, dc);
+			
+			adjoints[ins->a] += adj*da;
+			if(arity(ins->op) > 1)
+				adjoints[ins->b] += adj*db;
+			if(arity(ins->op) > 2)
+				adjoints[ins->c] += adj*dc;
+		}
+		
+		for(size_t ind = 0; ind < input_regs.size(); ind++)
+			grad[ind] = input_regs[ind] != unused_input ? adjoints[input_regs[ind]] : 0;
+	}
+	
+	return r[result_reg];
+}
+
+size_t Bytecode::n_inputs() const {
+	return input_regs.size();
+}
+
+size_t Bytecode::n_instructions() const {
+	return code.size();
+}
+
+size_t Bytecode::n_registers() const {
+	return regs.size();
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+	Register-based bytecode for behavioral expressions, evaluated with builtin functions
+	Constant operations are folded as the code is emitted
+*/
+
+#pragma once
+
+#include "Core/Table.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spice {
+
+class Bytecode {
+public:
+	enum Op: uint8_t {
+		// Operators
+		ADD, SUB, MUL, DIV, POW,
+		GREATER, LESS, GREATER_EQUALS, LESS_EQUALS,
+		AND, OR, XOR, IF,
+		
+		// Builtin functions
+		SIN, COS, TAN, ASIN, ACOS, ATAN, ATAN2, HYPOT,
+		SINH, COSH, TANH, EXP, LOG, LOG10,
+		SGN, ABS, SQRT, SQUARE, PWR, PWRS,
+		ROUND, INT, FLOOR, CEIL,
+		MIN, MAX, LIMIT, UPLIM, DNLIM,
+		URAMP, STP, BUF, INV,
+		
+		// Lookup in tables[b]
+		TABLE
+	};
+	
+	// dst = op(a, b, c)
+	struct Instruction {
+		Op op;
+		uint32_t dst, a, b, c;
+	};
+
+private:
+	// Register file: inputs, constants, and results of instructions
+	mutable std::vector<double> regs;
+	
+	// Set for registers holding constants
+	std::vector<bool> constant;
+	
+	// Register each input is loaded into
+	std::vector<uint32_t> input_regs;
+	
+	std::vector<Instruction> code;
+	std::vector<Table> tables;
+	
+	uint32_t result_reg = 0;
+	
+	// Adjoint of each register for reverse-mode differentiation
+	mutable std::vector<double> adjoints;
+	
+	uint32_t new_reg(double value, bool is_constant);
+	
+	// Value of one instruction given the register file
+	double exec(const Instruction &ins, const double *r) const;
+	
+	// Partial derivatives of one instruction with respect to its operands
+	void partials(const Instruction &ins, const double *r, double &da, double &db, double &dc) const;
+
+public:
+	// Number of register operands an operation reads
+	static unsigned int arity(Op op);
+	
+	// Register for input ind (inputs are given to eval() in this order)
+	uint32_t input(size_t ind);
+	
+	uint32_t constant_reg(double value);
+	
+	// Emit dst = op(a, b, c) and return dst, or a constant register if every operand is constant
+	uint32_t emit(Op op, uint32_t a, uint32_t b = 0, uint32_t c = 0);
+	
+	// Emit a lookup of x in a table of constant points
+	uint32_t emit_table(uint32_t x, std::vector<double> xs, std::vector<double> ys);
+	
+	bool is_constant(uint32_t reg) const;
+	double value(uint32_t reg) const;
+	
+	void set_result(uint32_t reg);
+	
+	// Evaluate with the given input values, optionally also computing the
+	// derivative with respect to each input (zero where the expression isn't differentiable)
+	// Evaluation uses the object's registers, so it isn't thread-safe
+	double eval(const double *inputs, double *grad = nullptr) const;
+	
+	size_t n_inputs() const;
+	size_t n_instructions() const;
+	size_t n_registers() const;
+};
+
+}
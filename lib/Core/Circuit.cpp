@@ -3,20 +3,38 @@
 #include "Core/Component.hpp"
 #include "Core/TwoTerminalComponent.hpp"
 #include "Core/IntegratingComponent.hpp"
+#include "Core/NonlinearComponent.hpp"
+#include "Core/BehavioralComponent.hpp"
 #include "Core/Modulator.hpp"
+#include "Core/ThreadPool.hpp"
+#include "Core/Subcircuit.hpp"
+#include "Core/SubcircuitDef.hpp"
+#include "Core/SubcircuitInstance.hpp"
+#include "Core/CloneMap.hpp"
+#include "Component/Resistor.hpp"
+#include "Component/Capacitor.hpp"
+#include "Component/Inductor.hpp"
+#include "Component/TransmissionLine.hpp"
 
 #include <stdexcept>
 #include <map>
+#include <unordered_set>
+#include <algorithm>
 #include <limits>
+#include <cmath>
+#include <tuple>
+#include <typeinfo>
 
 #include <gsl/gsl_errno.h>
 
 namespace spice {
 
 Circuit::Circuit(double min_ts, double max_ts, double max_e_abs, double max_e_rel, const gsl_odeiv2_step_type *stepper_type):
-	min_ts(min_ts), max_ts(max_ts), max_e_abs(max_e_abs), max_e_rel(max_e_rel), stepper_type(stepper_type) {
+	user_min_ts(min_ts), user_max_ts(max_ts),
+	min_ts(min_ts ? min_ts : 1e-15), max_ts(max_ts ? max_ts : 1e-6), initial_ts(this->max_ts),
+	max_e_abs(max_e_abs), max_e_rel(max_e_rel), initial_stepper_type(stepper_type), stepper_type(stepper_type) {
 	system.function = system_function;
-	system.jacobian = nullptr;
+	system.jacobian = system_jacobian;
 	system.params = this;
 }
 
@@ -54,6 +72,183 @@ Node *Circuit::get_gnd_node() {
 	return n;
 }
 
+std::unique_ptr<Circuit> Circuit::clone(CloneMap *map) const {
+	// States carried through a pending re-generation are read through the old state assignment
+	if(gen_matrix_pend && simulation_mode == TRANSIENT_ANALYSIS && gen_mode == TRANSIENT_ANALYSIS)
+		throw std::logic_error("Circuit can't be cloned after a topology change until the next step");
+	
+	CloneMap local_map;
+	CloneMap &m = map ? *map : local_map;
+	m = CloneMap();
+	
+	std::unique_ptr<Circuit> c(new Circuit(user_min_ts, user_max_ts, max_e_abs, max_e_rel, initial_stepper_type));
+	
+	// Options
+	c->mixed_precision = mixed_precision;
+	c->max_refinement_steps = max_refinement_steps;
+	c->dense_solver = dense_solver;
+	c->max_newton_iterations = max_newton_iterations;
+	c->newton_reltol = newton_reltol;
+	c->newton_vntol = newton_vntol;
+	c->newton_abstol = newton_abstol;
+	c->bypass_tol = bypass_tol;
+	c->modified_newton = modified_newton;
+	c->auto_stepper = auto_stepper;
+	c->explicit_stepper = explicit_stepper;
+	c->implicit_stepper = implicit_stepper;
+	c->stiffness_check_interval = stiffness_check_interval;
+	c->reduce_states = reduce_states;
+	c->n_threads = n_threads;
+	c->record_trajectory = record_trajectory;
+	c->save_period = save_period;
+	
+	// Nodes, components, and modulators in the same order, so the clone's matrix and
+	// state assignment come out the same as ours
+	for(auto &n:nodes) {
+		Node *copy = n->fixed ? new Node{c.get(), n->fixed_voltage} : new Node{c.get()};
+		copy->_v_hist = n->_v_hist;
+		copy->auto_save = n->auto_save;
+		c->nodes.emplace_back(copy);
+		m.nodes[n.get()] = copy;
+	}
+	
+	for(auto &comp:components) {
+		Component *copy = comp->clone();
+		c->components.emplace_back(copy);
+		m.components[comp.get()] = copy;
+		
+		if(const TwoTerminalComponent *ttc = dynamic_cast<const TwoTerminalComponent*>(comp.get()))
+			m.values[&ttc->value] = &static_cast<TwoTerminalComponent*>(copy)->value;
+	}
+	
+	for(auto &mod:modulators) {
+		Modulator *copy = mod->clone();
+		c->modulators.emplace_back(copy);
+		m.modulators[mod.get()] = copy;
+	}
+	
+	// Everything exists now, so references between them can be rebound
+	for(auto &comp:c->components)
+		comp->rebind(c.get(), m);
+	
+	for(auto &mod:c->modulators)
+		mod->rebind(c.get(), m);
+	
+	for(auto &n:nodes) {
+		Node *copy = m.nodes.at(n.get());
+		for(auto &conn:n->connections)
+			copy->connections[m.component(conn.first)] = conn.second;
+	}
+	
+	for(auto &sub:subcircuits) {
+		std::vector<TwoTerminalComponent*> comps;
+		for(const TwoTerminalComponent *ttc:sub->comps)
+			comps.push_back(m.component(ttc));
+		
+		Subcircuit *copy = new Subcircuit(c.get(), comps);
+		c->subcircuits.emplace_back(copy);
+		m.subcircuits[sub.get()] = copy;
+	}
+	
+	// Instances share our definitions
+	for(auto &inst:instances) {
+		std::vector<Node*> ports;
+		for(const Node *n:inst->ports)
+			ports.push_back(m.node(n));
+		
+		SubcircuitInstance *copy = new SubcircuitInstance(c.get(), inst->def, ports, inst->overrides);
+		copy->ic_values = inst->ic_values;
+		c->instances.emplace_back(copy);
+		m.instances[inst.get()] = copy;
+	}
+	
+	// Simulation state
+	c->simulation_mode = simulation_mode;
+	c->stepper_type = stepper_type;
+	c->min_ts = min_ts;
+	c->max_ts = max_ts;
+	c->initial_ts = initial_ts;
+	c->_save_times = _save_times;
+	c->trajectory = trajectory;
+	
+	// Generate the matrix (and allocate the driver) for the present mode, then take over
+	// the solution and states, which have the same layout
+	if(!gen_matrix_pend) {
+		c->gen_matrix();
+		
+		if(c->solved_vec.size() != solved_vec.size() || c->deq_state.size() != deq_state.size())
+			throw std::logic_error("Cloned circuit has a different matrix");
+		
+		// Copied in place since expressions reference both
+		std::copy(solved_vec.data(), solved_vec.data() + solved_vec.size(), c->solved_vec.data());
+		std::copy(deq_state.begin(), deq_state.end(), c->deq_state.begin());
+		
+		// Nonlinear components keep their linearizations
+		c->newton_jacobian_valid = newton_jacobian_valid;
+		
+		c->next_step = next_step;
+		if(_dt)
+			*c->_dt = *_dt;
+		
+		// The derivative at the end of the last step is reused by steppers that can,
+		// so single-step methods continue exactly (multistep methods restart)
+		if(system.dimension && driver && c->driver) {
+			gsl_odeiv2_evolve *e = driver->e, *ce = c->driver->e;
+			std::copy(e->dydt_out, e->dydt_out + system.dimension, ce->dydt_out);
+			ce->count = e->count;
+			ce->failed_steps = e->failed_steps;
+			ce->last_step = e->last_step;
+		}
+		
+		c->stiffness_window_accepted = stiffness_window_accepted;
+		c->stiffness_window_rejected = stiffness_window_rejected;
+	}
+	
+	c->t = t;
+	
+	return c;
+}
+
+void Circuit::map_parts(Circuit &other, CloneMap &map) const {
+	if(other.nodes.size() != nodes.size() || other.components.size() != components.size() ||
+	   other.modulators.size() != modulators.size() || other.subcircuits.size() != subcircuits.size() ||
+	   other.instances.size() != instances.size())
+		throw std::invalid_argument("Circuits weren't built the same way");
+	
+	map = CloneMap();
+	
+	for(size_t ind = 0; ind < nodes.size(); ind++) {
+		if(nodes[ind]->fixed != other.nodes[ind]->fixed)
+			throw std::invalid_argument("Circuits weren't built the same way");
+		map.nodes[nodes[ind].get()] = other.nodes[ind].get();
+	}
+	
+	for(size_t ind = 0; ind < components.size(); ind++) {
+		const Component *comp = components[ind].get();
+		Component *other_comp = other.components[ind].get();
+		if(typeid(*comp) != typeid(*other_comp))
+			throw std::invalid_argument("Circuits weren't built the same way");
+		
+		map.components[comp] = other_comp;
+		if(const TwoTerminalComponent *ttc = dynamic_cast<const TwoTerminalComponent*>(comp))
+			map.values[&ttc->value] = &static_cast<TwoTerminalComponent*>(other_comp)->value;
+	}
+	
+	for(size_t ind = 0; ind < modulators.size(); ind++) {
+		const Modulator *mod = modulators[ind].get();
+		Modulator *other_mod = other.modulators[ind].get();
+		if(typeid(*mod) != typeid(*other_mod))
+			throw std::invalid_argument("Circuits weren't built the same way");
+		map.modulators[mod] = other_mod;
+	}
+	
+	for(size_t ind = 0; ind < subcircuits.size(); ind++)
+		map.subcircuits[subcircuits[ind].get()] = other.subcircuits[ind].get();
+	
+	for(size_t ind = 0; ind < instances.size(); ind++)
+		map.instances[instances[ind].get()] = other.instances[ind].get();
+}
+
 // Enable saving for all nodes and components
 void Circuit::save_all(double period) {
 	if(period >= 0)
@@ -70,7 +265,9 @@ void Circuit::save_all(double period) {
 void Circuit::reset() {
 	gen_matrix_pend = true;
 	simulation_mode = DC_ANALYSIS;
+	stepper_type = initial_stepper_type;
 	t = 0;
+	trajectory.clear();
 	
 	for(auto &c:components)
 		c->clear_hist();
@@ -92,6 +289,15 @@ const double *Circuit::dt() const {
 	return _dt;
 }
 
+// Timestep limits in use
+double Circuit::min_timestep() const {
+	return min_ts;
+}
+
+double Circuit::max_timestep() const {
+	return max_ts;
+}
+
 // Floor function that handles floating point imprecision
 long Circuit::epsilon_floor(double x) {
 	long normal_floor = x;
@@ -123,13 +329,23 @@ double Circuit::next_modulator_time() const {
 	return earliest;
 }
 
+double Circuit::next_line_time() const {
+	double earliest = std::numeric_limits<double>::max();
+	
+	for(const TransmissionLine *tl:tlines)
+		earliest = std::min(earliest, tl->next_change_time());
+	
+	return earliest;
+}
+
 // Return the next time step length
 double Circuit::next_step_duration() const {
 	return std::max({min_ts,
 	       std::min({max_ts,
 	                 next_step,
 	                 next_save_time() - t,
-	                 next_modulator_time() - t})});
+	                 next_modulator_time() - t,
+	                 next_line_time() - t})});
 }
 
 // Return the next time we will step to
@@ -173,84 +389,526 @@ ssize_t Circuit::node_index(const Node *node) const {
 }
 
 ssize_t Circuit::node_index(const double *var) const {
+	// Without a matrix, a null var would look like the first variable
+	if(!solved_vec.size())
+		throw std::logic_error("Node indices need the circuit matrix generated first");
+	
 	// Find offset of node's voltage variable into solved_vec data area
 	ssize_t diff = var - solved_vec.data();
 	if(diff < 0 || (size_t)diff >= nodes.size()) return -1;
 	return diff;
 }
 
+void Circuit::assign_state_variables() {
+	const size_t n_nodes = nodes.size();
+	
+	// Simple union-find over node indices
+	auto find = [](std::vector<size_t> &parent, size_t x) {
+		while(parent[x] != x)
+			x = parent[x] = parent[parent[x]];
+		return x;
+	};
+	
+	std::vector<IntegratingComponent*> ics;
+	for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+		ics.push_back(ic);
+	});
+	
+	// Dependent components and the expression of their state in terms of
+	// (index into ics, coefficient) pairs of independent components, plus constant references
+	std::unordered_map<size_t, std::vector<std::pair<size_t, double>>> dep_states;
+	std::unordered_map<size_t, Expression> dep_consts;
+	
+	// Capacitor loops: build a spanning forest out of capacitors and fixed node voltages
+	// (relative to a virtual reference vertex). Capacitors closing a loop are links whose
+	// voltage follows from KVL around the tree path.
+	// Voltage sources are left out since a capacitor across one still needs a lagging state to carry current.
+	if(reduce_states) {
+		const size_t ref = n_nodes;
+		std::vector<size_t> uf(n_nodes + 1);
+		for(size_t ind = 0; ind <= n_nodes; ind++)
+			uf[ind] = ind;
+		
+		// Tree edges from each vertex: (other vertex, edge voltage sign from this vertex, ics index or fixed node)
+		struct Edge {
+			size_t to;
+			double sign;
+			ssize_t ic;
+			const double *fixed_v;
+		};
+		std::vector<std::vector<Edge>> tree(n_nodes + 1);
+		std::vector<size_t> links;
+		
+		for(size_t node_ind = 0; node_ind < n_nodes; node_ind++)
+			if(nodes[node_ind]->fixed) {
+				uf[find(uf, node_ind)] = find(uf, ref);
+				tree[node_ind].push_back({ref, 1, -1, &nodes[node_ind]->fixed_voltage});
+				tree[ref].push_back({node_ind, -1, -1, &nodes[node_ind]->fixed_voltage});
+			}
+		
+		for(size_t ind = 0; ind < ics.size(); ind++) {
+			if(!dynamic_cast<const Capacitor*>(ics[ind]))
+				continue;
+			
+			const size_t top = node_index(ics[ind]->node_top);
+			const size_t bot = node_index(ics[ind]->node_bot);
+			const size_t top_root = find(uf, top), bot_root = find(uf, bot);
+			
+			if(top_root == bot_root)
+				links.push_back(ind);
+			else {
+				uf[top_root] = bot_root;
+				tree[top].push_back({bot,  1, (ssize_t)ind, nullptr});
+				tree[bot].push_back({top, -1, (ssize_t)ind, nullptr});
+			}
+		}
+		
+		if(links.size()) {
+			// Root the forest to find tree paths
+			std::vector<ssize_t> parent(n_nodes + 1, -1);
+			std::vector<const Edge*> parent_edge(n_nodes + 1, nullptr);
+			std::vector<size_t> depth(n_nodes + 1, 0);
+			std::vector<bool> visited(n_nodes + 1, false);
+			
+			for(size_t root = 0; root <= n_nodes; root++) {
+				if(visited[root])
+					continue;
+				
+				std::vector<size_t> stack{root};
+				visited[root] = true;
+				
+				while(stack.size()) {
+					const size_t v = stack.back();
+					stack.pop_back();
+					
+					for(const Edge &e:tree[v])
+						if(!visited[e.to]) {
+							visited[e.to] = true;
+							parent[e.to] = v;
+							parent_edge[e.to] = &e;
+							depth[e.to] = depth[v] + 1;
+							stack.push_back(e.to);
+						}
+				}
+			}
+			
+			for(size_t link:links) {
+				auto &states = dep_states[link];
+				Expression &consts = dep_consts[link];
+				
+				// Walk up to the common ancestor from both ends
+				// v(top) - v(bot) = sum of edge voltages going up from top - sum going up from bot
+				size_t a = node_index(ics[link]->node_top);
+				size_t b = node_index(ics[link]->node_bot);
+				
+				auto step_up = [&](size_t &v, double side) {
+					// Edge stored at parent pointing to v; voltage from v to parent is the negated sign
+					const Edge *e = parent_edge[v];
+					const double sign = -e->sign*side;
+					if(e->ic >= 0)
+						states.push_back({(size_t)e->ic, sign});
+					else
+						consts.push_back({sign, {e->fixed_v}});
+					v = parent[v];
+				};
+				
+				while(depth[a] > depth[b])
+					step_up(a, 1);
+				while(depth[b] > depth[a])
+					step_up(b, -1);
+				while(a != b) {
+					step_up(a, 1);
+					step_up(b, -1);
+				}
+			}
+		}
+	}
+	
+	// Inductor cutsets: contract every non-inductor branch (and all fixed nodes) into supernodes.
+	// Only inductors cross between supernodes, so KCL at each supernode constrains inductor currents.
+	// Inductors in a spanning forest of the supernode graph are dependent on the links.
+	if(reduce_states) {
+		std::vector<size_t> uf(n_nodes);
+		for(size_t ind = 0; ind < n_nodes; ind++)
+			uf[ind] = ind;
+		
+		ssize_t first_fixed = -1;
+		for(size_t node_ind = 0; node_ind < n_nodes; node_ind++)
+			if(nodes[node_ind]->fixed) {
+				if(first_fixed >= 0)
+					uf[find(uf, node_ind)] = find(uf, first_fixed);
+				else
+					first_fixed = node_ind;
+			}
+		
+		std::vector<size_t> inductors;
+		for(auto &c:components) {
+			const TwoTerminalComponent *ttc = dynamic_cast<const TwoTerminalComponent*>(c.get());
+			if(!ttc)
+				continue;
+			
+			if(dynamic_cast<const Inductor*>(ttc))
+				continue;
+			
+			uf[find(uf, node_index(ttc->node_top))] = find(uf, node_index(ttc->node_bot));
+		}
+		
+		// Instances' cells can connect any of their ports to each other and to ground (the cell's ground is ours)
+		for(auto &inst:instances) {
+			ssize_t first_port = first_fixed;
+			for(const Node *port:inst->ports) {
+				if(first_port >= 0)
+					uf[find(uf, node_index(port))] = find(uf, first_port);
+				else
+					first_port = node_index(port);
+			}
+		}
+		
+		for(size_t ind = 0; ind < ics.size(); ind++)
+			if(dynamic_cast<const Inductor*>(ics[ind]))
+				inductors.push_back(ind);
+		
+		// Supernode graph spanning forest
+		std::vector<size_t> super_uf(n_nodes);
+		for(size_t ind = 0; ind < n_nodes; ind++)
+			super_uf[ind] = ind;
+		
+		// Incident inductors of each supernode: (ics index, +1 if current enters the supernode)
+		std::unordered_map<size_t, std::vector<std::pair<size_t, double>>> incident;
+		std::unordered_map<size_t, std::vector<std::pair<size_t, size_t>>> tree_adj;
+		bool have_tree = false;
+		
+		for(size_t ind:inductors) {
+			const size_t top = find(uf, node_index(ics[ind]->node_top));
+			const size_t bot = find(uf, node_index(ics[ind]->node_bot));
+			
+			// Both ends in the same supernode; not part of any inductor cutset
+			if(top == bot)
+				continue;
+			
+			incident[top].push_back({ind, -1});
+			incident[bot].push_back({ind,  1});
+			
+			const size_t top_root = find(super_uf, top), bot_root = find(super_uf, bot);
+			if(top_root != bot_root) {
+				super_uf[top_root] = bot_root;
+				tree_adj[top].push_back({bot, ind});
+				tree_adj[bot].push_back({top, ind});
+				have_tree = true;
+			}
+		}
+		
+		if(have_tree) {
+			// Post-order over each tree; a tree inductor's current follows from KCL
+			// at the child supernode once all of the child's other tree inductors are known
+			std::unordered_map<size_t, bool> visited;
+			
+			for(auto &root_adj:tree_adj) {
+				const size_t root = root_adj.first;
+				if(visited[root])
+					continue;
+				
+				// (supernode, parent supernode, inductor to parent)
+				std::vector<std::tuple<size_t, ssize_t, ssize_t>> order, stack{{root, -1, -1}};
+				visited[root] = true;
+				
+				while(stack.size()) {
+					auto item = stack.back();
+					stack.pop_back();
+					order.push_back(item);
+					
+					for(auto &adj:tree_adj[std::get<0>(item)])
+						if(!visited[adj.first]) {
+							visited[adj.first] = true;
+							stack.push_back({adj.first, std::get<0>(item), adj.second});
+						}
+				}
+				
+				for(auto it = order.rbegin(); it != order.rend(); it++) {
+					const ssize_t tree_ind = std::get<2>(*it);
+					if(tree_ind < 0)
+						continue;
+					
+					// KCL: sum of sign*current over incident inductors = 0
+					double tree_sign = 0;
+					std::vector<std::pair<size_t, double>> others;
+					for(auto &inc:incident[std::get<0>(*it)]) {
+						if(inc.first == (size_t)tree_ind)
+							tree_sign = inc.second;
+						else
+							others.push_back(inc);
+					}
+					
+					auto &states = dep_states[tree_ind];
+					for(auto &other:others) {
+						const double coeff = -tree_sign*other.second;
+						
+						// Other dependent inductors (children in the tree) are already expressed in terms of links
+						auto dep = dep_states.find(other.first);
+						if(dep != dep_states.end() && other.first != (size_t)tree_ind)
+							for(auto &dep_term:dep->second)
+								states.push_back({dep_term.first, coeff*dep_term.second});
+						else
+							states.push_back({other.first, coeff});
+					}
+				}
+			}
+		}
+	}
+	
+	// Allocate states for the independent components
+	// Subcircuit instance states go after the components' states
+	system.dimension = ics.size() - dep_states.size() + n_cell_states;
+	deq_state.resize(system.dimension);
+	dydt_exprs.resize(system.dimension - n_cell_states);
+	
+	size_t ic_ind = 0;
+	for(size_t ind = 0; ind < ics.size(); ind++) {
+		IntegratingComponent *ic = ics[ind];
+		
+		if(dep_states.count(ind)) {
+			ic->var = nullptr;
+			continue;
+		}
+		
+		// Initialize integrator state vector to initial conditions stored in components
+		// and set each IntegratingComponent's integration variable reference
+		ic->var = deq_state.data() + ic_ind;
+		ic->state_expr = {ic->var};
+		deq_state[ic_ind] = ic->initial_cond;
+		ic_ind++;
+	}
+	
+	for(auto &dep:dep_states) {
+		Expression &state = ics[dep.first]->state_expr;
+		state = dep_consts[dep.first];
+		
+		for(auto &term:dep.second)
+			state.push_back({term.second, {ics[term.first]->var}});
+	}
+	
+	// Instance states start from the initial conditions found with the DC solution
+	for(auto &inst:instances) {
+		inst->state_offset += ic_ind;
+		
+		size_t cell_ic_ind = 0;
+		Circuit &cell = *cell_variants[inst->variant]->cell;
+		cell.for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+			if(ic->var) {
+				const double initial_cond = cell_ic_ind < inst->ic_values.size() ? inst->ic_values[cell_ic_ind] : ic->initial_cond;
+				deq_state[inst->state_offset + (ic->var - cell.deq_state.data())] = initial_cond;
+			}
+			cell_ic_ind++;
+		});
+	}
+}
+
 void Circuit::gen_matrix() {
-	// Figure out how many variables we have
 	size_t n_nodes = nodes.size();
-	n_vars = n_nodes;
 	
-	system.dimension = 0;
+	// Each voltage source will get an additional variable that represents the current through it
+	std::vector<const TwoTerminalComponent*> vsources;
+	size_t n_ics = 0;
 	
-	std::unordered_map<const TwoTerminalComponent*, size_t> vsource_map;
+	tlines.clear();
 	
 	for(auto &c:components) {
 		const TwoTerminalComponent *ttc = dynamic_cast<const TwoTerminalComponent*>(c.get());
-		const IntegratingComponent *ic  = dynamic_cast<const IntegratingComponent*>(c.get());
 		
 		// Make sure all components are connected properly
 		if(!c->fully_connected())
 			throw std::runtime_error("Components not fully connected");
 		
-		// Create a list of voltage sources
-		// Each voltage source will get an additional variable that represents the current through it
 		if(ttc && ttc->v_expr().size())
-			vsource_map.emplace(ttc, n_vars++);
+			vsources.push_back(ttc);
+		
+		if(dynamic_cast<const IntegratingComponent*>(c.get()))
+			n_ics++;
 		
-		// Count the number of IntegratingComponents
-		if(ic)
-			system.dimension++;
+		if(TransmissionLine *tl = dynamic_cast<TransmissionLine*>(c.get()))
+			tlines.push_back(tl);
 	}
 	
-	// Clear and resize circuit representation
-	expr_mat.clear();
-	expr_vec.clear();
-	expr_vec.resize(n_vars);
+	auto same_vsources = [&]() {
+		bool same = vsources.size() == vsource_map.size();
+		for(const TwoTerminalComponent *vsource:vsources)
+			same &= vsource_map.count(vsource) > 0;
+		return same;
+	};
 	
-	eval_mat.resize(n_vars, n_vars);
-	eval_mat.setZero();
-	eval_vec.resize(n_vars);
-	solved_vec.resize(n_vars);
+	// Switching modes: keep the present matrix, and use the one already generated for the new mode
+	// if the topology hasn't changed since (components can still become voltage-defined, like a
+	// capacitor given an initial condition)
+	const bool mode_switch = gen_mode >= 0 && gen_mode != simulation_mode;
+	if(mode_switch) {
+		// Rows still waiting to be re-generated make the present matrix useless later
+		const bool up_to_date = !regen_all && changed_nodes.empty();
+		swap_plan();
+		if(!up_to_date)
+			other_plan.mode = -1;
+		
+		if(up_to_date && gen_mode == simulation_mode && same_vsources()) {
+			reuse_plan();
+			return;
+		}
+		
+		gen_mode = -1;
+	}
 	
-	dydt_exprs.resize(system.dimension);
-	deq_state.resize(system.dimension);
-	_dt = nullptr;
-	next_step = max_ts;
+	// A running transient simulation keeps its states through topology changes,
+	// so read them while the old state assignment is still in place
+	const bool running = simulation_mode == TRANSIENT_ANALYSIS && gen_mode == TRANSIENT_ANALYSIS;
+	std::unordered_map<const IntegratingComponent*, double> carried_states;
+	std::unordered_map<const IntegratingComponent*, Expression> old_state_exprs;
 	
-	// Set each node's voltage reference to the corresponding variable in solved_vec
-	for(size_t ind = 0; ind < n_nodes; ind++)
-		nodes[ind]->_v = &solved_vec[ind];
+	if(running) {
+		for(const IntegratingComponent *ic:state_comps) {
+			carried_states[ic] = ic->state_expr.eval();
+			old_state_exprs[ic] = ic->state_expr;
+		}
+		
+		// Instances added since the last generation aren't stamped yet
+		for(auto &inst:instances) {
+			if(inst->slots.empty())
+				continue;
+			
+			size_t cell_ic_ind = 0;
+			Circuit &cell = *cell_variants[inst->variant]->cell;
+			cell.for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+				if(cell_ic_ind >= inst->ic_values.size())
+					inst->ic_values.push_back(ic->initial_cond);
+				if(ic->var)
+					inst->ic_values[cell_ic_ind] = deq_state[inst->state_offset + (ic->var - cell.deq_state.data())];
+				cell_ic_ind++;
+			});
+		}
+	}
 	
-	if(simulation_mode == TRANSIENT_ANALYSIS && system.dimension) {
-		// Allocate diff EQ driver
-		if(driver)
-			gsl_odeiv2_driver_free(driver);
-		driver = gsl_odeiv2_driver_alloc_y_new(&system, stepper_type, max_ts, max_e_abs, max_e_rel);
-		if(!driver)
-			throw std::runtime_error("GSL driver allocation failed");
+	system.dimension = 0;
+	
+	gen_cells();
+	
+	// Only the changed nodes' rows need to be re-generated if the variables stay the same
+	// and the states fit in deq_state without moving it (expressions reference both)
+	const bool incremental = !regen_all && gen_mode == simulation_mode && same_vsources() &&
+	                         (simulation_mode == DC_ANALYSIS || n_ics + n_cell_states <= deq_state.capacity());
+	
+	if(!incremental) {
+		n_vars = n_nodes;
+		vsource_map.clear();
+		for(const TwoTerminalComponent *vsource:vsources)
+			vsource_map.emplace(vsource, n_vars++);
 		
-		gsl_odeiv2_driver_set_hmin(driver, min_ts);
-		gsl_odeiv2_driver_set_hmax(driver, max_ts);
-		_dt = &driver->h;
-		*_dt = next_step;
+		// Clear and resize circuit representation
+		expr_mat.clear();
+		expr_vec.clear();
+		expr_vec.resize(n_vars);
 		
-		// Initialize integrator state vector to initial conditions stored in components
-		// and set each IntegratingComponent's integration variable reference
+		eval_vec.resize(n_vars);
+		
+		// Keep the previous solution as the starting point for Newton iteration
+		// (just the node voltages if it's from the other mode)
+		const Eigen::VectorXd &old_solved = mode_switch ? other_plan.solved_vec : solved_vec;
+		const size_t n_kept = std::min<size_t>(old_solved.size(), mode_switch ? n_nodes : n_vars);
+		Eigen::VectorXd start = Eigen::VectorXd::Zero(n_vars);
+		start.head(n_kept) = old_solved.head(n_kept);
+		solved_vec = start;
+		
+		// Set each node's voltage reference to the corresponding variable in solved_vec
+		for(size_t ind = 0; ind < n_nodes; ind++)
+			nodes[ind]->_v = &solved_vec[ind];
+		
+		// A running simulation continues with its present step size
+		if(!running) {
+			_dt = nullptr;
+			next_step = initial_ts;
+		}
+		
+		// New structure needs new symbolic analysis, and mixed precision gets another chance
+		mat_solver.reset(new Eigen::SparseLU<Eigen::SparseMatrix<double>, CachedOrdering<int>>);
+		mat_solver_f.reset(new Eigen::SparseLU<Eigen::SparseMatrix<float>, CachedOrdering<int>>);
+		mat_solver_analyzed = false;
+		mat_solver_f_analyzed = false;
+		mixed_precision_stalled = false;
+	}
+	
+	factorized_values.clear();
+	
+	nonlinear_comps.clear();
+	for_component_type<NonlinearComponent>([&](NonlinearComponent *nl) {
+		nonlinear_comps.push_back(nl);
+	});
+	
+	behavioral_comps.clear();
+	for_component_type<BehavioralComponent>([&](BehavioralComponent *bc) {
+		behavioral_comps.push_back(bc);
+	});
+	newton_jacobian_valid = false;
+	
+	if(simulation_mode == TRANSIENT_ANALYSIS) {
+		// Leave room for IntegratingComponents added later
+		if(!incremental) {
+			deq_state.clear();
+			deq_state.reserve(2*(n_ics + n_cell_states));
+		}
+		
+		assign_state_variables();
+		
+		state_comps.clear();
+		for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+			state_comps.insert(ic);
+			
+			auto carried = carried_states.find(ic);
+			if(ic->var && carried != carried_states.end())
+				deq_state[ic->var - deq_state.data()] = carried->second;
+			
+			// Rows with components whose state is expressed differently need to be re-generated
+			auto old = old_state_exprs.find(ic);
+			if(incremental && (old == old_state_exprs.end() || old->second != ic->state_expr)) {
+				changed_nodes.insert(ic->node_top);
+				changed_nodes.insert(ic->node_bot);
+			}
+		});
+		
+		// Recorded steps belong to the old diff EQ system
+		if(running)
+			trajectory.clear();
+		
+		if(system.dimension)
+			alloc_driver();
+		
+		// Derivative expressions reference dt and possibly dependent components' states,
+		// so they can only be built once everything is assigned
 		size_t ic_ind = 0;
 		for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
-			ic->var = deq_state.data() + ic_ind;
-			deq_state[ic_ind] = ic->initial_cond;
-			dydt_exprs[ic_ind] = ic->dydt_expr();
-			ic_ind++;
+			if(ic->var)
+				dydt_exprs[ic_ind++] = ic->dydt_expr();
 		});
 	}
 	
+	// Rows to generate: changed nodes' rows, or all of them
+	std::vector<size_t> rows;
+	if(incremental) {
+		for(const Node *n:changed_nodes)
+			rows.push_back(node_index(n));
+		std::sort(rows.begin(), rows.end());
+	}
+	else {
+		rows.resize(n_nodes);
+		for(size_t ind = 0; ind < n_nodes; ind++)
+			rows[ind] = ind;
+	}
+	
+	auto changed = [&](const Node *n) {
+		return !incremental || changed_nodes.count(n) > 0;
+	};
+	
 	// Create voltage and current expressions for all TwoTerminalComponents
+	// (only the ones in changed rows, which are the ones whose current expressions can change)
 	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(!changed(ttc->node_top) && !changed(ttc->node_bot))
+			return;
+		
 		// Voltage is always difference between top and bottom node voltages
 		ttc->circuit_v_expr = {{ttc->node_top->v()}, {-1.0, {ttc->node_bot->v()}}};
 		
@@ -262,21 +920,64 @@ void Circuit::gen_matrix() {
 			ttc->circuit_i_expr = {&solved_vec[vi->second]};
 	});
 	
-	// The first rows and columns correspond to nodes
-	for(size_t node_ind = 0; node_ind < n_nodes; node_ind++) {
-		std::unique_ptr<Node> &n = nodes[node_ind];
+	// Remove the rows being re-generated, including the voltage-defining rows of
+	// voltage sources connected to changed nodes
+	if(incremental) {
+		std::unordered_set<size_t> erased_rows(rows.begin(), rows.end());
+		for(auto &vi:vsource_map)
+			if(changed(vi.first->node_top) || changed(vi.first->node_bot))
+				erased_rows.insert(vi.second);
 		
-		// Node is fixed to a voltage
-		if(n->fixed) {
-			// 1 * node voltage = fixed value
-			expr_mat[{node_ind, node_ind}].emplace_back(1.0);
-			expr_vec[node_ind].emplace_back(n->fixed_voltage);
+		for(auto it = expr_mat.begin(); it != expr_mat.end();) {
+			if(erased_rows.count(it->first.row))
+				it = expr_mat.erase(it);
+			else
+				it++;
 		}
 		
-		// Node is free to move; add currents to do KCL
-		else {
+		for(size_t row:erased_rows)
+			expr_vec[row].clear();
+	}
+	
+	// Position of each component, so node connections are walked in an order
+	// that doesn't depend on pointer values (and neither do the summation orders)
+	std::unordered_map<const Component*, size_t> comp_index;
+	for(size_t ind = 0; ind < components.size(); ind++)
+		comp_index[components[ind].get()] = ind;
+	
+	// Matrix (or RHS vector, if col is n_vars) entries from each chunk of nodes
+	struct Stamp {
+		size_t row, col;
+		Term term;
+	};
+	
+	ThreadPool &pool = thread_pool();
+	std::vector<std::vector<Stamp>> stamps(pool.size());
+	
+	// The first rows and columns correspond to nodes
+	pool.parallel_for(rows.size(), parallel_grain, [&](size_t begin, size_t end, unsigned int chunk) {
+		std::vector<Stamp> &out = stamps[chunk];
+		
+		for(size_t row_ind = begin; row_ind < end; row_ind++) {
+			const size_t node_ind = rows[row_ind];
+			const std::unique_ptr<Node> &n = nodes[node_ind];
+			
+			// Node is fixed to a voltage
+			if(n->fixed) {
+				// 1 * node voltage = fixed value
+				out.push_back({node_ind, node_ind, 1.0});
+				out.push_back({node_ind, n_vars, &n->fixed_voltage});
+				continue;
+			}
+			
+			// Node is free to move; add currents to do KCL
+			std::vector<std::pair<TwoTerminalComponent*, bool>> connections(n->connections.begin(), n->connections.end());
+			std::sort(connections.begin(), connections.end(), [&](const auto &x, const auto &y) {
+				return comp_index.at(x.first) < comp_index.at(y.first);
+			});
+			
 			// Iterate through all components connected to this node
-			for(auto &ci:n->connections) {
+			for(auto &ci:connections) {
 				Expression ie = ci.first->i_expr();
 				
 				// If current is leaving, invert coefficients of all terms
@@ -296,7 +997,7 @@ void Circuit::gen_matrix() {
 							// Remove the reference to the node from the term since
 							// the matrix multiplication will include it automatically
 							t.num.erase(num);
-							expr_mat[{node_ind, (size_t)node_match}].push_back(t);
+							out.push_back({node_ind, (size_t)node_match, t});
 							break;
 						}
 					}
@@ -306,88 +1007,2087 @@ void Circuit::gen_matrix() {
 						// Coefficient must be inverted since the KCL term is moved
 						// to the opposite side of the equation
 						t.coeff *= -1;
-						expr_vec[node_ind].push_back(t);
+						out.push_back({node_ind, n_vars, t});
 					}
 				}
 			}
 		}
-	}
+	});
+	
+	// Combine in chunk (and so node) order
+	for(auto &chunk_stamps:stamps)
+		for(Stamp &st:chunk_stamps) {
+			if(st.col == n_vars)
+				expr_vec[st.row].push_back(std::move(st.term));
+			else
+				expr_mat[{st.row, st.col}].push_back(std::move(st.term));
+		}
 	
 	// Rest of the rows and cols correspond to the voltage-defined components
 	for(auto vi:vsource_map) {
 		const TwoTerminalComponent *vsource = vi.first;
 		size_t extra_var_ind = vi.second;
 		
-		// Add 1 * current variables to connected nodes
+		if(!changed(vsource->node_top) && !changed(vsource->node_bot))
+			continue;
+		
+		// Add 1 * current variables to connected nodes (in rows being generated)
 		// but only if they aren't already a fixed voltage
 		// (since equations for the fixed ones aren't KCL equations anymore)
-		if(!vsource->node_top->fixed)
+		if(!vsource->node_top->fixed && changed(vsource->node_top))
 			expr_mat[{(size_t)node_index(vsource->node_top), extra_var_ind}].emplace_back(-1.0);
 		
-		if(!vsource->node_bot->fixed)
+		if(!vsource->node_bot->fixed && changed(vsource->node_bot))
 			expr_mat[{(size_t)node_index(vsource->node_bot), extra_var_ind}].emplace_back(1.0);
 		
 		// Create extra equation defining the forced voltage difference
 		// Node voltage at the negative side should have negative sign
 		expr_mat[{extra_var_ind, (size_t)node_index(vsource->node_top)}].emplace_back(1.0);
 		expr_mat[{extra_var_ind, (size_t)node_index(vsource->node_bot)}].emplace_back(-1.0);
-		expr_vec[extra_var_ind] = vsource->v_expr();
+		
+		// Terms referencing node voltages (controlled sources) move to the left-hand side
+		expr_vec[extra_var_ind].clear();
+		for(Term &t:vsource->v_expr()) {
+			ssize_t node_match = -1;
+			
+			for(auto num = t.num.begin(); num != t.num.end(); num++) {
+				node_match = node_index(*num);
+				if(node_match >= 0) {
+					t.num.erase(num);
+					t.coeff *= -1;
+					expr_mat[{extra_var_ind, (size_t)node_match}].push_back(t);
+					break;
+				}
+			}
+			
+			if(node_match < 0)
+				expr_vec[extra_var_ind].push_back(t);
+		}
 	}
 	
-	gen_matrix_pend = false;
-}
-
-void Circuit::update_matrix() {
-	// Evaluate the circuit definition matrix with current parameters
-	// and convert to Eigen form
+	// Fix the sparsity pattern and remember where each entry's value is stored
+	// so update_matrix() can evaluate entries independently
+	// Subcircuit instances add admittances between all of their ports (in free nodes' rows)
+	std::vector<Eigen::Triplet<double>> triplets;
+	triplets.reserve(expr_mat.size());
 	for(auto &expr:expr_mat)
-		eval_mat.coeffRef(expr.first.row, expr.first.col) = expr.second.eval();
+		triplets.emplace_back(expr.first.row, expr.first.col, 0.0);
 	
-	for(size_t row = 0; row < n_vars; row++)
-		eval_vec[row] = expr_vec[row].eval();
+	for(auto &inst:instances)
+		for(const Node *row:inst->ports)
+			if(!row->fixed)
+				for(const Node *col:inst->ports)
+					triplets.emplace_back(node_index(row), node_index(col), 0.0);
+	
+	Eigen::SparseMatrix<double> pattern(n_vars, n_vars);
+	pattern.setFromTriplets(triplets.begin(), triplets.end());
+	pattern.makeCompressed();
+	
+	// Symbolic analysis is only needed again if the pattern changed
+	const bool same_pattern = incremental && pattern.nonZeros() == eval_mat.nonZeros() &&
+	                          std::equal(pattern.outerIndexPtr(), pattern.outerIndexPtr() + n_vars + 1, eval_mat.outerIndexPtr()) &&
+	                          std::equal(pattern.innerIndexPtr(), pattern.innerIndexPtr() + pattern.nonZeros(), eval_mat.innerIndexPtr());
 	
-	// Prepare the solver
-	if(!eval_mat.isCompressed()) {
-		// Structure changed
-		eval_mat.makeCompressed();
-		mat_solver.analyzePattern(eval_mat);
+	if(!same_pattern) {
+		eval_mat = std::move(pattern);
+		mat_solver_analyzed = false;
+		mat_solver_f_analyzed = false;
+		mixed_precision_stalled = false;
 	}
 	
-	mat_solver.factorize(eval_mat);
-	if(mat_solver.info() != Eigen::Success)
-		throw std::runtime_error("SparseLU factorize: " + mat_solver.lastErrorMessage());
-}
-
-void Circuit::topology_changed() {
-	gen_matrix_pend = true;
-	simulation_mode = DC_ANALYSIS;
+	mat_entries.clear();
+	mat_entries.reserve(expr_mat.size());
+	for(auto &expr:expr_mat)
+		mat_entries.push_back({&expr.second, &eval_mat.coeffRef(expr.first.row, expr.first.col)});
+	
+	gen_instance_slots();
+	
+	// Condensation works on the double-precision factors
+	// (and the condensed pattern can change even if eval_mat's doesn't)
+	gen_condensation();
+	if(condensed.size()) {
+		mixed_precision_stalled = true;
+		mat_solver_analyzed = false;
+	}
+	
+	// Dense factors are double precision only
+	if(dense_solver)
+		mixed_precision_stalled = true;
+	
+	gen_mode = simulation_mode;
+	regen_all = false;
+	changed_nodes.clear();
+	gen_matrix_pend = false;
 }
 
-void Circuit::solve_matrix() {
-	// Recompute values in the matrix
-	update_matrix();
+void Circuit::swap_plan() {
+	std::swap(gen_mode, other_plan.mode);
+	expr_mat.swap(other_plan.expr_mat);
+	vsource_map.swap(other_plan.vsource_map);
+	mat_entries.swap(other_plan.mat_entries);
+	expr_vec.swap(other_plan.expr_vec);
+	std::swap(n_vars, other_plan.n_vars);
 	
-	// Solve the circuit matrix to get all node voltages
-	solved_vec = mat_solver.solve(eval_vec);
-	if(mat_solver.info() != Eigen::Success)
-		throw std::runtime_error("SparseLU solve: " + mat_solver.lastErrorMessage());
+	// Eigen swaps only exchange storage, so references into it stay valid
+	eval_mat.swap(other_plan.eval_mat);
+	eval_vec.swap(other_plan.eval_vec);
+	solved_vec.swap(other_plan.solved_vec);
+	mat_solver.swap(other_plan.mat_solver);
+	std::swap(mat_solver_analyzed, other_plan.mat_solver_analyzed);
+	std::swap(dense_lu, other_plan.dense_lu);
+	std::swap(dense_factorized, other_plan.dense_factorized);
+	eval_mat_f.swap(other_plan.eval_mat_f);
+	mat_solver_f.swap(other_plan.mat_solver_f);
+	std::swap(mat_solver_f_analyzed, other_plan.mat_solver_f_analyzed);
+	factorized_values.swap(other_plan.factorized_values);
+	std::swap(factorized_single, other_plan.factorized_single);
+	std::swap(eval_mat_norm, other_plan.eval_mat_norm);
+	std::swap(mixed_precision_stalled, other_plan.mixed_precision_stalled);
+	std::swap(system.dimension, other_plan.dimension);
+	
+	size_t comp_ind = 0;
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(comp_ind == other_plan.comp_exprs.size())
+			other_plan.comp_exprs.emplace_back();
+		
+		std::swap(ttc->circuit_v_expr, other_plan.comp_exprs[comp_ind].first);
+		std::swap(ttc->circuit_i_expr, other_plan.comp_exprs[comp_ind].second);
+		comp_ind++;
+	});
+	
+	for(size_t ind = 0; ind < nodes.size() && ind < (size_t)solved_vec.size(); ind++)
+		nodes[ind]->_v = &solved_vec[ind];
+}
+
+void Circuit::reuse_plan() {
+	// Start from the node voltages of the other mode's solution
+	const size_t n_nodes = nodes.size();
+	solved_vec.head(n_nodes) = other_plan.solved_vec.head(n_nodes);
+	newton_jacobian_valid = false;
+	
+	// Cells and their instances' stamps depend on the mode
+	gen_cells();
+	gen_instance_slots();
+	
+	// States start from the initial conditions again
+	if(simulation_mode == TRANSIENT_ANALYSIS) {
+		assign_state_variables();
+		
+		next_step = initial_ts;
+		if(system.dimension)
+			alloc_driver();
+	}
+	
+	gen_condensation();
+	if(condensed.size()) {
+		mixed_precision_stalled = true;
+		mat_solver_analyzed = false;
+		factorized_values.clear();
+	}
+	
+	changed_nodes.clear();
+	gen_matrix_pend = false;
+}
+
+void Circuit::gen_condensation() {
+	condensed.clear();
+	
+	// Subcircuit owning each variable (-1 for the rest of the circuit)
+	std::vector<ssize_t> owner(n_vars, -1);
+	
+	for(auto &sub:subcircuits) {
+		// Free nodes with every connection inside the subcircuit are internal
+		std::unordered_set<const TwoTerminalComponent*> in_sub(sub->comps.begin(), sub->comps.end());
+		std::unordered_set<const Node*> seen;
+		sub->internal.clear();
+		sub->boundary.clear();
+		
+		for(TwoTerminalComponent *ttc:sub->comps)
+			for(Node *n:{ttc->node_top, ttc->node_bot}) {
+				if(!seen.insert(n).second)
+					continue;
+				
+				bool inside = !n->fixed;
+				for(auto &ci:n->connections)
+					inside &= in_sub.count(ci.first) > 0;
+				
+				(inside ? sub->internal : sub->boundary).push_back(n);
+			}
+		
+		sub->int_vars.clear();
+		sub->row_vars.clear();
+		sub->col_vars.clear();
+		sub->entries.clear();
+		sub->schur_slots.clear();
+		sub->condensed_values.clear();
+		sub->solver_analyzed = false;
+		
+		if(sub->internal.empty())
+			continue;
+		
+		for(Node *n:sub->internal) {
+			const size_t var = node_index(n);
+			if(owner[var] >= 0)
+				throw std::logic_error("Subcircuits share an internal node");
+			
+			owner[var] = condensed.size();
+			sub->int_vars.push_back(var);
+		}
+		
+		condensed.push_back(sub.get());
+	}
+	
+	if(condensed.empty())
+		return;
+	
+	// Current variables of voltage-defined components touching internal nodes
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		auto vi = vsource_map.find(ttc);
+		if(vi == vsource_map.end())
+			return;
+		
+		ssize_t o = owner[node_index(ttc->node_top)];
+		if(o < 0)
+			o = owner[node_index(ttc->node_bot)];
+		
+		if(o >= 0) {
+			owner[vi->second] = o;
+			condensed[o]->int_vars.push_back(vi->second);
+		}
+	});
+	
+	// Position of each variable in its subcircuit or in the condensed matrix
+	std::vector<size_t> local(n_vars);
+	for(Subcircuit *sub:condensed)
+		for(size_t ind = 0; ind < sub->int_vars.size(); ind++)
+			local[sub->int_vars[ind]] = ind;
+	
+	size_t n_cond = 0;
+	cond_index.resize(n_vars);
+	for(size_t var = 0; var < n_vars; var++)
+		cond_index[var] = owner[var] < 0 ? (ssize_t)n_cond++ : -1;
+	
+	// Sort eval_mat entries into the rest of the circuit and each subcircuit's blocks,
+	// collecting the variables coupled to internal ones
+	std::vector<std::unordered_map<size_t, size_t>> row_local(condensed.size()), col_local(condensed.size());
+	std::vector<Eigen::Triplet<double>> triplets;
+	
+	for(Eigen::Index col = 0; col < eval_mat.outerSize(); col++)
+		for(Eigen::SparseMatrix<double>::InnerIterator it(eval_mat, col); it; ++it) {
+			const size_t row = it.row();
+			const size_t offset = &it.valueRef() - eval_mat.valuePtr();
+			const ssize_t ro = owner[row], co = owner[col];
+			
+			if(ro < 0 && co < 0)
+				triplets.emplace_back(cond_index[row], cond_index[col], 0.0);
+			
+			else if(ro >= 0 && co >= 0) {
+				if(ro != co)
+					throw std::logic_error("Subcircuits share a component");
+				
+				condensed[ro]->entries.push_back({offset, &condensed[ro]->A_ii, local[row], local[col]});
+			}
+			
+			else if(ro >= 0) {
+				Subcircuit *sub = condensed[ro];
+				auto ci = col_local[ro].emplace(col, sub->col_vars.size());
+				if(ci.second)
+					sub->col_vars.push_back(col);
+				
+				sub->entries.push_back({offset, &sub->A_ic, local[row], ci.first->second});
+			}
+			
+			else {
+				Subcircuit *sub = condensed[co];
+				auto ri = row_local[co].emplace(row, sub->row_vars.size());
+				if(ri.second)
+					sub->row_vars.push_back(row);
+				
+				sub->entries.push_back({offset, &sub->A_ri, ri.first->second, local[col]});
+			}
+		}
+	
+	// Schur complements couple every row_var to every col_var
+	for(Subcircuit *sub:condensed)
+		for(size_t col:sub->col_vars)
+			for(size_t row:sub->row_vars)
+				triplets.emplace_back(cond_index[row], cond_index[col], 0.0);
+	
+	cond_mat.resize(n_cond, n_cond);
+	cond_mat.setFromTriplets(triplets.begin(), triplets.end());
+	cond_mat.makeCompressed();
+	
+	auto cond_offset = [&](size_t row, size_t col) {
+		return (size_t)(&cond_mat.coeffRef(cond_index[row], cond_index[col]) - cond_mat.valuePtr());
+	};
+	
+	cond_slots.assign(eval_mat.nonZeros(), -1);
+	for(Eigen::Index col = 0; col < eval_mat.outerSize(); col++)
+		for(Eigen::SparseMatrix<double>::InnerIterator it(eval_mat, col); it; ++it)
+			if(owner[it.row()] < 0 && owner[col] < 0)
+				cond_slots[&it.valueRef() - eval_mat.valuePtr()] = cond_offset(it.row(), col);
+	
+	// Column-major, like the schur matrix
+	for(Subcircuit *sub:condensed)
+		for(size_t col:sub->col_vars)
+			for(size_t row:sub->row_vars)
+				sub->schur_slots.push_back(cond_offset(row, col));
+}
+
+void Circuit::condense() {
+	// Every subcircuit only touches its own blocks
+	thread_pool().parallel_for(condensed.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t ind = begin; ind < end; ind++)
+			condensed[ind]->condense(eval_mat.valuePtr());
+	});
+	
+	// Rest of the circuit, minus what the internal variables pass between boundary variables
+	double *values = cond_mat.valuePtr();
+	std::fill(values, values + cond_mat.nonZeros(), 0.0);
+	
+	for(size_t offset = 0; offset < cond_slots.size(); offset++)
+		if(cond_slots[offset] >= 0)
+			values[cond_slots[offset]] += eval_mat.valuePtr()[offset];
+	
+	for(Subcircuit *sub:condensed)
+		for(size_t ind = 0; ind < sub->schur_slots.size(); ind++)
+			values[sub->schur_slots[ind]] -= sub->schur.data()[ind];
+}
+
+Eigen::MatrixXd Circuit::solve_factorized(const Eigen::MatrixXd &rhs, bool transposed) {
+	auto solve = [&](const Eigen::MatrixXd &b) {
+		Eigen::MatrixXd x;
+		if(dense_factorized) {
+			if(transposed)
+				x = dense_lu.transpose().solve(b);
+			else
+				x = dense_lu.solve(b);
+			return x;
+		}
+		
+		if(transposed)
+			x = mat_solver->transpose().solve(b);
+		else
+			x = mat_solver->solve(b);
+		
+		if(mat_solver->info() != Eigen::Success)
+			throw std::runtime_error("SparseLU solve: " + mat_solver->lastErrorMessage());
+		
+		return x;
+	};
+	
+	if(condensed.empty())
+		return solve(rhs);
+	
+	auto gather = [](const Eigen::MatrixXd &m, const std::vector<size_t> &vars) {
+		Eigen::MatrixXd out(vars.size(), m.cols());
+		for(size_t ind = 0; ind < vars.size(); ind++)
+			out.row(ind) = m.row(vars[ind]);
+		return out;
+	};
+	
+	Eigen::MatrixXd cond_rhs(cond_mat.rows(), rhs.cols());
+	for(size_t var = 0; var < n_vars; var++)
+		if(cond_index[var] >= 0)
+			cond_rhs.row(cond_index[var]) = rhs.row(var);
+	
+	// Move the internal right-hand sides to the boundary
+	std::vector<Eigen::MatrixXd> int_y(condensed.size());
+	for(size_t sub_ind = 0; sub_ind < condensed.size(); sub_ind++) {
+		Subcircuit *sub = condensed[sub_ind];
+		const std::vector<size_t> &vars = transposed ? sub->col_vars : sub->row_vars;
+		const Eigen::MatrixXd contrib = sub->eliminate(gather(rhs, sub->int_vars), transposed, int_y[sub_ind]);
+		
+		for(size_t ind = 0; ind < vars.size(); ind++)
+			cond_rhs.row(cond_index[vars[ind]]) -= contrib.row(ind);
+	}
+	
+	const Eigen::MatrixXd cond_x = solve(cond_rhs);
+	
+	Eigen::MatrixXd x(n_vars, rhs.cols());
+	for(size_t var = 0; var < n_vars; var++)
+		if(cond_index[var] >= 0)
+			x.row(var) = cond_x.row(cond_index[var]);
+	
+	// Internal variables from the boundary solution
+	for(size_t sub_ind = 0; sub_ind < condensed.size(); sub_ind++) {
+		Subcircuit *sub = condensed[sub_ind];
+		const std::vector<size_t> &vars = transposed ? sub->row_vars : sub->col_vars;
+		const Eigen::MatrixXd int_x = sub->recover(int_y[sub_ind], gather(x, vars), transposed);
+		
+		for(size_t ind = 0; ind < sub->int_vars.size(); ind++)
+			x.row(sub->int_vars[ind]) = int_x.row(ind);
+	}
+	
+	return x;
+}
+
+void Circuit::gen_cells() {
+	cell_variants.clear();
+	n_cell_states = 0;
+	
+	std::map<std::pair<const SubcircuitDef*, std::vector<std::pair<TwoTerminalComponent*, double>>>, size_t> variant_index;
+	
+	for(auto &inst:instances) {
+		SubcircuitDef *def = inst->def;
+		
+		auto vi = variant_index.emplace(std::make_pair(def, inst->overrides), cell_variants.size());
+		if(vi.second) {
+			CellVariant *v = new CellVariant;
+			cell_variants.emplace_back(v);
+			v->def = def;
+			v->overrides = inst->overrides;
+			
+			// Stamp templates for the present analysis, shared by all instances of the variant
+			CloneMap map;
+			v->cell = def->cell.clone(&map);
+			for(auto &o:v->overrides)
+				map.component(o.first)->value = o.second;
+			
+			Circuit &cell = *v->cell;
+			cell.simulation_mode = simulation_mode;
+			cell.gen_matrix();
+			
+			if(cell.nonlinear_comps.size() || cell.behavioral_comps.size())
+				throw std::logic_error("Subcircuit definitions can't have nonlinear or behavioral components");
+			
+			std::vector<bool> is_port(cell.n_vars, false);
+			for(const Node *port:def->ports) {
+				v->port_vars.push_back(cell.node_index(map.node(port)));
+				is_port[v->port_vars.back()] = true;
+			}
+			
+			for(size_t var = 0; var < cell.n_vars; var++)
+				if(!is_port[var])
+					v->int_vars.push_back(var);
+		}
+		
+		inst->variant = vi.first->second;
+		inst->state_offset = n_cell_states;
+		n_cell_states += cell_variants[inst->variant]->cell->system.dimension;
+	}
+}
+
+void Circuit::gen_instance_slots() {
+	for(auto &inst:instances) {
+		inst->slots.clear();
+		for(const Node *row:inst->ports)
+			for(const Node *col:inst->ports)
+				inst->slots.push_back(row->fixed ? -1 : &eval_mat.coeffRef(node_index(row), node_index(col)) - eval_mat.valuePtr());
+	}
+}
+
+void Circuit::update_cell(CellVariant &v) {
+	Circuit &cell = *v.cell;
+	const size_t n_ports = v.port_vars.size();
+	const size_t n_int = v.int_vars.size();
+	const size_t n_states = cell.system.dimension;
+	
+	// Evaluate the cell with the circuit's step size,
+	// and with zero states so the right-hand side is its constant part
+	cell.step_size = step_size;
+	std::fill(cell.deq_state.begin(), cell.deq_state.end(), 0.0);
+	
+	for(const MatrixEntry &entry:cell.mat_entries)
+		*entry.value = entry.expr->eval();
+	for(size_t row = 0; row < cell.n_vars; row++)
+		cell.eval_vec[row] = cell.expr_vec[row].eval();
+	
+	std::vector<double> values(cell.eval_mat.valuePtr(), cell.eval_mat.valuePtr() + cell.eval_mat.nonZeros());
+	values.insert(values.end(), cell.eval_vec.data(), cell.eval_vec.data() + cell.n_vars);
+	values.push_back(step_size);
+	
+	if(values != v.values) {
+		v.values = values;
+		
+		// Split into port and internal variables
+		std::vector<ssize_t> port_pos(cell.n_vars, -1), int_pos(cell.n_vars, -1);
+		for(size_t ind = 0; ind < n_ports; ind++)
+			port_pos[v.port_vars[ind]] = ind;
+		for(size_t ind = 0; ind < n_int; ind++)
+			int_pos[v.int_vars[ind]] = ind;
+		
+		std::vector<Eigen::Triplet<double>> ii_trip;
+		Eigen::MatrixXd A_pp = Eigen::MatrixXd::Zero(n_ports, n_ports);
+		Eigen::MatrixXd A_pi = Eigen::MatrixXd::Zero(n_ports, n_int);
+		Eigen::MatrixXd A_ip = Eigen::MatrixXd::Zero(n_int, n_ports);
+		
+		for(Eigen::Index col = 0; col < cell.eval_mat.outerSize(); col++)
+			for(Eigen::SparseMatrix<double>::InnerIterator it(cell.eval_mat, col); it; ++it) {
+				const ssize_t rp = port_pos[it.row()], cp = port_pos[col];
+				if(rp >= 0 && cp >= 0)
+					A_pp(rp, cp) += it.value();
+				else if(rp >= 0)
+					A_pi(rp, int_pos[col]) += it.value();
+				else if(cp >= 0)
+					A_ip(int_pos[it.row()], cp) += it.value();
+				else
+					ii_trip.emplace_back(int_pos[it.row()], int_pos[col], it.value());
+			}
+		
+		Eigen::SparseMatrix<double> A_ii(n_int, n_int);
+		A_ii.setFromTriplets(ii_trip.begin(), ii_trip.end());
+		
+		Eigen::SparseLU<Eigen::SparseMatrix<double>> solver(A_ii);
+		if(solver.info() != Eigen::Success)
+			throw std::runtime_error("Subcircuit definition SparseLU factorize: " + solver.lastErrorMessage());
+		
+		// Right-hand side: constant part and dependence on the states
+		std::vector<double> p_grad;
+		Eigen::MatrixXd rhs = Eigen::MatrixXd::Zero(cell.n_vars, 1 + n_states);
+		rhs.col(0) = cell.eval_vec;
+		
+		for(size_t row = 0; row < cell.n_vars; row++) {
+			std::vector<double> s_grad(n_states, 0.0);
+			cell.accumulate_derivatives(cell.expr_vec[row], 1.0, nullptr, s_grad, p_grad, {});
+			for(size_t s = 0; s < n_states; s++)
+				rhs(row, 1 + s) = s_grad[s];
+		}
+		
+		Eigen::MatrixXd rhs_p(n_ports, 1 + n_states), rhs_i(n_int, 1 + n_states);
+		for(size_t ind = 0; ind < n_ports; ind++)
+			rhs_p.row(ind) = rhs.row(v.port_vars[ind]);
+		for(size_t ind = 0; ind < n_int; ind++)
+			rhs_i.row(ind) = rhs.row(v.int_vars[ind]);
+		
+		// Internal variables: x_i = A_ii^-1 (b_i - A_ip v_p)
+		const Eigen::MatrixXd x_b = solver.solve(rhs_i);
+		v.X0 = x_b.col(0);
+		v.Xs = x_b.rightCols(n_states);
+		v.Xp = solver.solve(A_ip);
+		
+		// Port rows with the internal variables eliminated
+		v.Y = A_pp - A_pi*v.Xp;
+		const Eigen::MatrixXd j = rhs_p - A_pi*x_b;
+		v.J0 = j.col(0);
+		v.Js = j.rightCols(n_states);
+		
+		// State derivatives are linear in the cell's variables and states
+		cell.solved_vec.setZero();
+		v.D0.resize(n_states);
+		v.Ds.resize(n_states, n_states);
+		v.Dp.resize(n_states, n_ports);
+		
+		for(size_t ind = 0; ind < n_states; ind++) {
+			Eigen::VectorXd x_grad = Eigen::VectorXd::Zero(cell.n_vars);
+			std::vector<double> s_grad(n_states, 0.0);
+			cell.accumulate_derivatives(cell.dydt_exprs[ind], 1.0, &x_grad, s_grad, p_grad, {});
+			
+			Eigen::RowVectorXd grad_p(n_ports), grad_i(n_int);
+			for(size_t p = 0; p < n_ports; p++)
+				grad_p[p] = x_grad[v.port_vars[p]];
+			for(size_t i = 0; i < n_int; i++)
+				grad_i[i] = x_grad[v.int_vars[i]];
+			
+			v.D0[ind] = cell.dydt_exprs[ind].eval() + grad_i*v.X0;
+			v.Ds.row(ind) = Eigen::Map<const Eigen::RowVectorXd>(s_grad.data(), n_states) + grad_i*v.Xs;
+			v.Dp.row(ind) = grad_p - grad_i*v.Xp;
+		}
+	}
+}
+
+void Circuit::stamp_cells() {
+	for(auto &v:cell_variants)
+		update_cell(*v);
+	
+	double *values = eval_mat.valuePtr();
+	
+	for(auto &inst:instances) {
+		const CellVariant &v = *cell_variants[inst->variant];
+		const size_t n_ports = inst->ports.size();
+		
+		const Eigen::Map<const Eigen::VectorXd> s(deq_state.data() + inst->state_offset, v.Js.cols());
+		const Eigen::VectorXd j = v.J0 + v.Js*s;
+		
+		for(size_t row = 0; row < n_ports; row++) {
+			if(inst->ports[row]->fixed)
+				continue;
+			
+			eval_vec[node_index(inst->ports[row])] += j[row];
+			for(size_t col = 0; col < n_ports; col++)
+				values[inst->slots[row*n_ports + col]] += v.Y(row, col);
+		}
+	}
+}
+
+Eigen::VectorXd Circuit::cell_solution(const SubcircuitInstance *inst) const {
+	const CellVariant &v = *cell_variants.at(inst->variant);
+	const size_t n_ports = inst->ports.size();
+	
+	Eigen::VectorXd v_p(n_ports);
+	for(size_t ind = 0; ind < n_ports; ind++)
+		v_p[ind] = inst->ports[ind]->voltage();
+	
+	const Eigen::Map<const Eigen::VectorXd> s(deq_state.data() + inst->state_offset, v.Xs.cols());
+	const Eigen::VectorXd x_i = v.X0 + v.Xs*s - v.Xp*v_p;
+	
+	Eigen::VectorXd x(v.port_vars.size() + v.int_vars.size());
+	for(size_t ind = 0; ind < n_ports; ind++)
+		x[v.port_vars[ind]] = v_p[ind];
+	for(size_t ind = 0; ind < v.int_vars.size(); ind++)
+		x[v.int_vars[ind]] = x_i[ind];
+	
+	return x;
+}
+
+double Circuit::cell_voltage(const SubcircuitInstance *inst, const Node *cell_node) const {
+	if(gen_matrix_pend)
+		throw std::logic_error("Circuit matrix hasn't been generated");
+	
+	// The variant's cell has its nodes in the same order as the definition's
+	const Circuit &def_cell = inst->def->cell;
+	const Circuit &cell = *cell_variants.at(inst->variant)->cell;
+	
+	ssize_t var = -1;
+	for(size_t ind = 0; ind < def_cell.nodes.size(); ind++)
+		if(def_cell.nodes[ind].get() == cell_node)
+			var = cell.node_index(cell.nodes[ind].get());
+	
+	if(var < 0)
+		throw std::invalid_argument("Node not in the subcircuit definition");
+	
+	return cell_solution(inst)[var];
+}
+
+void Circuit::cell_initial_conds(SubcircuitInstance *inst) {
+	Circuit &cell = *cell_variants.at(inst->variant)->cell;
+	
+	// Copy into the existing storage, which the cell's expressions reference
+	const Eigen::VectorXd x = cell_solution(inst);
+	cell.solved_vec = x;
+	
+	inst->ic_values.clear();
+	cell.for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+		if(!ic->initial_cond_specified)
+			ic->gen_initial_cond();
+		inst->ic_values.push_back(ic->initial_cond);
+	});
+}
+
+void Circuit::cell_derivatives(double dydt[]) const {
+	for(auto &inst:instances) {
+		const CellVariant &v = *cell_variants[inst->variant];
+		const size_t n_ports = inst->ports.size();
+		
+		Eigen::VectorXd v_p(n_ports);
+		for(size_t ind = 0; ind < n_ports; ind++)
+			v_p[ind] = inst->ports[ind]->voltage();
+		
+		const Eigen::Map<const Eigen::VectorXd> s(deq_state.data() + inst->state_offset, v.Ds.cols());
+		Eigen::Map<Eigen::VectorXd>(dydt + inst->state_offset, v.Ds.rows()) = v.D0 + v.Ds*s + v.Dp*v_p;
+	}
+}
+
+ThreadPool &Circuit::thread_pool() {
+	const unsigned int n = n_threads ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+	
+	if(!pool || pool->size() != n)
+		pool.reset(new ThreadPool(n));
+	
+	return *pool;
+}
+
+void Circuit::alloc_driver() {
+	// Stepped by a CircuitGroup
+	if(external_stepping) {
+		if(driver)
+			gsl_odeiv2_driver_free(driver);
+		driver = nullptr;
+	}
+	
+	// Re-use the driver if it's for the same system, restarting its step history
+	else if(driver && driver->s->dimension == system.dimension && driver->s->type == stepper_type)
+		gsl_odeiv2_driver_reset(driver);
+	
+	// Allocate diff EQ driver
+	else {
+		if(driver)
+			gsl_odeiv2_driver_free(driver);
+		driver = gsl_odeiv2_driver_alloc_y_new(&system, stepper_type, max_ts, max_e_abs, max_e_rel);
+		if(!driver)
+			throw std::runtime_error("GSL driver allocation failed");
+	}
+	
+	if(driver) {
+		gsl_odeiv2_driver_set_hmin(driver, min_ts);
+		gsl_odeiv2_driver_set_hmax(driver, max_ts);
+	}
+	
+	_dt = &step_size;
+	*_dt = next_step;
+	
+	stiffness_window_accepted = 0;
+	stiffness_window_rejected = 0;
+}
+
+const gsl_odeiv2_step_type *Circuit::current_stepper() const {
+	return stepper_type;
+}
+
+bool Circuit::stepper_is_implicit(const gsl_odeiv2_step_type *type) {
+	return type == gsl_odeiv2_step_rk1imp ||
+	       type == gsl_odeiv2_step_rk2imp ||
+	       type == gsl_odeiv2_step_rk4imp ||
+	       type == gsl_odeiv2_step_bsimp  ||
+	       type == gsl_odeiv2_step_msbdf;
+}
+
+double Circuit::estimate_spectral_radius() {
+	const size_t dim = system.dimension;
+	std::vector<double> f0(dim), f1(dim), y1(dim), v(dim);
+	
+	system_function(t, deq_state.data(), f0.data(), this);
+	
+	// Start from a vector with alternating signs so it isn't orthogonal to typical eigenvectors
+	for(size_t ind = 0; ind < dim; ind++)
+		v[ind] = (ind % 2) ? -1.0 : 1.0;
+	
+	double y_norm = 0;
+	for(double y:deq_state)
+		y_norm = std::max(y_norm, std::abs(y));
+	
+	double rho = 0;
+	
+	for(int iter = 0; iter < 10; iter++) {
+		double v_norm = 0;
+		for(double x:v)
+			v_norm = std::max(v_norm, std::abs(x));
+		if(v_norm == 0)
+			break;
+		
+		// J*v ~= (f(y + delta*v) - f(y))/delta
+		const double delta = std::sqrt(std::numeric_limits<double>::epsilon())*std::max(y_norm, max_e_abs/max_e_rel)/v_norm;
+		for(size_t ind = 0; ind < dim; ind++)
+			y1[ind] = deq_state[ind] + delta*v[ind];
+		
+		system_function(t, y1.data(), f1.data(), this);
+		
+		double jv_norm = 0;
+		for(size_t ind = 0; ind < dim; ind++) {
+			v[ind] = (f1[ind] - f0[ind])/delta;
+			jv_norm = std::max(jv_norm, std::abs(v[ind]));
+		}
+		
+		const double new_rho = jv_norm/v_norm;
+		const bool converged = std::abs(new_rho - rho) < 0.05*new_rho;
+		rho = new_rho;
+		if(converged)
+			break;
+	}
+	
+	// Leave the circuit solved at the unperturbed state
+	system_function(t, deq_state.data(), f0.data(), this);
+	
+	return rho;
+}
+
+void Circuit::check_stiffness(double h) {
+	const unsigned long window = stiffness_window_accepted + stiffness_window_rejected;
+	if(window < stiffness_check_interval)
+		return;
+	
+	const double reject_ratio = (double)stiffness_window_rejected/window;
+	stiffness_window_accepted = 0;
+	stiffness_window_rejected = 0;
+	
+	// Approximate stability limit of h*|lambda| for explicit Runge-Kutta methods
+	const double explicit_stability_limit = 3.0;
+	
+	const double h_rho = h*estimate_spectral_radius();
+	const gsl_odeiv2_step_type *new_stepper = stepper_type;
+	
+	// Explicit stepper is held near its stability boundary and is rejecting steps;
+	// step size is limited by stability rather than accuracy
+	if(!stepper_is_implicit(stepper_type)) {
+		if(h_rho > 0.5*explicit_stability_limit && reject_ratio > 0.1)
+			new_stepper = implicit_stepper;
+	}
+	
+	// Implicit stepper is taking steps an explicit method could take stably
+	else if(h_rho < 0.5*explicit_stability_limit && reject_ratio < 0.1)
+		new_stepper = explicit_stepper;
+	
+	if(new_stepper != stepper_type) {
+		stepper_type = new_stepper;
+		alloc_driver();
+	}
+}
+
+void Circuit::eval_matrix() {
+	// Entries only stamped by subcircuit instances aren't overwritten below
+	for(auto &inst:instances)
+		for(ssize_t slot:inst->slots)
+			if(slot >= 0)
+				eval_mat.valuePtr()[slot] = 0;
+	
+	// Evaluate the circuit definition matrix with current parameters
+	// and convert to Eigen form
+	// Every entry is written by exactly one chunk, so this is the same regardless of thread count
+	ThreadPool &pool = thread_pool();
+	
+	pool.parallel_for(mat_entries.size(), parallel_grain, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t ind = begin; ind < end; ind++)
+			*mat_entries[ind].value = mat_entries[ind].expr->eval();
+	});
+	
+	pool.parallel_for(n_vars, parallel_grain, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t row = begin; row < end; row++)
+			eval_vec[row] = expr_vec[row].eval();
+	});
+	
+	stamp_cells();
+}
+
+void Circuit::update_matrix() {
+	eval_matrix();
+	
+	const bool single = mixed_precision && !mixed_precision_stalled;
+	
+	// Matrix is the same as the one already factorized by the solver that will be used
+	// (constant timestep, or a Jacobian kept by modified Newton iteration)
+	if(factorized_single == single && factorized_values.size() == (size_t)eval_mat.nonZeros() &&
+	        std::equal(factorized_values.begin(), factorized_values.end(), eval_mat.valuePtr()))
+		return;
+	
+	// Nothing is factorized until a factorization succeeds
+	factorized_values.clear();
+	
+	if(single) {
+		// Keep track of the matrix norm (largest row sum) for the refinement stopping criterion
+		// eval_mat is column-major, so the row sums are gathered in one pass over the entries
+		Eigen::VectorXd row_sums = Eigen::VectorXd::Zero(eval_mat.rows());
+		for(Eigen::Index col = 0; col < eval_mat.outerSize(); col++)
+			for(Eigen::SparseMatrix<double>::InnerIterator it(eval_mat, col); it; ++it)
+				row_sums[it.row()] += std::abs(it.value());
+		
+		eval_mat_norm = row_sums.size() ? row_sums.maxCoeff() : 0;
+		
+		// The pattern only changes along with the symbolic analysis, so after that only the values are copied
+		if(!mat_solver_f_analyzed || eval_mat_f.nonZeros() != eval_mat.nonZeros()) {
+			eval_mat_f = eval_mat.cast<float>();
+			mat_solver_f->analyzePattern(eval_mat_f);
+			mat_solver_f_analyzed = true;
+		}
+		
+		else
+			std::transform(eval_mat.valuePtr(), eval_mat.valuePtr() + eval_mat.nonZeros(), eval_mat_f.valuePtr(),
+			               [](double value) { return (float)value; });
+		
+		mat_solver_f->factorize(eval_mat_f);
+		
+		// Values out of single-precision range or a singular matrix in single precision
+		if(mat_solver_f->info() == Eigen::Success) {
+			factorized_values.assign(eval_mat.valuePtr(), eval_mat.valuePtr() + eval_mat.nonZeros());
+			factorized_single = true;
+			return;
+		}
+		
+		mixed_precision_stalled = true;
+	}
+	
+	factorize_double();
+	factorized_values.assign(eval_mat.valuePtr(), eval_mat.valuePtr() + eval_mat.nonZeros());
+	factorized_single = false;
+}
+
+void Circuit::factorize_double() {
+	if(condensed.size())
+		condense();
+	
+	const Eigen::SparseMatrix<double> &mat = condensed.size() ? cond_mat : eval_mat;
+	
+	dense_factorized = dense_solver;
+	if(dense_solver) {
+		dense_lu.compute(Eigen::MatrixXd(mat));
+		
+		// Partial pivoting only leaves a zero pivot if the matrix is singular
+		const Eigen::VectorXd pivots = dense_lu.matrixLU().diagonal();
+		if(!pivots.allFinite() || (pivots.array() == 0).any())
+			throw std::runtime_error("Dense LU factorize: matrix is singular");
+		
+		return;
+	}
+	
+	if(!mat_solver_analyzed) {
+		mat_solver->analyzePattern(mat);
+		mat_solver_analyzed = true;
+	}
+	
+	mat_solver->factorize(mat);
+	if(mat_solver->info() != Eigen::Success)
+		throw std::runtime_error("SparseLU factorize: " + mat_solver->lastErrorMessage());
+}
+
+bool Circuit::solve_refined() {
+	// Initial solution from the single-precision factors
+	solved_vec = mat_solver_f->solve(eval_vec.cast<float>()).cast<double>();
+	if(mat_solver_f->info() != Eigen::Success)
+		return false;
+	
+	const double tol = std::numeric_limits<double>::epsilon();
+	const double b_norm = eval_vec.lpNorm<Eigen::Infinity>();
+	double last_r_norm = std::numeric_limits<double>::max();
+	
+	for(unsigned int step = 0; step <= max_refinement_steps; step++) {
+		// Residual in double precision
+		Eigen::VectorXd r = eval_vec - eval_mat*solved_vec;
+		const double r_norm = r.lpNorm<Eigen::Infinity>();
+		
+		// Normwise backward error is as small as a double-precision solve would give
+		if(r_norm <= tol*(eval_mat_norm*solved_vec.lpNorm<Eigen::Infinity>() + b_norm))
+			return true;
+		
+		// Not converging (or out of steps)
+		if(!std::isfinite(r_norm) || r_norm > 0.5*last_r_norm || step == max_refinement_steps)
+			return false;
+		
+		last_r_norm = r_norm;
+		
+		// Scale the residual before rounding to single precision so it doesn't underflow
+		r /= r_norm;
+		solved_vec += r_norm*mat_solver_f->solve(r.cast<float>()).cast<double>();
+	}
+	
+	return false;
+}
+
+void Circuit::topology_changed() {
+	gen_matrix_pend = true;
+	regen_all = true;
+	changed_nodes.clear();
+	other_plan.mode = -1;
+}
+
+void Circuit::connections_changed(std::initializer_list<const Node*> changed) {
+	gen_matrix_pend = true;
+	other_plan.mode = -1;
+	
+	for(const Node *n:changed)
+		if(n)
+			changed_nodes.insert(n);
+}
+
+void Circuit::solve_matrix() {
+	if(nonlinear_comps.empty() && behavioral_comps.empty()) {
+		solve_linear();
+		return;
+	}
+	
+	// Newton-Raphson iteration: linearize every nonlinear and behavioral component around the
+	// present solution and solve the linear circuit until the solution stops moving
+	bool update_jacobian = !modified_newton || !newton_jacobian_valid;
+	double last_dv = std::numeric_limits<double>::max();
+	
+	for(unsigned int iter = 0; iter < max_newton_iterations; iter++) {
+		const bool limited = linearize_nonlinear(update_jacobian);
+		
+		solve_linear();
+		
+		double dv;
+		if(newton_converged(limited, dv))
+			return;
+		
+		// Refresh the Jacobian if a kept one stopped giving fast convergence
+		update_jacobian = !modified_newton || limited || dv > 0.5*last_dv;
+		last_dv = dv;
+	}
+	
+	throw std::runtime_error("Newton iteration did not converge");
+}
+
+bool Circuit::linearize_nonlinear(bool update_jacobian) {
+	std::vector<char> chunk_limited(thread_pool().size(), false);
+	thread_pool().parallel_for(nonlinear_comps.size(), parallel_grain, [&](size_t begin, size_t end, unsigned int chunk) {
+		for(size_t ind = begin; ind < end; ind++)
+			chunk_limited[chunk] |= nonlinear_comps[ind]->linearize(update_jacobian, bypass_tol);
+	});
+	
+	for(BehavioralComponent *bc:behavioral_comps)
+		bc->linearize(update_jacobian);
+	
+	newton_jacobian_valid = true;
+	
+	return std::find(chunk_limited.begin(), chunk_limited.end(), true) != chunk_limited.end();
+}
+
+bool Circuit::newton_converged(bool limited, double &dv) const {
+	// Converged when every component's voltage is where its model was linearized
+	// and the linearized current agrees with the device equation
+	bool converged = !limited;
+	dv = 0;
+	for(const NonlinearComponent *nl:nonlinear_comps) {
+		const double v = nl->voltage();
+		const double diff = std::abs(v - nl->v_lin);
+		
+		dv = std::max(dv, diff);
+		if(diff > newton_reltol*std::max(std::abs(v), std::abs(nl->v_lin)) + newton_vntol) {
+			converged = false;
+			continue;
+		}
+		
+		double i, g;
+		nl->eval(v, i, g);
+		const double i_lin = nl->G*v + nl->Ieq;
+		if(std::abs(i - i_lin) > newton_reltol*std::max(std::abs(i), std::abs(i_lin)) + newton_abstol)
+			converged = false;
+	}
+	
+	for(const BehavioralComponent *bc:behavioral_comps) {
+		for(size_t ind = 1; ind < bc->x_lin.size(); ind++)
+			dv = std::max(dv, std::abs(bc->controls[ind - 1]->voltage() - bc->x_lin[ind]));
+		
+		if(converged && !bc->converged(newton_reltol, newton_vntol, newton_abstol))
+			converged = false;
+	}
+	
+	return converged;
+}
+
+void Circuit::relinearize() {
+	if(nonlinear_comps.empty() && behavioral_comps.empty())
+		return;
+	
+	for(NonlinearComponent *nl:nonlinear_comps)
+		nl->linearize(true, 0);
+	
+	for(BehavioralComponent *bc:behavioral_comps)
+		bc->linearize(true);
+	
+	solve_linear();
+}
+
+void Circuit::solve_linear() {
+	// Recompute values in the matrix
+	update_matrix();
+	
+	// Solve the circuit matrix to get all node voltages
+	if(mixed_precision && !mixed_precision_stalled) {
+		if(solve_refined())
+			return;
+		
+		// Refinement stalled; use double precision from now on
+		mixed_precision_stalled = true;
+		factorize_double();
+		factorized_single = false;
+	}
+	
+	solved_vec = solve_factorized(eval_vec);
+}
+
+void Circuit::compute_dc_solution() {
+	if(gen_matrix_pend)
+		gen_matrix();
+	
+	apply_modulators();
+	
+	solve_matrix();
+	
+	auto_timestep_bounds();
+	
+	// Update initial conditions for all IntegratingComponents that don't have it specified already
+	for_component_type<IntegratingComponent>([](IntegratingComponent *ic) {
+		if(!ic->initial_cond_specified)
+			ic->gen_initial_cond();
+	});
+	
+	for(auto &inst:instances)
+		cell_initial_conds(inst.get());
+	
+	save_states();
+}
+
+void Circuit::ACSystem::fill(double omega, ACMatrix &mat, std::vector<std::complex<double>> &models) const {
+	models.resize(ttcs.size());
+	for(size_t ind = 0; ind < ttcs.size(); ind++)
+		models[ind] = branch[ind] < 0 ? ttcs[ind]->ac_admittance(omega) : ttcs[ind]->ac_impedance(omega);
+	
+	std::fill(mat.valuePtr(), mat.valuePtr() + mat.nonZeros(), 0.0);
+	for(const ACStamp &st:stamps)
+		mat.valuePtr()[st.slot] += st.sign*(st.comp < 0 ? 1.0 : models[st.comp]);
+}
+
+Circuit::ACSystem Circuit::gen_ac_system() {
+	if(instances.size())
+		throw std::logic_error("AC analysis doesn't support subcircuit instances");
+	
+	// Operating point for nonlinear components
+	if(simulation_mode == DC_ANALYSIS) {
+		if(gen_matrix_pend)
+			gen_matrix();
+		
+		apply_modulators();
+		solve_matrix();
+	}
+	
+	if(tlines.size())
+		throw std::logic_error("AC analysis doesn't support transmission lines");
+	
+	if(behavioral_comps.size())
+		throw std::logic_error("AC analysis doesn't support behavioral sources");
+	
+	ACSystem sys;
+	
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(!ttc->fully_connected())
+			throw std::runtime_error("Components not fully connected");
+		sys.ttcs.push_back(ttc);
+	});
+	
+	const std::vector<TwoTerminalComponent*> &ttcs = sys.ttcs;
+	
+	// Voltage-defined components get a current variable after the node voltages
+	const size_t n_nodes = nodes.size();
+	sys.n_vars = n_nodes;
+	sys.branch.assign(ttcs.size(), -1);
+	sys.sources.resize(ttcs.size());
+	
+	for(size_t ind = 0; ind < ttcs.size(); ind++) {
+		sys.sources[ind] = ttcs[ind]->ac_source();
+		
+		if(ttcs[ind]->ac_voltage_defined())
+			sys.branch[ind] = sys.n_vars++;
+	}
+	
+	std::vector<ACStamp> &stamps = sys.stamps;
+	sys.rhs = Eigen::VectorXcd::Zero(sys.n_vars);
+	
+	// Fixed nodes don't move in AC
+	for(size_t node_ind = 0; node_ind < n_nodes; node_ind++)
+		if(nodes[node_ind]->fixed)
+			stamps.push_back({node_ind, node_ind, -1, 1, 0});
+	
+	for(size_t ind = 0; ind < ttcs.size(); ind++) {
+		const size_t top = node_index(ttcs[ind]->node_top);
+		const size_t bot = node_index(ttcs[ind]->node_bot);
+		const bool top_free = !ttcs[ind]->node_top->fixed;
+		const bool bot_free = !ttcs[ind]->node_bot->fixed;
+		
+		// KCL rows sum currents leaving the node
+		// I = Y*(Vtop - Vbottom) + source
+		if(sys.branch[ind] < 0) {
+			if(top_free) {
+				stamps.push_back({top, top, (ssize_t)ind,  1, 0});
+				stamps.push_back({top, bot, (ssize_t)ind, -1, 0});
+				sys.rhs[top] -= sys.sources[ind];
+			}
+			
+			if(bot_free) {
+				stamps.push_back({bot, top, (ssize_t)ind, -1, 0});
+				stamps.push_back({bot, bot, (ssize_t)ind,  1, 0});
+				sys.rhs[bot] += sys.sources[ind];
+			}
+		}
+		
+		// Vtop - Vbottom - Z*I = source
+		else {
+			const size_t k = sys.branch[ind];
+			
+			if(top_free)
+				stamps.push_back({top, k, -1,  1, 0});
+			if(bot_free)
+				stamps.push_back({bot, k, -1, -1, 0});
+			
+			stamps.push_back({k, top, -1,  1, 0});
+			stamps.push_back({k, bot, -1, -1, 0});
+			stamps.push_back({k, k, (ssize_t)ind, -1, 0});
+			sys.rhs[k] = sys.sources[ind];
+		}
+	}
+	
+	std::vector<Eigen::Triplet<std::complex<double>>> triplets;
+	for(const ACStamp &st:stamps)
+		triplets.emplace_back(st.row, st.col, 1.0);
+	
+	ACMatrix pattern(sys.n_vars, sys.n_vars);
+	pattern.setFromTriplets(triplets.begin(), triplets.end());
+	pattern.makeCompressed();
+	
+	// The pattern is the same at every frequency, so the fill-reducing column ordering is computed once
+	// and the matrix is stored already permuted; per-thread solvers only need the natural ordering
+	CachedOrdering<int> ordering;
+	ordering(pattern, sys.perm);
+	
+	triplets.clear();
+	for(const ACStamp &st:stamps)
+		triplets.emplace_back(st.row, sys.perm.indices()(st.col), 1.0);
+	
+	sys.permuted.resize(sys.n_vars, sys.n_vars);
+	sys.permuted.setFromTriplets(triplets.begin(), triplets.end());
+	sys.permuted.makeCompressed();
+	
+	for(ACStamp &st:stamps)
+		st.slot = &sys.permuted.coeffRef(st.row, sys.perm.indices()(st.col)) - sys.permuted.valuePtr();
+	
+	return sys;
+}
+
+ACResult Circuit::ac_analysis(const std::vector<double> &freqs) {
+	const ACSystem sys = gen_ac_system();
+	const std::vector<TwoTerminalComponent*> &ttcs = sys.ttcs;
+	const auto &perm = sys.perm.indices();
+	
+	ACResult result;
+	result._freqs = freqs;
+	
+	const size_t n_nodes = nodes.size();
+	for(size_t ind = 0; ind < n_nodes; ind++)
+		result.node_map[nodes[ind].get()] = ind;
+	for(size_t ind = 0; ind < ttcs.size(); ind++)
+		result.comp_map[ttcs[ind]] = ind;
+	
+	result.node_v.resize(freqs.size());
+	result.comp_i.resize(freqs.size());
+	
+	thread_pool().parallel_for(freqs.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		ACMatrix mat = sys.permuted;
+		Eigen::SparseLU<ACMatrix, Eigen::NaturalOrdering<int>> solver;
+		solver.analyzePattern(mat);
+		
+		std::vector<std::complex<double>> models;
+		
+		for(size_t freq_ind = begin; freq_ind < end; freq_ind++) {
+			sys.fill(2*M_PI*freqs[freq_ind], mat, models);
+			
+			solver.factorize(mat);
+			if(solver.info() != Eigen::Success)
+				throw std::runtime_error("SparseLU factorize: " + solver.lastErrorMessage());
+			
+			const Eigen::VectorXcd y = solver.solve(sys.rhs);
+			
+			// Undo the column ordering
+			auto &node_v = result.node_v[freq_ind];
+			node_v.resize(n_nodes);
+			for(size_t node_ind = 0; node_ind < n_nodes; node_ind++)
+				node_v[node_ind] = y[perm(node_ind)];
+			
+			auto &comp_i = result.comp_i[freq_ind];
+			comp_i.resize(ttcs.size());
+			for(size_t ind = 0; ind < ttcs.size(); ind++) {
+				if(sys.branch[ind] >= 0)
+					comp_i[ind] = y[perm(sys.branch[ind])];
+				else
+					comp_i[ind] = models[ind]*(node_v[node_index(ttcs[ind]->node_top)] - node_v[node_index(ttcs[ind]->node_bot)]) + sys.sources[ind];
+			}
+		}
+	});
+	
+	return result;
+}
+
+std::vector<size_t> Circuit::port_indices(const std::vector<Node*> &ports) const {
+	if(gen_matrix_pend)
+		throw std::logic_error("Port indices need the circuit matrix generated first");
+	
+	std::vector<size_t> indices;
+	
+	for(const Node *port:ports) {
+		const ssize_t ind = node_index(port);
+		if(ind < 0)
+			throw std::invalid_argument("Port node not in the circuit matrix");
+		if(port->fixed)
+			throw std::invalid_argument("Port node has a fixed voltage");
+		
+		indices.push_back(ind);
+	}
+	
+	return indices;
+}
+
+Eigen::MatrixXd Circuit::dc_impedance(const std::vector<Node*> &ports) {
+	if(simulation_mode != DC_ANALYSIS)
+		throw std::logic_error("DC impedance requires the circuit to be in DC analysis (call reset() first)");
+	
+	if(gen_matrix_pend)
+		gen_matrix();
+	
+	const std::vector<size_t> port_ind = port_indices(ports);
+	
+	// Linearize exactly around the operating point
+	apply_modulators();
+	solve_matrix();
+	relinearize();
+	
+	if(mixed_precision && !mixed_precision_stalled)
+		factorize_double();
+	
+	// 1A into each port (KCL rows sum currents entering the node, so it goes on the right-hand side negated)
+	Eigen::MatrixXd excitation = Eigen::MatrixXd::Zero(n_vars, ports.size());
+	for(size_t port = 0; port < ports.size(); port++)
+		excitation(port_ind[port], port) = -1;
+	
+	const Eigen::MatrixXd response = solve_factorized(excitation);
+	
+	Eigen::MatrixXd z(ports.size(), ports.size());
+	for(size_t port = 0; port < ports.size(); port++)
+		z.row(port) = response.row(port_ind[port]);
+	
+	return z;
+}
+
+std::vector<Eigen::MatrixXcd> Circuit::ac_impedance(const std::vector<Node*> &ports, const std::vector<double> &freqs) {
+	const ACSystem sys = gen_ac_system();
+	const std::vector<size_t> port_ind = port_indices(ports);
+	const auto &perm = sys.perm.indices();
+	
+	// 1A into each port (AC KCL rows sum currents leaving the node)
+	Eigen::MatrixXcd excitation = Eigen::MatrixXcd::Zero(sys.n_vars, ports.size());
+	for(size_t port = 0; port < ports.size(); port++)
+		excitation(port_ind[port], port) = 1;
+	
+	std::vector<Eigen::MatrixXcd> result(freqs.size());
+	
+	thread_pool().parallel_for(freqs.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		ACMatrix mat = sys.permuted;
+		Eigen::SparseLU<ACMatrix, Eigen::NaturalOrdering<int>> solver;
+		solver.analyzePattern(mat);
+		
+		std::vector<std::complex<double>> models;
+		
+		for(size_t freq_ind = begin; freq_ind < end; freq_ind++) {
+			sys.fill(2*M_PI*freqs[freq_ind], mat, models);
+			
+			solver.factorize(mat);
+			if(solver.info() != Eigen::Success)
+				throw std::runtime_error("SparseLU factorize: " + solver.lastErrorMessage());
+			
+			// Every port in one blocked solve against the factorization
+			const Eigen::MatrixXcd y = solver.solve(excitation);
+			
+			Eigen::MatrixXcd &z = result[freq_ind];
+			z.resize(ports.size(), ports.size());
+			for(size_t port = 0; port < ports.size(); port++)
+				z.row(port) = y.row(perm(port_ind[port]));
+		}
+	});
+	
+	return result;
+}
+
+DCSweepResult Circuit::dc_sweep(TwoTerminalComponent *comp, const std::vector<double> &values) {
+	if(comp->mod)
+		throw std::logic_error("Component's value is already controlled by a modulator");
+	
+	if(simulation_mode != DC_ANALYSIS)
+		throw std::logic_error("DC sweep requires the circuit to be in DC analysis (call reset() first)");
+	
+	if(gen_matrix_pend)
+		gen_matrix();
+	
+	apply_modulators();
+	
+	std::vector<TwoTerminalComponent*> ttcs;
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		ttcs.push_back(ttc);
+	});
+	
+	DCSweepResult result;
+	result._values = values;
+	result.node_v.resize(values.size()*nodes.size());
+	result.comp_i.resize(values.size()*ttcs.size());
+	
+	for(size_t ind = 0; ind < nodes.size(); ind++)
+		result.node_map[nodes[ind].get()] = ind;
+	for(size_t ind = 0; ind < ttcs.size(); ind++)
+		result.comp_map[ttcs[ind]] = ind;
+	
+	// The circuit is left at its original value and solution afterwards
+	const double orig_value = comp->value;
+	const Eigen::VectorXd orig_solved = solved_vec;
+	
+	auto restore = [&]() {
+		comp->value = orig_value;
+		solved_vec = orig_solved;
+		newton_jacobian_valid = false;
+	};
+	
+	// Record the present solution as row ind
+	auto record = [&](size_t ind) {
+		for(size_t node_ind = 0; node_ind < nodes.size(); node_ind++)
+			result.node_v[ind*nodes.size() + node_ind] = nodes[node_ind]->voltage();
+		for(size_t comp_ind = 0; comp_ind < ttcs.size(); comp_ind++)
+			result.comp_i[ind*ttcs.size() + comp_ind] = ttcs[comp_ind]->current();
+	};
+	
+	// Check if the swept value shows up in the matrix itself
+	bool in_matrix = false;
+	for(const MatrixEntry &entry:mat_entries)
+		for(const Term &t:*entry.expr)
+			in_matrix |= std::find(t.num.begin(), t.num.end(), &comp->value) != t.num.end() ||
+			             std::find(t.den.begin(), t.den.end(), &comp->value) != t.den.end();
+	
+	try {
+		// Same matrix for every point: factorize once and solve all right-hand sides together
+		if(!in_matrix && nonlinear_comps.empty() && behavioral_comps.empty() && instances.empty() && !mixed_precision && values.size()) {
+			update_matrix();
+			
+			Eigen::MatrixXd rhs(n_vars, values.size());
+			for(size_t ind = 0; ind < values.size(); ind++) {
+				comp->value = values[ind];
+				for(size_t row = 0; row < n_vars; row++)
+					rhs(row, ind) = expr_vec[row].eval();
+			}
+			
+			Eigen::MatrixXd solved(n_vars, values.size());
+			thread_pool().parallel_for(values.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+				solved.middleCols(begin, end - begin) = solve_factorized(rhs.middleCols(begin, end - begin));
+			});
+			
+			for(size_t ind = 0; ind < values.size(); ind++) {
+				comp->value = values[ind];
+				solved_vec = solved.col(ind);
+				record(ind);
+			}
+		}
+		
+		// Matrix changes between points: reuse the symbolic analysis and warm-start
+		// Newton iteration from the previous point
+		else {
+			for(size_t ind = 0; ind < values.size(); ind++) {
+				comp->value = values[ind];
+				solve_matrix();
+				record(ind);
+			}
+		}
+	}
+	catch(...) {
+		restore();
+		throw;
+	}
+	
+	restore();
+	
+	return result;
+}
+
+std::vector<TwoTerminalComponent*> Circuit::sensitivity_params(ParamIndex &param_index) {
+	// Nonlinear and behavioral components' values enter through their device equations
+	// and expressions rather than the circuit's expressions
+	std::vector<TwoTerminalComponent*> params;
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(dynamic_cast<NonlinearComponent*>(ttc) || dynamic_cast<BehavioralComponent*>(ttc))
+			return;
+		
+		param_index[&ttc->value] = params.size();
+		params.push_back(ttc);
+	});
+	
+	return params;
 }
 
-void Circuit::compute_dc_solution() {
+Eigen::VectorXd Circuit::output_weights(const Node *n) const {
+	const ssize_t ind = node_index(n);
+	if(ind < 0)
+		throw std::invalid_argument("Node not in the circuit matrix");
+	
+	Eigen::VectorXd weights = Eigen::VectorXd::Zero(n_vars);
+	weights[ind] = 1;
+	return weights;
+}
+
+Eigen::VectorXd Circuit::output_weights(const TwoTerminalComponent *c) const {
+	if(!c->fully_connected())
+		throw std::invalid_argument("Component not connected");
+	
+	return output_weights(c->node_top) - output_weights(c->node_bot);
+}
+
+void Circuit::accumulate_derivatives(const Expression &expr, double weight, Eigen::VectorXd *x_grad,
+                                     std::vector<double> &s_grad, std::vector<double> &p_grad, const ParamIndex &param_index) const {
+	if(weight == 0)
+		return;
+	
+	std::vector<const double*> refs;
+	
+	for(const Term &t:expr) {
+		refs.assign(t.num.begin(), t.num.end());
+		refs.insert(refs.end(), t.den.begin(), t.den.end());
+		std::sort(refs.begin(), refs.end());
+		refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+		
+		for(const double *ref:refs) {
+			const ptrdiff_t x_ind = ref - solved_vec.data();
+			const ptrdiff_t s_ind = ref - deq_state.data();
+			
+			if(x_ind >= 0 && x_ind < solved_vec.size()) {
+				if(x_grad)
+					(*x_grad)[x_ind] += weight*t.derivative(ref);
+			}
+			
+			else if(s_ind >= 0 && (size_t)s_ind < deq_state.size())
+				s_grad[s_ind] += weight*t.derivative(ref);
+			
+			else {
+				auto pi = param_index.find(ref);
+				if(pi != param_index.end())
+					p_grad[pi->second] += weight*t.derivative(ref);
+			}
+		}
+	}
+}
+
+void Circuit::adjoint_network(const Eigen::VectorXd &x_weights, std::vector<double> &s_grad,
+                              std::vector<double> &p_grad, const ParamIndex &param_index) {
+	// Transposed solve needs the double-precision factors
+	if(mixed_precision && !mixed_precision_stalled)
+		factorize_double();
+	
+	const Eigen::VectorXd w = solve_factorized(x_weights, true);
+	
+	// A x = b  =>  dx/dp = A^-1 (db/dp - dA/dp x)
+	for(size_t row = 0; row < n_vars; row++)
+		accumulate_derivatives(expr_vec[row], w[row], nullptr, s_grad, p_grad, param_index);
+	
+	for(auto &expr:expr_mat)
+		accumulate_derivatives(expr.second, -w[expr.first.row]*solved_vec[expr.first.col], nullptr, s_grad, p_grad, param_index);
+}
+
+void Circuit::solve_at_state(const std::vector<double> &state, double time, double h) {
+	deq_state = state;
+	t = time;
+	if(_dt)
+		*_dt = h;
+	
+	for(auto &m:modulators)
+		if(m->continuous())
+			m->apply();
+	
+	solve_matrix();
+	
+	// Adjoint needs the exact Jacobian rather than one kept by modified Newton iteration
+	relinearize();
+}
+
+void Circuit::adjoint_system(const std::vector<double> &state, double time, double h, const std::vector<double> &mu,
+                             std::vector<double> &jt_mu, std::vector<double> &p_grad, const ParamIndex &param_index) {
+	solve_at_state(state, time, h);
+	
+	// dydt depends on states and parameters directly, and through the node voltages
+	Eigen::VectorXd x_weights = Eigen::VectorXd::Zero(n_vars);
+	for(size_t ind = 0; ind < dydt_exprs.size(); ind++)
+		accumulate_derivatives(dydt_exprs[ind], mu[ind], &x_weights, jt_mu, p_grad, param_index);
+	
+	adjoint_network(x_weights, jt_mu, p_grad, param_index);
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::dc_sensitivity(const Node *output) {
 	if(gen_matrix_pend)
 		gen_matrix();
 	
-	apply_modulators();
+	return dc_sensitivity(output_weights(output));
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::dc_sensitivity(const TwoTerminalComponent *output) {
+	if(gen_matrix_pend)
+		gen_matrix();
+	
+	return dc_sensitivity(output_weights(output));
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::dc_sensitivity(const Eigen::VectorXd &weights) {
+	if(instances.size())
+		throw std::logic_error("Sensitivity analysis doesn't support subcircuit instances");
 	
+	if(simulation_mode != DC_ANALYSIS)
+		throw std::logic_error("DC sensitivity requires the circuit to be in DC analysis (call reset() first)");
+	
+	apply_modulators();
 	solve_matrix();
+	relinearize();
 	
-	// Update initial conditions for all IntegratingComponents that don't have it specified already
-	for_component_type<IntegratingComponent>([](IntegratingComponent *ic) {
-		if(!ic->initial_cond_specified)
-			ic->gen_initial_cond();
+	ParamIndex param_index;
+	std::vector<TwoTerminalComponent*> params = sensitivity_params(param_index);
+	
+	std::vector<double> s_grad(deq_state.size()), p_grad(params.size());
+	adjoint_network(weights, s_grad, p_grad, param_index);
+	
+	std::unordered_map<const TwoTerminalComponent*, double> result;
+	for(size_t ind = 0; ind < params.size(); ind++)
+		result[params[ind]] = p_grad[ind];
+	
+	return result;
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::transient_sensitivity(const Node *output) {
+	if(gen_matrix_pend)
+		throw std::logic_error("Transient sensitivity requires a transient simulation of the present circuit");
+	
+	return transient_sensitivity(output_weights(output));
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::transient_sensitivity(const TwoTerminalComponent *output) {
+	if(gen_matrix_pend)
+		throw std::logic_error("Transient sensitivity requires a transient simulation of the present circuit");
+	
+	return transient_sensitivity(output_weights(output));
+}
+
+std::unordered_map<const TwoTerminalComponent*, double> Circuit::transient_sensitivity(const Eigen::VectorXd &weights) {
+	if(instances.size())
+		throw std::logic_error("Sensitivity analysis doesn't support subcircuit instances");
+	
+	if(tlines.size())
+		throw std::logic_error("Transient sensitivity doesn't support transmission lines");
+	
+	if(simulation_mode != TRANSIENT_ANALYSIS || !record_trajectory || (system.dimension && trajectory.empty()))
+		throw std::logic_error("Transient sensitivity requires a transient simulation run with record_trajectory set");
+	
+	ParamIndex param_index;
+	std::vector<TwoTerminalComponent*> params = sensitivity_params(param_index);
+	
+	const size_t dim = deq_state.size();
+	const double end_t = t;
+	const std::vector<double> end_state = deq_state;
+	const double end_dt = _dt ? *_dt : 0;
+	const std::vector<double> end_held = held_values();
+	
+	std::vector<double> p_grad(params.size(), 0);
+	
+	// Output at the end depends on the final state and on the parameters through the network
+	std::vector<double> mu(dim, 0);
+	solve_at_state(end_state, end_t, trajectory.size() ? trajectory.back().h : 0);
+	adjoint_network(weights, mu, p_grad, param_index);
+	
+	// Integrate the adjoint equation dmu/dt = -J^T mu backward over the recorded steps (Heun's method),
+	// along with the parameter gradient integral of mu^T df/dp (trapezoidal rule)
+	std::vector<double> jt_end(dim), jt_start(dim), q_end(params.size()), q_start(params.size()), mu_pred(dim);
+	
+	for(size_t step = trajectory.size(); step-- > 0;) {
+		const TrajectoryStep &ts = trajectory[step];
+		const std::vector<double> &y_end = step + 1 < trajectory.size() ? trajectory[step + 1].y : end_state;
+		
+		// Discontinuous modulators' values in effect during the step
+		// (continuous ones are applied at each time by solve_at_state)
+		set_held_values(ts.held);
+		
+		std::fill(jt_end.begin(), jt_end.end(), 0);
+		std::fill(q_end.begin(), q_end.end(), 0);
+		adjoint_system(y_end, ts.t + ts.h, ts.h, mu, jt_end, q_end, param_index);
+		
+		for(size_t ind = 0; ind < dim; ind++)
+			mu_pred[ind] = mu[ind] + ts.h*jt_end[ind];
+		
+		std::fill(jt_start.begin(), jt_start.end(), 0);
+		std::fill(q_start.begin(), q_start.end(), 0);
+		adjoint_system(ts.y, ts.t, ts.h, mu_pred, jt_start, q_start, param_index);
+		
+		for(size_t ind = 0; ind < dim; ind++)
+			mu[ind] += 0.5*ts.h*(jt_end[ind] + jt_start[ind]);
+		
+		for(size_t ind = 0; ind < params.size(); ind++)
+			p_grad[ind] += 0.5*ts.h*(q_end[ind] + q_start[ind]);
+	}
+	
+	// Leave the circuit as it was
+	set_held_values(end_held);
+	solve_at_state(end_state, end_t, end_dt);
+	
+	std::unordered_map<const TwoTerminalComponent*, double> result;
+	for(size_t ind = 0; ind < params.size(); ind++)
+		result[params[ind]] = p_grad[ind];
+	
+	return result;
+}
+
+std::vector<double> Circuit::held_values() {
+	std::vector<double> values;
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(ttc->mod && !ttc->mod->continuous())
+			values.push_back(ttc->value);
 	});
 	
-	save_states();
+	return values;
+}
+
+void Circuit::set_held_values(const std::vector<double> &values) {
+	size_t ind = 0;
+	for_component_type<TwoTerminalComponent>([&](TwoTerminalComponent *ttc) {
+		if(ttc->mod && !ttc->mod->continuous() && ind < values.size())
+			ttc->value = values[ind++];
+	});
+}
+
+std::vector<Node*> Circuit::internal_nodes(const std::vector<Node*> &ports, std::function<bool(const TwoTerminalComponent*)> allowed) {
+	std::unordered_set<const Node*> port_set(ports.begin(), ports.end());
+	std::unordered_set<Node*> internal;
+	
+	// Subcircuit instances aren't in node connections but still lead elsewhere
+	std::unordered_set<const Node*> instance_ports;
+	for(auto &inst:instances)
+		instance_ports.insert(inst->ports.begin(), inst->ports.end());
+	
+	for(auto &n:nodes) {
+		if(n->fixed || port_set.count(n.get()) || instance_ports.count(n.get()))
+			continue;
+		
+		bool ok = n->connections.size() > 0;
+		for(auto &ci:n->connections)
+			ok &= ci.first->fully_connected() && allowed(ci.first);
+		
+		if(ok)
+			internal.insert(n.get());
+	}
+	
+	// Nodes leading anywhere other than internal nodes, ports, or ground aren't internal,
+	// which can make their neighbors external too
+	bool changed = true;
+	while(changed) {
+		changed = false;
+		
+		for(auto it = internal.begin(); it != internal.end();) {
+			bool ok = true;
+			for(auto &ci:(*it)->connections) {
+				const Node *other = ci.first->node_top == *it ? ci.first->node_bot : ci.first->node_top;
+				ok &= (other->fixed && other->fixed_voltage == 0) || port_set.count(other) || internal.count((Node*)other);
+			}
+			
+			if(ok)
+				it++;
+			else {
+				it = internal.erase(it);
+				changed = true;
+			}
+		}
+	}
+	
+	// Keep circuit order
+	std::vector<Node*> result;
+	for(auto &n:nodes)
+		if(internal.count(n.get()))
+			result.push_back(n.get());
+	
+	return result;
+}
+
+void Circuit::erase_components(const std::vector<TwoTerminalComponent*> &comps) {
+	std::unordered_set<const Component*> erased(comps.begin(), comps.end());
+	
+	for(TwoTerminalComponent *ttc:comps) {
+		ttc->remove_mod();
+		if(ttc->node_top)
+			ttc->node_top->connections.erase(ttc);
+		if(ttc->node_bot)
+			ttc->node_bot->connections.erase(ttc);
+		
+		connections_changed({ttc->node_top, ttc->node_bot});
+		state_comps.erase(dynamic_cast<const IntegratingComponent*>(ttc));
+	}
+	
+	components.erase(std::remove_if(components.begin(), components.end(), [&](const std::unique_ptr<Component> &c) {
+		return erased.count(c.get()) > 0;
+	}), components.end());
+	
+	for(auto &sub:subcircuits) {
+		std::vector<TwoTerminalComponent*> &sub_comps = sub->comps;
+		sub_comps.erase(std::remove_if(sub_comps.begin(), sub_comps.end(), [&](const TwoTerminalComponent *ttc) {
+			return erased.count(ttc) > 0;
+		}), sub_comps.end());
+	}
+}
+
+void Circuit::remove_comp(TwoTerminalComponent *c) {
+	if(c->parent_circuit != this)
+		throw std::invalid_argument("Component not in the same circuit");
+	
+	erase_components({c});
+}
+
+void Circuit::erase_nodes(const std::vector<Node*> &erased) {
+	std::unordered_set<const Node*> erased_set(erased.begin(), erased.end());
+	
+	for(const Node *n:erased)
+		if(n->connections.size())
+			throw std::logic_error("Node still has components connected");
+	
+	for(auto &inst:instances)
+		for(const Node *n:inst->ports)
+			if(erased_set.count(n))
+				throw std::logic_error("Node still has a subcircuit instance connected");
+	
+	nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [&](const std::unique_ptr<Node> &n) {
+		return erased_set.count(n.get()) > 0;
+	}), nodes.end());
+	
+	topology_changed();
+}
+
+Subcircuit *Circuit::add_subcircuit(const std::vector<TwoTerminalComponent*> &comps) {
+	for(const TwoTerminalComponent *ttc:comps) {
+		if(ttc->parent_circuit != this)
+			throw std::invalid_argument("Component not in the same circuit");
+		if(dynamic_cast<const NonlinearComponent*>(ttc) || dynamic_cast<const BehavioralComponent*>(ttc))
+			throw std::invalid_argument("Nonlinear and behavioral components can't be condensed");
+	}
+	
+	topology_changed();
+	Subcircuit *s = new Subcircuit(this, comps);
+	subcircuits.emplace_back(s);
+	return s;
+}
+
+SubcircuitInstance *Circuit::add_instance(SubcircuitDef *def, const std::vector<Node*> &ports,
+                                          std::vector<std::pair<TwoTerminalComponent*, double>> overrides) {
+	if(ports.size() != def->ports.size())
+		throw std::invalid_argument("Number of nodes doesn't match the subcircuit definition's ports");
+	
+	for(const Node *n:ports)
+		if(n->parent_circuit != this)
+			throw std::invalid_argument("Node not in the same circuit");
+	
+	for(const Node *n:def->ports)
+		if(n->parent_circuit != &def->cell || n->fixed)
+			throw std::invalid_argument("Subcircuit definition ports must be free nodes of its cell");
+	
+	for(auto &o:overrides)
+		if(o.first->parent_circuit != &def->cell)
+			throw std::invalid_argument("Component not in the subcircuit definition");
+	
+	// Same parameters always compare equal
+	std::sort(overrides.begin(), overrides.end());
+	
+	topology_changed();
+	SubcircuitInstance *inst = new SubcircuitInstance(this, def, ports, overrides);
+	instances.emplace_back(inst);
+	return inst;
+}
+
+size_t Circuit::reduce_network(const std::vector<Node*> &ports, size_t order) {
+	if(!order)
+		throw std::invalid_argument("Reduction order must be at least 1");
+	
+	Node *gnd = get_gnd_node();
+	
+	for(Node *port:ports) {
+		if(port->parent_circuit != this)
+			throw std::invalid_argument("Node not in the same circuit");
+		if(port == gnd)
+			throw std::invalid_argument("Ground is the reference, not a port");
+	}
+	
+	// Only plain R/C elements can be absorbed; capacitors with initial conditions and modulated
+	// values keep their nodes external
+	std::vector<Node*> internal = internal_nodes(ports, [](const TwoTerminalComponent *ttc) {
+		if(ttc->mod)
+			return false;
+		
+		const Capacitor *cap = dynamic_cast<const Capacitor*>(ttc);
+		return dynamic_cast<const Resistor*>(ttc) || (cap && !cap->initial_cond_specified);
+	});
+	
+	if(internal.empty())
+		return 0;
+	
+	// Ports first, then internal nodes (ground is eliminated)
+	const size_t n_ports = ports.size();
+	const size_t n_int = internal.size();
+	std::unordered_map<const Node*, size_t> index;
+	for(size_t ind = 0; ind < n_ports; ind++)
+		index[ports[ind]] = ind;
+	for(size_t ind = 0; ind < n_int; ind++)
+		index[internal[ind]] = n_ports + ind;
+	
+	std::vector<TwoTerminalComponent*> reduced;
+	std::unordered_set<const TwoTerminalComponent*> seen;
+	for(Node *n:internal)
+		for(auto &ci:n->connections)
+			if(seen.insert(ci.first).second)
+				reduced.push_back(ci.first);
+	
+	// Nodal conductance and capacitance matrices of the reduced components
+	const size_t n = n_ports + n_int;
+	std::vector<Eigen::Triplet<double>> g_trip, c_trip;
+	
+	for(TwoTerminalComponent *ttc:reduced) {
+		const bool is_cap = dynamic_cast<const Capacitor*>(ttc);
+		const double y = is_cap ? ttc->value : 1/ttc->value;
+		auto &trip = is_cap ? c_trip : g_trip;
+		
+		auto ti = index.find(ttc->node_top), bi = index.find(ttc->node_bot);
+		if(ti != index.end())
+			trip.emplace_back(ti->second, ti->second, y);
+		if(bi != index.end())
+			trip.emplace_back(bi->second, bi->second, y);
+		if(ti != index.end() && bi != index.end()) {
+			trip.emplace_back(ti->second, bi->second, -y);
+			trip.emplace_back(bi->second, ti->second, -y);
+		}
+	}
+	
+	Eigen::SparseMatrix<double> G(n, n), C(n, n);
+	G.setFromTriplets(g_trip.begin(), g_trip.end());
+	C.setFromTriplets(c_trip.begin(), c_trip.end());
+	
+	const Eigen::SparseMatrix<double> G_ii = G.block(n_ports, n_ports, n_int, n_int);
+	const Eigen::SparseMatrix<double> C_ii = C.block(n_ports, n_ports, n_int, n_int);
+	
+	Eigen::SparseLU<Eigen::SparseMatrix<double>> G_ii_solver(G_ii);
+	if(G_ii_solver.info() != Eigen::Success)
+		throw std::runtime_error("Network has internal nodes without a DC path to a port or ground");
+	
+	// Internal voltages for port voltages x_p: x_i = -(G_ii + sC_ii)^-1 (G_ip + sC_ip) x_p
+	// Expanding around s = 0 gives moments spanned by A^k G_ii^-1 [G_ip C_ip] with A = G_ii^-1 C_ii
+	Eigen::MatrixXd block(n_int, 2*n_ports);
+	block << Eigen::MatrixXd(G.block(n_ports, 0, n_int, n_ports)), Eigen::MatrixXd(C.block(n_ports, 0, n_int, n_ports));
+	block = G_ii_solver.solve(block);
+	
+	// Block Arnoldi with modified Gram-Schmidt (twice) and deflation of dependent columns
+	std::vector<Eigen::VectorXd> basis;
+	for(size_t moment = 0; moment < order && block.cols(); moment++) {
+		Eigen::MatrixXd next(n_int, 0);
+		
+		for(Eigen::Index col = 0; col < block.cols(); col++) {
+			Eigen::VectorXd v = block.col(col);
+			const double orig_norm = v.norm();
+			
+			for(int pass = 0; pass < 2; pass++)
+				for(const Eigen::VectorXd &b:basis)
+					v -= b.dot(v)*b;
+			
+			if(v.norm() <= 1e-10*orig_norm || orig_norm == 0)
+				continue;
+			
+			v.normalize();
+			basis.push_back(v);
+			
+			next.conservativeResize(Eigen::NoChange, next.cols() + 1);
+			next.col(next.cols() - 1) = v;
+		}
+		
+		block = G_ii_solver.solve(C_ii*next);
+		if(G_ii_solver.info() != Eigen::Success)
+			throw std::runtime_error("SparseLU solve: " + G_ii_solver.lastErrorMessage());
+	}
+	
+	const size_t n_red = basis.size();
+	
+	// Projection keeps port voltages as they are: V = diag(I, V_i)
+	Eigen::MatrixXd V = Eigen::MatrixXd::Zero(n, n_ports + n_red);
+	V.topLeftCorner(n_ports, n_ports).setIdentity();
+	for(size_t ind = 0; ind < n_red; ind++)
+		V.block(n_ports, n_ports + ind, n_int, 1) = basis[ind];
+	
+	const Eigen::MatrixXd G_red = V.transpose()*(G*V);
+	const Eigen::MatrixXd C_red = V.transpose()*(C*V);
+	
+	erase_components(reduced);
+	erase_nodes(internal);
+	
+	// Realize the reduced nodal matrices as elements between ports, new nodes, and ground
+	std::vector<Node*> red_nodes(ports.begin(), ports.end());
+	for(size_t ind = 0; ind < n_red; ind++)
+		red_nodes.push_back(add_node());
+	
+	auto stamp = [&](const Eigen::MatrixXd &M, bool is_cap) {
+		const double tol = 1e-12*M.cwiseAbs().maxCoeff();
+		
+		auto add = [&](double y, Node *top, Node *bot) {
+			if(std::abs(y) <= tol)
+				return;
+			
+			if(is_cap)
+				add_comp<Capacitor>(y, top, bot);
+			else
+				add_comp<Resistor>(1/y, top, bot);
+		};
+		
+		for(Eigen::Index row = 0; row < M.rows(); row++) {
+			for(Eigen::Index col = row + 1; col < M.cols(); col++)
+				add(-0.5*(M(row, col) + M(col, row)), red_nodes[row], red_nodes[col]);
+			
+			// Whatever isn't accounted for by the elements to other nodes goes to ground
+			add(M.row(row).sum(), red_nodes[row], gnd);
+		}
+	};
+	
+	stamp(G_red, false);
+	stamp(C_red, true);
+	
+	return n_red;
+}
+
+void Circuit::auto_timestep_bounds() {
+	if(user_min_ts && user_max_ts)
+		return;
+	
+	// Use the same defaults as a user would have picked if nothing can be estimated
+	min_ts = user_min_ts ? user_min_ts : 1e-15;
+	max_ts = user_max_ts ? user_max_ts : 1e-6;
+	initial_ts = max_ts;
+	
+	std::vector<IntegratingComponent*> ics;
+	for_component_type<IntegratingComponent>([&](IntegratingComponent *ic) {
+		ics.push_back(ic);
+	});
+	
+	if(ics.empty())
+		return;
+	
+	// In DC analysis, capacitors are open and inductors are shorted (or the other way around
+	// if they have an initial condition), so the factorized DC matrix with sources zeroed is the
+	// network each energy storage element sees with all others open/shorted.
+	// Find the resistance each component sees by exciting it with a unit source.
+	Eigen::MatrixXd excitation = Eigen::MatrixXd::Zero(n_vars, ics.size());
+	
+	for(size_t ind = 0; ind < ics.size(); ind++) {
+		const IntegratingComponent *ic = ics[ind];
+		auto vi = vsource_map.find(ic);
+		
+		// 1V across a voltage-defined component
+		if(vi != vsource_map.end())
+			excitation(vi->second, ind) = 1;
+		
+		// 1A through an open one (only KCL rows of free nodes take currents)
+		else {
+			if(!ic->node_top->fixed)
+				excitation(node_index(ic->node_top), ind) = 1;
+			if(!ic->node_bot->fixed)
+				excitation(node_index(ic->node_bot), ind) = -1;
+		}
+	}
+	
+	Eigen::MatrixXd response;
+	if(mixed_precision && !mixed_precision_stalled)
+		response = mat_solver_f->solve(excitation.cast<float>()).cast<double>();
+	else
+		response = solve_factorized(excitation);
+	
+	double tau_fast = std::numeric_limits<double>::max();
+	double tau_sum = 0;
+	
+	for(size_t ind = 0; ind < ics.size(); ind++) {
+		const IntegratingComponent *ic = ics[ind];
+		auto vi = vsource_map.find(ic);
+		
+		double r_seen;
+		if(vi != vsource_map.end())
+			r_seen = 1/std::abs(response(vi->second, ind));
+		else
+			r_seen = std::abs(response(node_index(ic->node_top), ind) - response(node_index(ic->node_bot), ind));
+		
+		// RC or L/R time constant
+		double tau;
+		if(dynamic_cast<const Inductor*>(ic))
+			tau = ic->value/r_seen;
+		else
+			tau = ic->value*r_seen;
+		
+		if(!std::isfinite(tau) || tau <= 0)
+			continue;
+		
+		tau_fast = std::min(tau_fast, tau);
+		tau_sum += tau;
+	}
+	
+	if(tau_sum == 0)
+		return;
+	
+	// The sum of open-circuit time constants approximates the dominant time constant
+	// Companion models are only first order accurate in the step size, so keep steps well below it
+	if(!user_max_ts)
+		max_ts = tau_sum/1000;
+	if(!user_min_ts)
+		min_ts = std::min(tau_fast*1e-6, max_ts);
+	
+	initial_ts = std::max(min_ts, std::min(max_ts, tau_fast/10));
 }
 
 int Circuit::system_function(double t, const double y[], double dydt[], void *params) {
@@ -407,6 +3107,10 @@ int Circuit::system_function(double t, const double y[], double dydt[], void *pa
 		if(m->continuous())
 			m->apply();
 	
+	// A jump arriving at the start of the step applies to it, one at the end doesn't
+	for(TransmissionLine *tl:c->tlines)
+		tl->update(t <= tempt);
+	
 	// Solve matrix to keep all values up-to-date
 	c->solve_matrix();
 	
@@ -414,6 +3118,8 @@ int Circuit::system_function(double t, const double y[], double dydt[], void *pa
 	for(size_t ind = 0; ind < c->dydt_exprs.size(); ind++)
 		dydt[ind] = c->dydt_exprs[ind].eval();
 	
+	c->cell_derivatives(dydt);
+	
 	// Restore old values t and y values for main circuit class
 	c->t = tempt;
 	memcpy(c->deq_state.data(), tempy, c->deq_state.size()*sizeof(double));
@@ -421,15 +3127,47 @@ int Circuit::system_function(double t, const double y[], double dydt[], void *pa
 	return GSL_SUCCESS;
 }
 
+int Circuit::system_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params) {
+	Circuit *c = (Circuit*)params;
+	const size_t dim = c->system.dimension;
+	
+	std::vector<double> f0(dim), f1(dim), y1(y, y + dim);
+	system_function(t, y, f0.data(), params);
+	
+	// Column by column forward differences: dfdy[i*dim + j] = df_i/dy_j
+	for(size_t col = 0; col < dim; col++) {
+		const double delta = std::sqrt(std::numeric_limits<double>::epsilon())*std::max(std::abs(y[col]), c->max_e_abs/c->max_e_rel);
+		y1[col] = y[col] + delta;
+		system_function(t, y1.data(), f1.data(), params);
+		y1[col] = y[col];
+		
+		for(size_t row = 0; row < dim; row++)
+			dfdy[row*dim + col] = (f1[row] - f0[row])/delta;
+	}
+	
+	// Time derivative (from modulators)
+	const double delta_t = std::sqrt(std::numeric_limits<double>::epsilon())*std::max(std::abs(t), c->min_ts);
+	system_function(t + delta_t, y, f1.data(), params);
+	for(size_t row = 0; row < dim; row++)
+		dfdt[row] = (f1[row] - f0[row])/delta_t;
+	
+	return GSL_SUCCESS;
+}
+
 void Circuit::sim_to_time(double stop, bool single_step) {
 	if(simulation_mode == DC_ANALYSIS) {
 		compute_dc_solution();
 		
+		// Lines start in the DC steady state
+		for(TransmissionLine *tl:tlines)
+			tl->start();
+		
 		for(auto &m:modulators)
 			m->reset();
 		
 		simulation_mode = TRANSIENT_ANALYSIS;
 		gen_matrix_pend = true;
+		trajectory.clear();
 		
 		if(single_step) return;
 	}
@@ -439,13 +3177,18 @@ void Circuit::sim_to_time(double stop, bool single_step) {
 		apply_modulators();
 	}
 	
+	// Stepped by a CircuitGroup until now
+	if(system.dimension && !driver) {
+		external_stepping = false;
+		alloc_driver();
+	}
+	
 	bool ran_step = false;
 	
 	while(t + EPSILON < stop && !(single_step && ran_step)) {
-		ran_step = true;
-		
 		const double save_time = next_save_time();
-		const double forced_end_time = std::min(save_time, next_modulator_time());
+		const double mod_time = next_modulator_time();
+		const double forced_end_time = std::min({save_time, mod_time, next_line_time()});
 		next_step = next_step_duration();
 		
 		if(t + next_step > stop)
@@ -484,14 +3227,36 @@ void Circuit::sim_to_time(double stop, bool single_step) {
 			// If step succeeded, use automatic step size adjustment function
 			// to possibly adjust the step for the next time
 			if(step_status == GSL_SUCCESS) {
+				const double step_taken = next_step;
+				const int hadj = gsl_odeiv2_control_hadjust(driver->c, driver->s, y, e->yerr, e->dydt_out, &next_step);
+				
+				// Error too large; retry with the smaller step unless it can't get any smaller
+				if(hadj == GSL_ODEIV_HADJ_DEC && step_taken > min_ts) {
+					e->failed_steps++;
+					stiffness_window_rejected++;
+					memcpy(y, e->y0, sizeof(double)*system.dimension);
+					
+					// Force dydt_in to be regenerated since dydt_out is from the rejected step
+					e->count = 0;
+					continue;
+				}
+				
 				e->count++;
-				t += next_step;
-				gsl_odeiv2_control_hadjust(driver->c, driver->s, y, e->yerr, e->dydt_out, &next_step);
+				stiffness_window_accepted++;
+				
+				if(record_trajectory)
+					trajectory.push_back({t, step_taken, std::vector<double>(e->y0, e->y0 + system.dimension), held_values()});
+				
+				t += step_taken;
+				
+				if(auto_stepper)
+					check_stiffness(step_taken);
 			}
 			
 			// If step didn't succeed, try halving the timestep
 			else {
 				e->failed_steps++;
+				stiffness_window_rejected++;
 				
 				// Can't make dt any smaller
 				if(next_step <= min_ts)
@@ -506,12 +3271,38 @@ void Circuit::sim_to_time(double stop, bool single_step) {
 			}
 		}
 		
-		// If no diff EQs just solve matrix and jump to next interesting time
+		// If no diff EQs just solve matrix and jump to next interesting time (or the end)
 		else {
-			t = forced_end_time;
+			t = std::min(forced_end_time, stop);
+			
+			for(auto &m:modulators)
+				if(m->continuous())
+					m->apply();
+			
+			for(TransmissionLine *tl:tlines)
+				tl->update(false);
+			
 			solve_matrix();
 		}
 		
+		// Transmission lines record their waves at the accepted time
+		// (the last solve was at an intermediate stage if there are diff EQs)
+		if(tlines.size()) {
+			if(system.dimension) {
+				for(auto &m:modulators)
+					if(m->continuous())
+						m->apply();
+				
+				for(TransmissionLine *tl:tlines)
+					tl->update(false);
+				
+				solve_matrix();
+			}
+			
+			for(TransmissionLine *tl:tlines)
+				tl->accept(false);
+		}
+		
 		// Check if we need to save states
 		// If save time is undefined, save whenever anything happens
 		if(epsilon_equals(t, save_time) || save_time == std::numeric_limits<double>::max())
@@ -519,6 +3310,28 @@ void Circuit::sim_to_time(double stop, bool single_step) {
 		
 		// Run modulators
 		apply_modulators();
+		
+		// Modulator jumps and waves arriving at line ends enter line histories as a second sample
+		// at the same time; modulator jumps also reach the other ends a delay later
+		// (reflections aren't tracked, so there's no growing set of breakpoints)
+		if(tlines.size()) {
+			const bool mod_jump = epsilon_equals(t, mod_time);
+			bool jump = mod_jump;
+			for(TransmissionLine *tl:tlines)
+				jump |= tl->arrival();
+			
+			if(jump) {
+				for(TransmissionLine *tl:tlines)
+					tl->update(true);
+				
+				solve_matrix();
+				
+				for(TransmissionLine *tl:tlines)
+					tl->accept(mod_jump);
+			}
+		}
+		
+		ran_step = true;
 	}
 }
 
@@ -5,14 +5,20 @@
 #pragma once
 
 #include "Core/Expression.hpp"
+#include "Core/ACResult.hpp"
+#include "Core/DCSweepResult.hpp"
+#include "Core/OrderingCache.hpp"
 
 #include <vector>
 #include <memory>
 #include <utility>
 #include <unordered_map>
+#include <unordered_set>
+#include <initializer_list>
 #include <functional>
 
 #include <Eigen/Core>
+#include <Eigen/LU>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-but-set-variable"
@@ -31,7 +37,15 @@ class Node;
 class Component;
 class TwoTerminalComponent;
 class IntegratingComponent;
+class NonlinearComponent;
+class BehavioralComponent;
+class TransmissionLine;
 class Modulator;
+class ThreadPool;
+class Subcircuit;
+class SubcircuitDef;
+class SubcircuitInstance;
+class CloneMap;
 
 class Circuit {
 private:
@@ -55,15 +69,38 @@ private:
 	
 	struct CoordinateHash {
 		size_t operator()(const Coordinate &c) const {
+			// Mix the row in so entries along a diagonal don't all collide
 			std::hash<size_t> hasher;
-			return hasher(c.row) ^ hasher(~c.col);
+			size_t h = hasher(c.row);
+			return h ^ (hasher(c.col) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
 		}
 	};
 	
 	std::unordered_map<Coordinate, Expression, CoordinateHash> expr_mat;
+	
+	// Voltage-defined components and the index of their current variable
+	std::unordered_map<const TwoTerminalComponent*, size_t> vsource_map;
+	
+	// Each matrix expression and where its value goes in eval_mat
+	struct MatrixEntry {
+		const Expression *expr;
+		double *value;
+	};
+	
+	std::vector<MatrixEntry> mat_entries;
+	
 	std::vector<Expression> expr_vec;
 	size_t n_vars;
 	
+	// Worker threads for matrix generation and evaluation
+	std::unique_ptr<ThreadPool> pool;
+	
+	// Return the thread pool, (re-)creating it if n_threads changed
+	ThreadPool &thread_pool();
+	
+	// Smallest number of nodes, matrix entries, or components worth handing to a thread
+	static const size_t parallel_grain = 1024;
+	
 	// Helper function to iterate over components of a certain dynamic type
 	template<typename T> void for_component_type(std::function<void(T*)> func) {
 		for(auto &c:components) {
@@ -73,16 +110,49 @@ private:
 		}
 	}
 	
+	// Choose a minimal set of independent IntegratingComponent states (tree/cotree selection),
+	// allocate deq_state for them, and express the remaining ones in terms of them
+	void assign_state_variables();
+	
 	// Generate, update, or solve circuit matrix
+	// solve_matrix() runs Newton iteration if there are nonlinear or behavioral components
+	// gen_matrix() only re-generates the rows of changed nodes if it can (see connections_changed())
 	void gen_matrix();
 	void update_matrix();
 	void solve_matrix();
+	void solve_linear();
+	
+	// Evaluate eval_mat and eval_vec without factorizing
+	void eval_matrix();
+	
+	// One Newton iteration's linearization of the nonlinear and behavioral components
+	// Return true if a voltage had to be limited
+	bool linearize_nonlinear(bool update_jacobian);
+	
+	// Check if Newton iteration converged after solving with the last linearization
+	// dv is set to the largest change of a linearization voltage
+	bool newton_converged(bool limited, double &dv) const;
+	
+	// Nonlinear and behavioral components, linearized on every Newton iteration
+	std::vector<NonlinearComponent*> nonlinear_comps;
+	std::vector<BehavioralComponent*> behavioral_comps;
+	
+	// Linearize nonlinear and behavioral components exactly around the present solution
+	// and solve again (after Newton iteration, for analyses that use the Jacobian)
+	void relinearize();
+	
+	// Transmission lines, whose history sources are updated at every evaluation time
+	// and which record their waves at every accepted timestep
+	std::vector<TransmissionLine*> tlines;
+	
+	// Set once every nonlinear component has a Jacobian (G) that modified Newton iterations can keep
+	bool newton_jacobian_valid = false;
 	
 	// Run apply() for all modulators
 	void apply_modulators();
 	
 	// Return the index of the node in solved_vec given the node itself or its evaluation variable reference
-	// Return -1 if it doesn't exist
+	// Return -1 if it doesn't exist; throws std::logic_error before the matrix is generated
 	ssize_t node_index(const Node *node) const;
 	ssize_t node_index(const double *var) const;
 	
@@ -92,32 +162,215 @@ private:
 	Eigen::VectorXd solved_vec;
 	
 	// Eigen solver
-	Eigen::SparseLU<Eigen::SparseMatrix<double>> mat_solver;
+	// (allocated with the matrix so it can be swapped with the other simulation mode's)
+	std::unique_ptr<Eigen::SparseLU<Eigen::SparseMatrix<double>, CachedOrdering<int>>> mat_solver;
+	bool mat_solver_analyzed = false;
+	
+	// Factorization used instead of mat_solver with dense_solver, and whether
+	// the last double-precision factorization was the dense one
+	Eigen::PartialPivLU<Eigen::MatrixXd> dense_lu;
+	bool dense_factorized = false;
+	
+	// Single-precision copy of the matrix and solver for mixed-precision solves
+	Eigen::SparseMatrix<float> eval_mat_f;
+	std::unique_ptr<Eigen::SparseLU<Eigen::SparseMatrix<float>, CachedOrdering<int>>> mat_solver_f;
+	bool mat_solver_f_analyzed = false;
+	
+	// eval_mat values at the last factorization and whether it was done in single precision,
+	// so it can be skipped when nothing changed
+	std::vector<double> factorized_values;
+	bool factorized_single = false;
+	
+	// Infinity norm of eval_mat, used to judge iterative refinement convergence
+	double eval_mat_norm = 0;
+	
+	// Set if single-precision refinement failed to converge and the
+	// double-precision factorization is being used instead
+	bool mixed_precision_stalled = false;
+	
+	// Factorize eval_mat (or cond_mat) in double precision
+	void factorize_double();
+	
+	// Subcircuits, and the ones with internal nodes as of the last matrix generation
+	std::vector<std::unique_ptr<Subcircuit>> subcircuits;
+	std::vector<Subcircuit*> condensed;
+	
+	// eval_mat with the subcircuits' internal variables eliminated, the position of each
+	// variable in it (-1 if eliminated), and where each eval_mat value goes in it (-1 if nowhere)
+	Eigen::SparseMatrix<double> cond_mat;
+	std::vector<ssize_t> cond_index;
+	std::vector<ssize_t> cond_slots;
+	
+	// Find each subcircuit's internal variables and set up the blocks and cond_mat pattern
+	void gen_condensation();
+	
+	// Condense every subcircuit (in parallel) and assemble cond_mat
+	void condense();
+	
+	// Solve eval_mat x = rhs (or eval_mat^T x = rhs) with the double-precision factors,
+	// going through the condensed matrix if there are subcircuits
+	Eigen::MatrixXd solve_factorized(const Eigen::MatrixXd &rhs, bool transposed = false);
+	
+	// Subcircuit definition instances
+	std::vector<std::unique_ptr<SubcircuitInstance>> instances;
+	
+	// Each distinct (definition, parameter overrides) pair among the instances
+	// The cell's internal variables are eliminated once for all instances sharing it:
+	// port rows get admittance Y and current J0 + Js*s, internal variables are X0 + Xs*s - Xp*v_p,
+	// and state derivatives are D0 + Ds*s + Dp*v_p (s: instance states, v_p: port voltages)
+	struct CellVariant {
+		SubcircuitDef *def;
+		std::vector<std::pair<TwoTerminalComponent*, double>> overrides;
+		
+		// Copy of the definition's cell with the overrides applied, evaluated for this circuit only
+		// (the definition itself is never modified, so circuits sharing it don't interfere)
+		std::unique_ptr<Circuit> cell;
+		
+		// Cell variables of the ports (in port order) and all others
+		std::vector<size_t> port_vars, int_vars;
+		
+		// Cell matrix, right-hand side, and step size the maps were computed from
+		std::vector<double> values;
+		
+		Eigen::MatrixXd Y, Js, Xs, Xp, Ds, Dp;
+		Eigen::VectorXd J0, X0, D0;
+	};
+	
+	std::vector<std::unique_ptr<CellVariant>> cell_variants;
+	
+	// Number of deq_state entries used by instances (after the components' states)
+	size_t n_cell_states = 0;
+	
+	// Generate the definitions' matrices for the simulation mode and group instances into variants
+	void gen_cells();
+	
+	// Recompute a variant's maps if the cell's values changed
+	void update_cell(CellVariant &v);
+	
+	// Update variants and add every instance to eval_mat and eval_vec
+	void stamp_cells();
+	
+	// Find where each instance's port admittances go in eval_mat
+	void gen_instance_slots();
+	
+	// All cell variables of an instance at the present solution
+	Eigen::VectorXd cell_solution(const SubcircuitInstance *inst) const;
+	double cell_voltage(const SubcircuitInstance *inst, const Node *cell_node) const;
+	
+	// Initial conditions of an instance's IntegratingComponents from the DC solution
+	void cell_initial_conds(SubcircuitInstance *inst);
+	
+	// State derivatives of all instances
+	void cell_derivatives(double dydt[]) const;
+	
+	// Solve using the single-precision factorization with iterative refinement
+	// Return false if refinement stalls
+	bool solve_refined();
 	
 	// If we need to re-generate the matrix
 	bool gen_matrix_pend = true;
 	
+	// Everything generated for the simulation mode not in use, kept so switching modes
+	// (and resetting) doesn't re-generate it as long as the topology stays the same
+	struct Plan {
+		int mode = -1;
+		std::unordered_map<Coordinate, Expression, CoordinateHash> expr_mat;
+		std::unordered_map<const TwoTerminalComponent*, size_t> vsource_map;
+		std::vector<MatrixEntry> mat_entries;
+		std::vector<Expression> expr_vec;
+		size_t n_vars = 0;
+		Eigen::SparseMatrix<double> eval_mat;
+		Eigen::VectorXd eval_vec, solved_vec;
+		std::unique_ptr<Eigen::SparseLU<Eigen::SparseMatrix<double>, CachedOrdering<int>>> mat_solver;
+		bool mat_solver_analyzed = false;
+		Eigen::PartialPivLU<Eigen::MatrixXd> dense_lu;
+		bool dense_factorized = false;
+		Eigen::SparseMatrix<float> eval_mat_f;
+		std::unique_ptr<Eigen::SparseLU<Eigen::SparseMatrix<float>, CachedOrdering<int>>> mat_solver_f;
+		bool mat_solver_f_analyzed = false;
+		std::vector<double> factorized_values;
+		bool factorized_single = false;
+		double eval_mat_norm = 0;
+		bool mixed_precision_stalled = false;
+		size_t dimension = 0;
+		
+		// circuit_v_expr and circuit_i_expr of each TwoTerminalComponent (in component order)
+		std::vector<std::pair<Expression, Expression>> comp_exprs;
+	} other_plan;
+	
+	// Swap the generated matrix (and everything that goes with it) with other_plan
+	void swap_plan();
+	
+	// Finish switching to a plan from other_plan: refresh the starting point, cells, and states
+	void reuse_plan();
+	
+	// Nodes whose components changed since the matrix was generated, and whether
+	// the whole matrix needs to be re-generated instead (variables were added or removed)
+	std::unordered_set<const Node*> changed_nodes;
+	bool regen_all = true;
+	
+	// Simulation mode the matrix was generated for (-1 if it hasn't been)
+	int gen_mode = -1;
+	
+	// IntegratingComponents that had a state when the matrix was generated
+	std::unordered_set<const IntegratingComponent*> state_comps;
+	
+	// Indicate that components were connected to or disconnected from some nodes
+	// Only their rows are re-generated, and a running transient simulation keeps its states
+	void connections_changed(std::initializer_list<const Node*> changed);
+	
 	// Time
-	double t;
+	double t = 0;
 	
-	// Time step (dynamic, will point into driver object)
+	// Time step (dynamic, will point to step_size when integrating)
+	// Kept outside of the driver object so expressions stay valid when the driver is re-allocated
 	double *_dt = nullptr;
+	double step_size = 0;
 	
 	// Hold next timestep that will be tried
 	double next_step;
 	
-	// Timestep limits
-	const double min_ts, max_ts;
+	// Timestep limits requested in the constructor (0 to determine automatically)
+	const double user_min_ts, user_max_ts;
+	
+	// Timestep limits in use, and the first step to try in transient analysis
+	double min_ts, max_ts;
+	double initial_ts;
+	
+	// Estimate the fastest and dominant time constants of the circuit from the
+	// DC solution's factorization and set any timestep limits not given by the user
+	void auto_timestep_bounds();
 	
 	// Absolute error and relative error
 	const double max_e_abs, max_e_rel;
 	
-	// ODE solver algorithm
-	const gsl_odeiv2_step_type * const stepper_type;
+	// ODE solver algorithm chosen in the constructor, and the one currently in use
+	const gsl_odeiv2_step_type * const initial_stepper_type;
+	const gsl_odeiv2_step_type *stepper_type;
 	
 	// GSL diff EQ solver driver object
 	gsl_odeiv2_driver *driver = nullptr;
 	
+	// Set while a CircuitGroup steps the diff EQs as part of its own system, so no driver is allocated
+	bool external_stepping = false;
+	
+	// (Re-)allocate the driver for the current stepper_type
+	// A driver for the same dimension and stepper is reset instead
+	void alloc_driver();
+	
+	// Step statistics since the last stiffness check
+	unsigned long stiffness_window_accepted = 0;
+	unsigned long stiffness_window_rejected = 0;
+	
+	// Check if the system is stiff after a step of size h and switch steppers if needed
+	void check_stiffness(double h);
+	
+	// Estimate the spectral radius of the diff EQ system Jacobian using power iteration
+	double estimate_spectral_radius();
+	
+	// Return true if a stepper type requires a Jacobian (implicit methods)
+	static bool stepper_is_implicit(const gsl_odeiv2_step_type *type);
+	
 	// GSL diff EQ solver system
 	gsl_odeiv2_system system;
 	
@@ -130,18 +383,125 @@ private:
 	// Diff EQ system evaluation function
 	static int system_function(double t, const double y[], double dydt[], void *params);
 	
+	// Finite-difference Jacobian of system_function for implicit steppers
+	static int system_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params);
+	
 	// Times when a save was performed
 	std::vector<double> _save_times;
 	
+	// Accepted transient steps (start time, step size, state at the start, and values
+	// held by discontinuous modulators during the step) for sensitivity analysis
+	struct TrajectoryStep {
+		double t, h;
+		std::vector<double> y;
+		std::vector<double> held;
+	};
+	
+	std::vector<TrajectoryStep> trajectory;
+	
+	// Values of components driven by discontinuous modulators (in component order)
+	// Those modulators only move forward in time, so walking backward has to set them directly
+	std::vector<double> held_values();
+	void set_held_values(const std::vector<double> &values);
+	
+	// Sensitivity analysis parameters (component values) and their components
+	typedef std::unordered_map<const double*, size_t> ParamIndex;
+	std::vector<TwoTerminalComponent*> sensitivity_params(ParamIndex &param_index);
+	
+	// Weights on solved_vec selecting a node or component voltage
+	Eigen::VectorXd output_weights(const Node *n) const;
+	Eigen::VectorXd output_weights(const TwoTerminalComponent *c) const;
+	
+	// Add weight * d(expr)/d(ref) for every reference in expr to x_grad (solved_vec references, if given),
+	// s_grad (deq_state references), or p_grad (parameters)
+	void accumulate_derivatives(const Expression &expr, double weight, Eigen::VectorXd *x_grad,
+	                            std::vector<double> &s_grad, std::vector<double> &p_grad, const ParamIndex &param_index) const;
+	
+	// Adjoint of the network solution at the present solution: with w = A^-T x_weights,
+	// add w^T dx/ds to s_grad and w^T dx/dp to p_grad
+	void adjoint_network(const Eigen::VectorXd &x_weights, std::vector<double> &s_grad,
+	                     std::vector<double> &p_grad, const ParamIndex &param_index);
+	
+	// Solve the circuit at a state, time, and step size, with nonlinear components linearized exactly
+	void solve_at_state(const std::vector<double> &state, double time, double h);
+	
+	// Adjoint of the diff EQ system at a state: add J^T mu to jt_mu and mu^T df/dp to p_grad
+	void adjoint_system(const std::vector<double> &state, double time, double h, const std::vector<double> &mu,
+	                    std::vector<double> &jt_mu, std::vector<double> &p_grad, const ParamIndex &param_index);
+	
+	// AC small-signal matrix shared by every frequency, with entries that are sums of constants
+	// and +/- each component's admittance or impedance
+	typedef Eigen::SparseMatrix<std::complex<double>> ACMatrix;
+	
+	struct ACStamp {
+		size_t row, col;
+		ssize_t comp;
+		double sign;
+		size_t slot;
+	};
+	
+	struct ACSystem {
+		std::vector<TwoTerminalComponent*> ttcs;
+		
+		// Node voltages, then a current for each voltage-defined component (branch index, or -1)
+		size_t n_vars;
+		std::vector<ssize_t> branch;
+		std::vector<std::complex<double>> sources;
+		
+		std::vector<ACStamp> stamps;
+		Eigen::VectorXcd rhs;
+		
+		// Pattern stored with the fill-reducing column ordering perm already applied
+		ACMatrix permuted;
+		Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> perm;
+		
+		// Evaluate a copy of permuted at omega, leaving each component's admittance or impedance in models
+		void fill(double omega, ACMatrix &mat, std::vector<std::complex<double>> &models) const;
+	};
+	
+	// Build the AC system around the DC operating point (or the present state in transient)
+	ACSystem gen_ac_system();
+	
+	// Variable index of each port node
+	// Throw if one isn't in the circuit or has a fixed voltage, or the matrix isn't generated
+	std::vector<size_t> port_indices(const std::vector<Node*> &ports) const;
+	
+	// Nodes only reachable from the given ports through components accepted by allowed
+	// (not fixed, not ports, and with every connection allowed)
+	std::vector<Node*> internal_nodes(const std::vector<Node*> &ports, std::function<bool(const TwoTerminalComponent*)> allowed);
+	
+	// Map every part of this circuit to the part at the same position in other, which has to have
+	// been built the same way (throws std::invalid_argument if the parts' counts or types differ)
+	void map_parts(Circuit &other, CloneMap &map) const;
+	
+	// Delete components and nodes, disconnecting them from everything else
+	void erase_components(const std::vector<TwoTerminalComponent*> &comps);
+	void erase_nodes(const std::vector<Node*> &erased);
+	
+	std::unordered_map<const TwoTerminalComponent*, double> dc_sensitivity(const Eigen::VectorXd &weights);
+	std::unordered_map<const TwoTerminalComponent*, double> transient_sensitivity(const Eigen::VectorXd &weights);
+
 public:
-	// Constructor for setting ODE max timestep, solver algorithm, and error limits
+	// Constructor for setting ODE timestep limits, solver algorithm, and error limits
+	// Pass 0 for a timestep limit to estimate it from the circuit's time constants instead
 	Circuit(double min_ts = 1e-15, double max_ts = 1e-6, double max_e_abs = 1e-12, double max_e_rel = 1e-3, const gsl_odeiv2_step_type *stepper_type = gsl_odeiv2_step_rkf45);
 	
 	~Circuit();
 	
 	// Prevent copies from being made (because of many internal pointer references)
+	// Use clone() instead
 	Circuit(const Circuit&) = delete;
 	
+	// Deep copy of the circuit and its present simulation state (time, diff EQ states, solution,
+	// step size, histories, and the state of modulators and transmission lines), with every
+	// internal reference rebound, so the clone continues from where this circuit is
+	// The clone's matrix is generated (but not factorized) once, and its ODE stepper starts
+	// a new step history; subcircuit instances keep referring to the same definitions
+	// If map is given, it's filled with the clone's counterpart of every part of this circuit
+	// Throws std::logic_error if a component or modulator type can't be cloned, or if the
+	// topology changed during a transient simulation and no step was taken since
+	std::unique_ptr<Circuit> clone(CloneMap *map = nullptr) const;
+	
 	// Create new nodes
 	Node *add_node();
 	Node *add_node(double v);
@@ -152,7 +512,7 @@ public:
 	// Create new components
 	// (define here so templates can be created on demand)
 	template<typename T, typename... Args> T *add_comp(Args&&... args) {
-		topology_changed();
+		connections_changed({});
 		T *c = new T(this, std::forward<Args>(args)...);
 		components.emplace_back(c);
 		return c;
@@ -166,6 +526,57 @@ public:
 		return c;
 	}
 	
+	// Factor the circuit matrix in single precision and refine the solution
+	// to double precision accuracy using double-precision residuals
+	// Falls back to a double-precision factorization if refinement stalls
+	bool mixed_precision = false;
+	
+	// Maximum number of iterative refinement steps for mixed-precision solves
+	unsigned int max_refinement_steps = 10;
+	
+	// Factorize the circuit matrix densely (with partial pivoting) instead of with SparseLU,
+	// which skips the symbolic analysis and is faster for circuits of a few dozen variables
+	// Turns off mixed precision when the matrix is generated
+	bool dense_solver = false;
+	
+	// Newton iteration limit and convergence tolerances on nonlinear component voltages and currents
+	unsigned int max_newton_iterations = 100;
+	double newton_reltol = 1e-3;
+	double newton_vntol = 1e-6;
+	double newton_abstol = 1e-12;
+	
+	// Nonlinear components whose voltage moved less than this since their last
+	// linearization aren't re-evaluated
+	double bypass_tol = 1e-9;
+	
+	// Keep the previous Jacobian (and so the previous factorization) while Newton iteration
+	// converges quickly, only refreshing it when convergence slows down
+	bool modified_newton = true;
+	
+	// Monitor step size and rejection behavior and switch between explicit_stepper
+	// and implicit_stepper during the simulation when stiffness changes
+	bool auto_stepper = false;
+	const gsl_odeiv2_step_type *explicit_stepper = gsl_odeiv2_step_rkf45;
+	const gsl_odeiv2_step_type *implicit_stepper = gsl_odeiv2_step_rk2imp;
+	
+	// Number of steps between stiffness checks
+	unsigned long stiffness_check_interval = 50;
+	
+	// Integrate only an independent set of capacitor voltages and inductor currents
+	// Others in capacitor loops and inductor cutsets follow from them (false gives every one its own state)
+	bool reduce_states = true;
+	
+	// Stepper currently in use
+	const gsl_odeiv2_step_type *current_stepper() const;
+	
+	// Number of threads used to generate and evaluate the circuit matrix
+	// (0 for one per hardware thread)
+	// Results are identical for any number of threads
+	unsigned int n_threads = 1;
+	
+	// Record every accepted transient step so transient_sensitivity() can integrate backward
+	bool record_trajectory = false;
+	
 	// How often voltages and currents will be saved
 	// Zero for at every computed timestep
 	double save_period = 0;
@@ -182,6 +593,10 @@ public:
 	// Next modulator change time
 	double next_modulator_time() const;
 	
+	// Next time a transmission line needs a step to end at
+	// (steps never span more than a line delay, and discontinuities arrive a delay later)
+	double next_line_time() const;
+	
 	// Next step that will be taken in sim_to_time
 	double next_step_duration() const;
 	double next_step_time() const;
@@ -190,6 +605,8 @@ public:
 	void save_states();
 	
 	// Reset everything
+	// The generated DC and transient matrices (and their symbolic analyses) are kept,
+	// so running again on the same topology only refreshes values and initial conditions
 	void reset();
 	
 	// Get current time
@@ -198,6 +615,10 @@ public:
 	// Get pointer to internal time step
 	const double *dt() const;
 	
+	// Timestep limits in use
+	double min_timestep() const;
+	double max_timestep() const;
+	
 	// Simulate
 	void sim_to_time(double stop, bool single_step = false);
 	void sim_single_step(double step_time = -1);
@@ -205,13 +626,76 @@ public:
 	// DC solution for generating steady-state
 	void compute_dc_solution();
 	
+	// AC small-signal analysis at each frequency (Hz), linearized around the DC solution
+	// (or the present state if a transient simulation is running)
+	// Frequencies share one fill-reducing ordering and are solved in parallel on n_threads threads
+	ACResult ac_analysis(const std::vector<double> &freqs);
+	
+	// Impedance matrix between port nodes: Z(i, j) is the voltage at port i for 1A injected
+	// into port j (and taken out through the fixed-voltage nodes)
+	// All ports are solved as one block of right-hand sides against a single factorization,
+	// in DC around the operating point, and in AC at each frequency (in parallel on n_threads threads)
+	Eigen::MatrixXd dc_impedance(const std::vector<Node*> &ports);
+	std::vector<Eigen::MatrixXcd> ac_impedance(const std::vector<Node*> &ports, const std::vector<double> &freqs);
+	
+	// DC solution for each value of a component (i.e. a source voltage or a resistance)
+	// The matrix is generated and analyzed once, and each point starts from the previous solution
+	// If the value only enters the right-hand side of a linear circuit (independent sources),
+	// all points are solved from one factorization, split across n_threads threads
+	// The component's value is restored afterwards
+	DCSweepResult dc_sweep(TwoTerminalComponent *comp, const std::vector<double> &values);
+	
+	// Derivatives of the DC solution of a node or component voltage with respect to
+	// the value of every linear component, from a single transposed (adjoint) solve
+	std::unordered_map<const TwoTerminalComponent*, double> dc_sensitivity(const Node *output);
+	std::unordered_map<const TwoTerminalComponent*, double> dc_sensitivity(const TwoTerminalComponent *output);
+	
+	// Derivatives of a node or component voltage at the present time of a transient simulation
+	// with respect to the value of every linear component, from one backward adjoint integration
+	// over the steps recorded with record_trajectory
+	// Initial conditions are held fixed
+	std::unordered_map<const TwoTerminalComponent*, double> transient_sensitivity(const Node *output);
+	std::unordered_map<const TwoTerminalComponent*, double> transient_sensitivity(const TwoTerminalComponent *output);
+	
 	// Simulation mode which controls how components are represented
 	enum {
 		DC_ANALYSIS,
 		TRANSIENT_ANALYSIS
 	} simulation_mode = DC_ANALYSIS;
 	
-	// Indicate that the circuit topology has changed so the matrix needs to be re-generated
+	// Replace the Resistor/Capacitor network behind a set of port nodes with a reduced-order
+	// macromodel that matches the first order block moments of the port admittance (PRIMA)
+	// Internal nodes are the ones only connected to Resistors and Capacitors leading to other
+	// internal nodes, the ports, or ground; they and their components are deleted, and the model
+	// is stamped back as Resistors and Capacitors (possibly with negative values) between the ports,
+	// ground, and new internal nodes. The congruence projection keeps the model passive.
+	// Return the number of internal nodes in the macromodel
+	size_t reduce_network(const std::vector<Node*> &ports, size_t order);
+	
+	// Group linear components into a subcircuit that is condensed out of the circuit matrix:
+	// its internal nodes (free nodes only connected to the group) are eliminated with a
+	// Schur complement each time the matrix changes, and only its boundary nodes are
+	// solved with the rest of the circuit
+	// Subcircuits can't share components, are condensed in parallel on n_threads threads,
+	// and turn off mixed precision
+	Subcircuit *add_subcircuit(const std::vector<TwoTerminalComponent*> &comps);
+	
+	// Instantiate a subcircuit definition with its ports connected to the given nodes,
+	// optionally replacing the values of some of the definition's components
+	// Instances don't create nodes or components: each distinct parameter set has the definition's
+	// internal variables eliminated once, and instances only add admittances and currents between
+	// their ports (and their states to the diff EQ system)
+	// AC and sensitivity analyses don't support circuits with instances
+	SubcircuitInstance *add_instance(SubcircuitDef *def, const std::vector<Node*> &ports,
+	                                 std::vector<std::pair<TwoTerminalComponent*, double>> overrides = {});
+	
+	// Disconnect and delete a component
+	// The rows of its nodes are re-generated and a running transient simulation continues
+	void remove_comp(TwoTerminalComponent *c);
+	
+	// Indicate that the circuit topology has changed so the whole matrix needs to be re-generated
+	// A running transient simulation continues from its present states; IntegratingComponents
+	// and subcircuit instances added since the last step start from their initial conditions
 	void topology_changed();
 	
 	// Inexact floor function
@@ -221,6 +705,12 @@ public:
 	static bool epsilon_equals(double x, double y);
 	
 	friend class Node;
+	friend class TwoTerminalComponent;
+	friend class SubcircuitInstance;
+	friend class ParameterSweep;
+	friend class CircuitGroup;
+	friend class Ensemble;
+	friend class Batch;
 };
 
 }
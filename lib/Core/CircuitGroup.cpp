@@ -0,0 +1,318 @@
+#include "Core/CircuitGroup.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/Modulator.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+#include <gsl/gsl_errno.h>
+
+namespace spice {
+
+CircuitGroup::CircuitGroup() {
+	system.function = system_function;
+	system.jacobian = system_jacobian;
+	system.dimension = 0;
+	system.params = this;
+}
+
+CircuitGroup::~CircuitGroup() {
+	if(driver)
+		gsl_odeiv2_driver_free(driver);
+}
+
+size_t CircuitGroup::size() const {
+	return circuits.size();
+}
+
+double CircuitGroup::time() const {
+	return t;
+}
+
+void CircuitGroup::check() {}
+
+void CircuitGroup::setup() {
+	if(circuits.empty())
+		return;
+	
+	for(Circuit *c:circuits) {
+		// The group's driver takes the steps
+		c->external_stepping = true;
+		
+		// DC solution, leaving the circuit ready for its first transient step
+		if(c->simulation_mode == Circuit::DC_ANALYSIS)
+			c->sim_to_time(c->t, true);
+		
+		if(c->gen_matrix_pend) {
+			c->gen_matrix();
+			c->apply_modulators();
+		}
+		
+		// Circuits stepped before (on their own) don't need their drivers anymore
+		else if(c->driver)
+			c->alloc_driver();
+	}
+	
+	check();
+	
+	const Circuit &first = *circuits.front();
+	for(Circuit *c:circuits) {
+		if(!Circuit::epsilon_equals(c->t, first.t))
+			throw std::runtime_error("Circuits are at different times");
+		
+		// The group's driver steps every circuit with the same stepper and error limits
+		if(c->stepper_type != first.stepper_type || c->max_e_abs != first.max_e_abs || c->max_e_rel != first.max_e_rel)
+			throw std::runtime_error("Circuits have different steppers or error limits");
+	}
+	
+	t = first.t;
+	
+	// Timestep limits no circuit would exceed on its own
+	min_ts = max_ts = next_step = std::numeric_limits<double>::max();
+	for(Circuit *c:circuits) {
+		min_ts = std::min(min_ts, c->min_ts);
+		max_ts = std::min(max_ts, c->max_ts);
+		next_step = std::min(next_step, c->next_step);
+	}
+	max_ts = std::max(max_ts, min_ts);
+	
+	// States of all circuits, circuit after circuit
+	offsets.assign(1, 0);
+	for(Circuit *c:circuits)
+		offsets.push_back(offsets.back() + c->system.dimension);
+	
+	system.dimension = offsets.back();
+	deq_state.resize(system.dimension);
+	saved_state.resize(system.dimension);
+	saved_time.resize(circuits.size());
+	for(size_t ind = 0; ind < circuits.size(); ind++)
+		std::copy(circuits[ind]->deq_state.begin(), circuits[ind]->deq_state.end(), deq_state.begin() + offsets[ind]);
+	
+	if(driver) {
+		gsl_odeiv2_driver_free(driver);
+		driver = nullptr;
+	}
+	
+	if(system.dimension) {
+		driver = gsl_odeiv2_driver_alloc_y_new(&system, first.stepper_type, max_ts, first.max_e_abs, first.max_e_rel);
+		if(!driver)
+			throw std::runtime_error("GSL driver allocation failed");
+		
+		gsl_odeiv2_driver_set_hmin(driver, min_ts);
+		gsl_odeiv2_driver_set_hmax(driver, max_ts);
+	}
+	
+	setup_pend = false;
+}
+
+int CircuitGroup::system_function(double t, const double y[], double dydt[], void *params) {
+	CircuitGroup *g = (CircuitGroup*)params;
+	
+	// Save each circuit's t and y, and use the values passed to this function
+	std::vector<double> &tempy = g->saved_state;
+	std::vector<double> &tempt = g->saved_time;
+	
+	for(size_t ind = 0; ind < g->circuits.size(); ind++) {
+		Circuit &c = *g->circuits[ind];
+		const size_t offset = g->offsets[ind];
+		
+		tempt[ind] = c.t;
+		std::copy(c.deq_state.begin(), c.deq_state.end(), tempy.begin() + offset);
+		std::copy(y + offset, y + g->offsets[ind + 1], c.deq_state.begin());
+		c.t = t;
+		
+		for(auto &m:c.modulators)
+			if(m->continuous())
+				m->apply();
+	}
+	
+	g->solve_all();
+	
+	for(size_t ind = 0; ind < g->circuits.size(); ind++) {
+		Circuit &c = *g->circuits[ind];
+		const size_t offset = g->offsets[ind];
+		
+		for(size_t state = 0; state < c.dydt_exprs.size(); state++)
+			dydt[offset + state] = c.dydt_exprs[state].eval();
+		
+		c.cell_derivatives(dydt + offset);
+		
+		c.t = tempt[ind];
+		std::copy(tempy.begin() + offset, tempy.begin() + g->offsets[ind + 1], c.deq_state.begin());
+	}
+	
+	return GSL_SUCCESS;
+}
+
+int CircuitGroup::system_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params) {
+	CircuitGroup *g = (CircuitGroup*)params;
+	const size_t dim = g->system.dimension;
+	const Circuit &first = *g->circuits.front();
+	
+	size_t max_dim = 0;
+	for(size_t ind = 0; ind < g->circuits.size(); ind++)
+		max_dim = std::max(max_dim, g->offsets[ind + 1] - g->offsets[ind]);
+	
+	std::vector<double> f0(dim), f1(dim), y1(y, y + dim), delta(dim);
+	system_function(t, y, f0.data(), params);
+	
+	// Circuits don't depend on each other, so a state of every circuit is perturbed at once
+	std::fill(dfdy, dfdy + dim*dim, 0.0);
+	for(size_t col = 0; col < max_dim; col++) {
+		for(size_t ind = 0; ind < g->circuits.size(); ind++) {
+			const size_t state = g->offsets[ind] + col;
+			if(state >= g->offsets[ind + 1])
+				continue;
+			
+			delta[state] = std::sqrt(std::numeric_limits<double>::epsilon())*std::max(std::abs(y[state]), first.max_e_abs/first.max_e_rel);
+			y1[state] = y[state] + delta[state];
+		}
+		
+		system_function(t, y1.data(), f1.data(), params);
+		
+		for(size_t ind = 0; ind < g->circuits.size(); ind++) {
+			const size_t state = g->offsets[ind] + col;
+			if(state >= g->offsets[ind + 1])
+				continue;
+			
+			y1[state] = y[state];
+			for(size_t row = g->offsets[ind]; row < g->offsets[ind + 1]; row++)
+				dfdy[row*dim + state] = (f1[row] - f0[row])/delta[state];
+		}
+	}
+	
+	// Time derivative (from modulators)
+	const double delta_t = std::sqrt(std::numeric_limits<double>::epsilon())*std::max(std::abs(t), g->min_ts);
+	system_function(t + delta_t, y, f1.data(), params);
+	for(size_t row = 0; row < dim; row++)
+		dfdt[row] = (f1[row] - f0[row])/delta_t;
+	
+	return GSL_SUCCESS;
+}
+
+void CircuitGroup::sim_to_time(double stop) {
+	bool pend = setup_pend;
+	for(Circuit *c:circuits)
+		pend |= c->simulation_mode == Circuit::DC_ANALYSIS || c->gen_matrix_pend || !c->external_stepping;
+	
+	if(pend)
+		setup();
+	
+	if(circuits.empty())
+		return;
+	
+	const size_t n = circuits.size();
+	std::vector<double> save_time(n);
+	
+	while(t + EPSILON < stop) {
+		// Step to the first time any circuit needs a step to end at
+		double forced_end_time = std::numeric_limits<double>::max();
+		double step = std::numeric_limits<double>::max();
+		
+		for(size_t ind = 0; ind < n; ind++) {
+			Circuit &c = *circuits[ind];
+			c.next_step = next_step;
+			save_time[ind] = c.next_save_time();
+			forced_end_time = std::min({forced_end_time, save_time[ind], c.next_modulator_time()});
+			step = std::min(step, c.next_step_duration());
+		}
+		
+		next_step = std::max(min_ts, std::min(step, max_ts));
+		if(t + next_step > stop)
+			next_step = stop - t;
+		
+		if(system.dimension) {
+			for(Circuit *c:circuits)
+				*c->_dt = next_step;
+			
+			// Same as the step in Circuit::sim_to_time(), for all circuits
+			gsl_odeiv2_evolve *e = driver->e;
+			double *y = deq_state.data();
+			
+			memcpy(e->y0, y, sizeof(double)*system.dimension);
+			
+			int step_status;
+			if(driver->s->type->can_use_dydt_in) {
+				if(e->count == 0)
+					system_function(t, y, e->dydt_in, this);
+				else
+					memcpy(e->dydt_in, e->dydt_out, sizeof(double)*system.dimension);
+				
+				step_status = gsl_odeiv2_step_apply(driver->s, t, next_step, y, e->yerr, e->dydt_in, e->dydt_out, &system);
+			}
+			
+			else
+				step_status = gsl_odeiv2_step_apply(driver->s, t, next_step, y, e->yerr, nullptr, e->dydt_out, &system);
+			
+			if(step_status == GSL_EFAULT)
+				throw std::runtime_error("gsl_odeiv2_step_apply returned EFAULT");
+			
+			if(step_status == GSL_SUCCESS) {
+				const double step_taken = next_step;
+				const int hadj = gsl_odeiv2_control_hadjust(driver->c, driver->s, y, e->yerr, e->dydt_out, &next_step);
+				
+				if(hadj == GSL_ODEIV_HADJ_DEC && step_taken > min_ts) {
+					e->failed_steps++;
+					memcpy(y, e->y0, sizeof(double)*system.dimension);
+					e->count = 0;
+					continue;
+				}
+				
+				e->count++;
+				
+				for(size_t ind = 0; ind < n; ind++) {
+					Circuit &c = *circuits[ind];
+					if(c.record_trajectory)
+						c.trajectory.push_back({t, step_taken, std::vector<double>(e->y0 + offsets[ind], e->y0 + offsets[ind + 1]), c.held_values()});
+					
+					std::copy(y + offsets[ind], y + offsets[ind + 1], c.deq_state.begin());
+				}
+				
+				t += step_taken;
+			}
+			
+			else {
+				e->failed_steps++;
+				
+				if(next_step <= min_ts)
+					throw std::runtime_error("System does not converge at min timestep");
+				
+				next_step /= 2;
+				memcpy(y, e->y0, sizeof(double)*system.dimension);
+				continue;
+			}
+			
+			for(Circuit *c:circuits)
+				c->t = t;
+		}
+		
+		// If no diff EQs just solve the circuits at the next interesting time (or the end)
+		else {
+			t = std::min(forced_end_time, stop);
+			
+			for(Circuit *c:circuits) {
+				c->t = t;
+				for(auto &m:c->modulators)
+					if(m->continuous())
+						m->apply();
+			}
+			
+			solve_all();
+		}
+		
+		for(size_t ind = 0; ind < n; ind++) {
+			Circuit &c = *circuits[ind];
+			c.next_step = next_step;
+			
+			if(Circuit::epsilon_equals(t, save_time[ind]) || save_time[ind] == std::numeric_limits<double>::max())
+				c.save_states();
+			
+			c.apply_modulators();
+		}
+	}
+}
+
+}
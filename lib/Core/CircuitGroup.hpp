@@ -0,0 +1,76 @@
+/*
+	Base class for circuits whose diff EQs are stepped together as one system, with one driver
+	and one timestep: every circuit's states are controlled, so steps are the smallest any circuit
+	would take, and each circuit saves its states and runs its modulators as it would on its own
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <gsl/gsl_odeiv2.h>
+
+namespace spice {
+
+class Circuit;
+
+class CircuitGroup {
+protected:
+	// Circuits stepped together (owned by the derived class)
+	std::vector<Circuit*> circuits;
+	
+	// Where each circuit's states start in deq_state (and how many there are, at the end)
+	std::vector<size_t> offsets;
+	
+	// Time, next timestep, and timestep limits (the smallest of the circuits')
+	double t = 0;
+	double next_step = 0;
+	double min_ts = 0, max_ts = 0;
+	
+	// Diff EQ system of all circuits (circuit after circuit), and its driver
+	// The stepper and error limits are the circuits' (which must all have the same ones)
+	gsl_odeiv2_system system;
+	gsl_odeiv2_driver *driver = nullptr;
+	std::vector<double> deq_state;
+	
+	// Each circuit's states and time, saved while the system function evaluates other ones
+	std::vector<double> saved_state;
+	std::vector<double> saved_time;
+	
+	// Start every circuit's transient simulation and set up the combined system
+	// (again whenever a circuit needs its matrix re-generated)
+	// Throws std::runtime_error if the circuits' steppers or error limits differ
+	void setup();
+	bool setup_pend = true;
+	
+	// Check derived classes' requirements once every circuit's matrix is generated
+	virtual void check();
+	
+	// Solve every circuit at its present time and states
+	virtual void solve_all() = 0;
+	
+	// Diff EQ system evaluation function and its finite-difference Jacobian (block diagonal)
+	static int system_function(double t, const double y[], double dydt[], void *params);
+	static int system_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params);
+	
+	CircuitGroup();
+
+public:
+	virtual ~CircuitGroup();
+	
+	CircuitGroup(const CircuitGroup&) = delete;
+	
+	// Number of circuits
+	size_t size() const;
+	
+	// Get current time
+	double time() const;
+	
+	// Simulate every circuit
+	// The first call computes each circuit's DC solution
+	// Throws std::runtime_error if the circuits aren't all at the same time
+	// or don't all have the same stepper and error limits
+	virtual void sim_to_time(double stop);
+};
+
+}
@@ -0,0 +1,44 @@
+#include "Core/CloneMap.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace spice {
+
+// Look up a counterpart, with null for null
+template<typename K, typename V> static V *find(const std::unordered_map<const K*, V*> &map, const K *key, const char *what) {
+	if(!key)
+		return nullptr;
+	
+	auto it = map.find(key);
+	if(it == map.end())
+		throw std::invalid_argument(std::string(what) + " not part of the cloned circuit");
+	
+	return it->second;
+}
+
+Component *CloneMap::find_component(const Component *c) const {
+	return find(components, c, "Component");
+}
+
+Modulator *CloneMap::find_modulator(const Modulator *m) const {
+	return find(modulators, m, "Modulator");
+}
+
+Node *CloneMap::node(const Node *n) const {
+	return find(nodes, n, "Node");
+}
+
+Subcircuit *CloneMap::subcircuit(const Subcircuit *s) const {
+	return find(subcircuits, s, "Subcircuit");
+}
+
+SubcircuitInstance *CloneMap::instance(const SubcircuitInstance *inst) const {
+	return find(instances, inst, "Subcircuit instance");
+}
+
+double *CloneMap::value(const double *v) const {
+	return find(values, v, "Component value");
+}
+
+}
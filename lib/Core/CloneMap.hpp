@@ -0,0 +1,50 @@
+/*
+	Correspondence between the parts of a circuit and the parts of its clone (see Circuit::clone())
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+namespace spice {
+
+class Node;
+class Component;
+class Modulator;
+class Subcircuit;
+class SubcircuitInstance;
+
+class CloneMap {
+private:
+	std::unordered_map<const Node*, Node*> nodes;
+	std::unordered_map<const Component*, Component*> components;
+	std::unordered_map<const Modulator*, Modulator*> modulators;
+	std::unordered_map<const Subcircuit*, Subcircuit*> subcircuits;
+	std::unordered_map<const SubcircuitInstance*, SubcircuitInstance*> instances;
+	
+	// Component values (what modulators control)
+	std::unordered_map<const double*, double*> values;
+	
+	Component *find_component(const Component *c) const;
+	Modulator *find_modulator(const Modulator *m) const;
+
+public:
+	// Counterparts in the clone (null for null)
+	// Throw std::invalid_argument if something isn't part of the cloned circuit
+	Node *node(const Node *n) const;
+	Subcircuit *subcircuit(const Subcircuit *s) const;
+	SubcircuitInstance *instance(const SubcircuitInstance *inst) const;
+	double *value(const double *v) const;
+	
+	template<typename T> T *component(const T *c) const {
+		return static_cast<T*>(find_component(c));
+	}
+	
+	template<typename T> T *modulator(const T *m) const {
+		return static_cast<T*>(find_modulator(m));
+	}
+	
+	friend class Circuit;
+};
+
+}
@@ -1,5 +1,7 @@
 #include "Core/Component.hpp"
 
+#include <stdexcept>
+
 namespace spice {
 
 Component::Component(Circuit *parent_circuit): parent_circuit(parent_circuit) {}
@@ -12,4 +14,12 @@ void Component::save_hist() {}
 
 void Component::clear_hist() {}
 
+Component *Component::clone() const {
+	throw std::logic_error("Component type can't be cloned");
+}
+
+void Component::rebind(Circuit *c, const CloneMap&) {
+	parent_circuit = c;
+}
+
 }
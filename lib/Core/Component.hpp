@@ -7,6 +7,7 @@
 namespace spice {
 
 class Circuit;
+class CloneMap;
 
 class Component {
 protected:
@@ -15,8 +16,15 @@ protected:
 	
 	Component(Circuit *parent);
 	
-	// No copy constructor
-	Component(const Component&) = delete;
+	// Only copied by clone()
+	Component(const Component&) = default;
+	
+	// Copy of this component for a clone of the circuit (see Circuit::clone())
+	// Throws std::logic_error for component types that can't be cloned
+	virtual Component *clone() const;
+	
+	// Point a clone at the clone's circuit, nodes, components, and modulators
+	virtual void rebind(Circuit *c, const CloneMap &map);
 	
 public:
 	virtual ~Component() {}
@@ -0,0 +1,32 @@
+#include "Core/DCSweepResult.hpp"
+#include "Core/TwoTerminalComponent.hpp"
+
+#include <stdexcept>
+
+namespace spice {
+
+const std::vector<double> &DCSweepResult::values() const {
+	return _values;
+}
+
+double DCSweepResult::voltage(const Node *n, size_t ind) const {
+	auto ni = node_map.find(n);
+	if(ni == node_map.end())
+		throw std::invalid_argument("Node not part of the swept circuit");
+	
+	return node_v.at(ind*node_map.size() + ni->second);
+}
+
+double DCSweepResult::voltage(const TwoTerminalComponent *c, size_t ind) const {
+	return voltage(c->top(), ind) - voltage(c->bot(), ind);
+}
+
+double DCSweepResult::current(const TwoTerminalComponent *c, size_t ind) const {
+	auto ci = comp_map.find(c);
+	if(ci == comp_map.end())
+		throw std::invalid_argument("Component not part of the swept circuit");
+	
+	return comp_i.at(ind*comp_map.size() + ci->second);
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+	Node voltages and component currents from a DC sweep
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+namespace spice {
+
+class Node;
+class TwoTerminalComponent;
+
+class DCSweepResult {
+private:
+	std::vector<double> _values;
+	
+	// One row per swept value
+	std::vector<double> node_v;
+	std::vector<double> comp_i;
+	
+	std::unordered_map<const Node*, size_t> node_map;
+	std::unordered_map<const TwoTerminalComponent*, size_t> comp_map;
+	
+public:
+	// Swept values
+	const std::vector<double> &values() const;
+	
+	// Results at the swept value with index ind
+	double voltage(const Node *n, size_t ind) const;
+	double voltage(const TwoTerminalComponent *c, size_t ind) const;
+	double current(const TwoTerminalComponent *c, size_t ind) const;
+	
+	friend class Circuit;
+};
+
+}
@@ -0,0 +1,179 @@
+#include "Core/Ensemble.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/CloneMap.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace spice {
+
+Ensemble::Ensemble(const Circuit &prototype, size_t lanes): lu(lanes) {
+	if(prototype.tlines.size())
+		throw std::logic_error("Circuits with transmission lines can't be simulated in an ensemble");
+	
+	for(size_t l = 0; l < lanes; l++) {
+		maps.emplace_back(new CloneMap);
+		clones.push_back(prototype.clone(maps.back().get()));
+		circuits.push_back(clones.back().get());
+	}
+	
+	factorized_values.resize(lanes);
+}
+
+Circuit &Ensemble::lane(size_t l) {
+	return *circuits.at(l);
+}
+
+const CloneMap &Ensemble::map(size_t l) const {
+	return *maps.at(l);
+}
+
+void Ensemble::check() {
+	const Circuit &first = *circuits.front();
+	const Eigen::SparseMatrix<double> &mat = first.eval_mat;
+	
+	for(Circuit *c:circuits) {
+		const Eigen::SparseMatrix<double> &m = c->eval_mat;
+		if(c->n_vars != first.n_vars || c->system.dimension != first.system.dimension ||
+		   m.nonZeros() != mat.nonZeros() || !m.isCompressed() || !mat.isCompressed() ||
+		   !std::equal(m.outerIndexPtr(), m.outerIndexPtr() + m.outerSize() + 1, mat.outerIndexPtr()) ||
+		   !std::equal(m.innerIndexPtr(), m.innerIndexPtr() + m.nonZeros(), mat.innerIndexPtr()))
+			throw std::runtime_error("Ensemble lanes have different circuit matrices");
+	}
+	
+	lu_pend = true;
+	for(auto &values:factorized_values)
+		values.clear();
+}
+
+void Ensemble::solve_linear_lanes(const std::vector<char> &done) {
+	const size_t lanes = circuits.size();
+	
+	bool changed = false;
+	for(size_t l = 0; l < lanes; l++) {
+		if(done[l])
+			continue;
+		
+		Circuit &c = *circuits[l];
+		c.eval_matrix();
+		
+		// The lane's own solver doesn't hold this factorization
+		c.factorized_values.clear();
+		
+		changed |= factorized_values[l].size() != (size_t)c.eval_mat.nonZeros() ||
+		           !std::equal(factorized_values[l].begin(), factorized_values[l].end(), c.eval_mat.valuePtr());
+	}
+	
+	// Matrices stay the same with a constant timestep, or while Newton iteration keeps Jacobians
+	if(changed) {
+		std::vector<const double*> values(lanes);
+		for(size_t l = 0; l < lanes; l++) {
+			const Eigen::SparseMatrix<double> &mat = circuits[l]->eval_mat;
+			values[l] = mat.valuePtr();
+			factorized_values[l].assign(mat.valuePtr(), mat.valuePtr() + mat.nonZeros());
+		}
+		
+		if(lu_pend) {
+			lu.analyze(circuits.front()->eval_mat);
+			lu_pend = false;
+		}
+		
+		lu.factorize(values);
+		
+		// Pivot order chosen for values that changed too much; choose it again from a failed lane
+		size_t failed = 0;
+		for(size_t l = 0; l < lanes; l++)
+			failed += !lu.lane_ok(l);
+		
+		if(2*failed > lanes) {
+			for(size_t l = 0; l < lanes; l++)
+				if(!lu.lane_ok(l)) {
+					lu.analyze(circuits[l]->eval_mat);
+					break;
+				}
+			
+			lu.factorize(values);
+		}
+	}
+	
+	const size_t n = circuits.front()->n_vars;
+	std::vector<double> rhs(n*lanes);
+	for(size_t l = 0; l < lanes; l++) {
+		const Eigen::VectorXd &vec = circuits[l]->eval_vec;
+		for(size_t row = 0; row < n; row++)
+			rhs[row*lanes + l] = vec[row];
+	}
+	
+	lu.solve(rhs.data());
+	
+	for(size_t l = 0; l < lanes; l++) {
+		if(done[l])
+			continue;
+		
+		Circuit &c = *circuits[l];
+		
+		// Solution written in place since node voltages reference it
+		if(lu.lane_ok(l)) {
+			for(size_t row = 0; row < n; row++)
+				c.solved_vec[row] = rhs[row*lanes + l];
+		}
+		
+		// Lanes that need other pivots are solved on their own
+		else {
+			c.factorize_double();
+			c.factorized_values.assign(c.eval_mat.valuePtr(), c.eval_mat.valuePtr() + c.eval_mat.nonZeros());
+			c.factorized_single = false;
+			c.solved_vec = c.solve_factorized(c.eval_vec);
+		}
+	}
+}
+
+void Ensemble::solve_all() {
+	const size_t lanes = circuits.size();
+	std::vector<char> done(lanes, false);
+	
+	const Circuit &first = *circuits.front();
+	if(first.nonlinear_comps.empty() && first.behavioral_comps.empty()) {
+		solve_linear_lanes(done);
+		return;
+	}
+	
+	// Newton-Raphson iteration as in Circuit::solve_matrix(), with each lane stopping once it converged
+	std::vector<char> update_jacobian(lanes), limited(lanes);
+	std::vector<double> last_dv(lanes, std::numeric_limits<double>::max());
+	for(size_t l = 0; l < lanes; l++)
+		update_jacobian[l] = !circuits[l]->modified_newton || !circuits[l]->newton_jacobian_valid;
+	
+	for(unsigned int iter = 0; iter < first.max_newton_iterations; iter++) {
+		for(size_t l = 0; l < lanes; l++)
+			if(!done[l])
+				limited[l] = circuits[l]->linearize_nonlinear(update_jacobian[l]);
+		
+		solve_linear_lanes(done);
+		
+		bool all_done = true;
+		for(size_t l = 0; l < lanes; l++) {
+			if(done[l])
+				continue;
+			
+			Circuit &c = *circuits[l];
+			double dv;
+			if(c.newton_converged(limited[l], dv)) {
+				done[l] = true;
+				continue;
+			}
+			
+			update_jacobian[l] = !c.modified_newton || limited[l] || dv > 0.5*last_dv[l];
+			last_dv[l] = dv;
+			all_done = false;
+		}
+		
+		if(all_done)
+			return;
+	}
+	
+	throw std::runtime_error("Newton iteration did not converge");
+}
+
+}
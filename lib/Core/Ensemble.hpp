@@ -0,0 +1,56 @@
+/*
+	Simulate copies of a circuit with different parameter values in lockstep: every variant (lane)
+	shares the matrix pattern, pivot order, and timesteps, and the lanes' matrices are factorized
+	and solved together, interleaved so the arithmetic runs across lanes in vector instructions
+*/
+
+#pragma once
+
+#include "Core/CircuitGroup.hpp"
+#include "Core/LaneLU.hpp"
+
+#include <vector>
+#include <memory>
+
+namespace spice {
+
+class Circuit;
+class CloneMap;
+
+class Ensemble: public CircuitGroup {
+private:
+	// Lanes' circuits and their counterparts of the prototype's parts
+	std::vector<std::unique_ptr<Circuit>> clones;
+	std::vector<std::unique_ptr<CloneMap>> maps;
+	
+	// Factorization shared by all lanes, and each lane's matrix values at the last factorization
+	LaneLU lu;
+	bool lu_pend = true;
+	std::vector<std::vector<double>> factorized_values;
+	
+	// Check that every lane has the same matrix pattern
+	virtual void check();
+	
+	// Newton iteration on every lane at once
+	virtual void solve_all();
+	
+	// Evaluate and solve the matrices of the lanes not marked as done
+	void solve_linear_lanes(const std::vector<char> &done);
+
+public:
+	// Clone the prototype into each lane, to be given its own parameter values before simulating
+	// (each lane's map gives its counterparts of the prototype's parts)
+	// Throws std::logic_error for circuits with transmission lines, which need steps of their own
+	Ensemble(const Circuit &prototype, size_t lanes);
+	
+	// A lane's circuit, and its counterparts of the prototype's parts
+	// Parameters must not change the lane's topology
+	Circuit &lane(size_t l);
+	const CloneMap &map(size_t l) const;
+	
+	// A lane whose matrix can't use the shared pivot order is factorized on its own
+	// Throws std::runtime_error if the lanes' matrices don't have the same pattern
+	using CircuitGroup::sim_to_time;
+};
+
+}
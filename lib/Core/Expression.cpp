@@ -1,5 +1,8 @@
 #include "Core/Expression.hpp"
 
+#include <stdexcept>
+#include <cmath>
+
 namespace spice {
 
 double Term::eval() const {
@@ -22,6 +25,46 @@ double Term::eval() const {
 	return num_d / den_d;
 }
 
+bool Term::operator==(const Term &other) const {
+	return coeff == other.coeff && num == other.num && den == other.den && func == other.func;
+}
+
+bool Term::operator!=(const Term &other) const {
+	return !(*this == other);
+}
+
+double Term::derivative(const double *ref) const {
+	// Term is rest * ref^power
+	int power = 0;
+	double num_d = coeff;
+	double den_d = 1;
+	
+	if(func)
+		num_d *= (*func)();
+	
+	for(const double *n:num) {
+		if(n == ref)
+			power++;
+		else
+			num_d *= *n;
+	}
+	
+	for(const double *d:den) {
+		if(d == ref)
+			power--;
+		else
+			den_d *= *d;
+	}
+	
+	if(!power)
+		return 0;
+	
+	if(den_d == 0)
+		throw std::invalid_argument("Division by zero");
+	
+	return power * std::pow(*ref, power - 1) * num_d / den_d;
+}
+
 double Expression::eval() const {
 	double ret = 0;
 	
@@ -28,6 +28,13 @@ struct Term {
 		Term(1.0, {}, {}, func) {}
 	
 	double eval() const;
+	
+	// Partial derivative with respect to the value behind ref
+	double derivative(const double *ref) const;
+	
+	// Same coefficient, references, and function
+	bool operator==(const Term &other) const;
+	bool operator!=(const Term &other) const;
 };
 
 // Sum of multiple terms
@@ -31,8 +31,28 @@ void IntegratingComponent::gen_initial_cond() {
 	throw std::runtime_error("Component requires explicitly specified initial condition");
 }
 
+Expression IntegratingComponent::scaled_state(double coeff, std::vector<const double *> num, std::vector<const double *> den) const {
+	Expression expr = state_expr;
+	
+	for(Term &t:expr) {
+		t.coeff *= coeff;
+		t.num.insert(t.num.end(), num.begin(), num.end());
+		t.den.insert(t.den.end(), den.begin(), den.end());
+	}
+	
+	return expr;
+}
+
 Expression IntegratingComponent::dydt_expr() const {
 	return {};
 }
 
+void IntegratingComponent::rebind(Circuit *c, const CloneMap &map) {
+	TwoTerminalComponent::rebind(c, map);
+	
+	// States are assigned again with the clone's matrix
+	var = nullptr;
+	state_expr.clear();
+}
+
 }
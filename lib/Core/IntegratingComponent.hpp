@@ -15,6 +15,15 @@ protected:
 	const double *var = nullptr;
 	double initial_cond = 0;
 	
+	// Expression for the state used in V/I expressions
+	// Either just var, or a combination of other components' states when this component's state
+	// is algebraically dependent on them (capacitor loops, inductor cutsets) and var isn't used
+	// Set by the Circuit class
+	Expression state_expr;
+	
+	// Return state_expr with every term multiplied by coeff and the given references
+	Expression scaled_state(double coeff, std::vector<const double *> num = {}, std::vector<const double *> den = {}) const;
+	
 	// DC solution will be used to set initial_cond if false
 	bool initial_cond_specified = false;
 	
@@ -23,6 +32,8 @@ protected:
 	
 	// Expression to be integrated to find var
 	virtual Expression dydt_expr() const;
+	
+	virtual void rebind(Circuit *c, const CloneMap &map);
 
 public:
 	IntegratingComponent(Circuit *parent, double value);
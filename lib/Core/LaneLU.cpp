@@ -0,0 +1,184 @@
+#include "Core/LaneLU.hpp"
+
+#include <Eigen/Dense>
+
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+namespace spice {
+
+// Lanes are processed in blocks of a fixed width, so the innermost loops have a constant trip count
+// and vectorize without remainder loops or aliasing checks (8 doubles fill one AVX-512 register)
+static const size_t block = 8;
+
+// a -= l*b over one block of lanes
+static inline void sub_product(double * __restrict a, const double * __restrict l, const double * __restrict b) {
+	for(size_t lane = 0; lane < block; lane++)
+		a[lane] -= l[lane]*b[lane];
+}
+
+// a = max(a, |b|) over one block of lanes
+static inline void max_abs(double * __restrict a, const double * __restrict b) {
+	for(size_t lane = 0; lane < block; lane++)
+		a[lane] = std::max(a[lane], std::abs(b[lane]));
+}
+
+// a *= b over one block of lanes
+static inline void product(double * __restrict a, const double * __restrict b) {
+	for(size_t lane = 0; lane < block; lane++)
+		a[lane] *= b[lane];
+}
+
+LaneLU::LaneLU(size_t lanes): lanes(lanes), stride((lanes + block - 1)/block*block) {
+	if(!lanes)
+		throw std::invalid_argument("LaneLU needs at least one lane");
+}
+
+void LaneLU::analyze(const Eigen::SparseMatrix<double> &mat) {
+	if(mat.rows() != mat.cols())
+		throw std::invalid_argument("LaneLU needs a square matrix");
+	
+	n = mat.rows();
+	
+	// Pivot order from a dense partial-pivoting factorization of the given values
+	const Eigen::PartialPivLU<Eigen::MatrixXd> plu{Eigen::MatrixXd(mat)};
+	row_pos.assign(plu.permutationP().indices().data(), plu.permutationP().indices().data() + n);
+	
+	// Pattern in pivot order
+	std::vector<std::vector<char>> nonzero(n, std::vector<char>(n, false));
+	slots.clear();
+	for(Eigen::Index col = 0; col < mat.outerSize(); col++)
+		for(Eigen::SparseMatrix<double>::InnerIterator it(mat, col); it; ++it) {
+			const size_t row = row_pos[it.row()];
+			nonzero[row][col] = true;
+			slots.push_back(row*n + col);
+		}
+	
+	// Symbolic elimination: each row below a pivot with an entry in its column
+	// gets entries in every column the pivot row has one in
+	lower.assign(n, {});
+	upper.assign(n, {});
+	for(size_t k = 0; k < n; k++) {
+		for(size_t col = k + 1; col < n; col++)
+			if(nonzero[k][col])
+				upper[k].push_back(col);
+		
+		for(size_t row = k + 1; row < n; row++)
+			if(nonzero[row][k]) {
+				lower[k].push_back(row);
+				for(size_t col:upper[k])
+					nonzero[row][col] = true;
+			}
+	}
+	
+	pattern.clear();
+	for(size_t row = 0; row < n; row++)
+		for(size_t col = 0; col < n; col++)
+			if(nonzero[row][col])
+				pattern.push_back(row*n + col);
+	
+	lu.assign(n*n*stride, 0);
+	inv_pivots.assign(n*stride, 0);
+	largest.assign(stride, 0);
+	x.assign(n*stride, 0);
+	ok.assign(lanes, false);
+	_analyzed = true;
+}
+
+bool LaneLU::analyzed() const {
+	return _analyzed;
+}
+
+void LaneLU::factorize(const std::vector<const double*> &values) {
+	if(!_analyzed)
+		throw std::logic_error("LaneLU factorized before analyzing");
+	if(values.size() != lanes)
+		throw std::invalid_argument("LaneLU needs values for every lane");
+	
+	// Entries outside the pattern are never written, and padding lanes stay zero
+	for(size_t pos:pattern)
+		std::fill_n(&lu[pos*stride], stride, 0.0);
+	for(size_t ind = 0; ind < slots.size(); ind++) {
+		double *entry = &lu[slots[ind]*stride];
+		for(size_t lane = 0; lane < lanes; lane++)
+			entry[lane] = values[lane][ind];
+	}
+	
+	std::fill(ok.begin(), ok.end(), true);
+	
+	for(size_t k = 0; k < n; k++) {
+		const double *pivot = &lu[(k*n + k)*stride];
+		double *inv = &inv_pivots[k*stride];
+		
+		// A pivot too small next to the entries below it would need a row exchange
+		std::fill(largest.begin(), largest.end(), 0.0);
+		for(size_t row:lower[k])
+			for(size_t b = 0; b < stride; b += block)
+				max_abs(&largest[b], &lu[(row*n + k)*stride + b]);
+		
+		for(size_t lane = 0; lane < lanes; lane++) {
+			const double p = std::abs(pivot[lane]);
+			if(!(p > 0) || !std::isfinite(p) || p < pivot_threshold*largest[lane])
+				ok[lane] = false;
+			
+			// Failed lanes carry on with zeros instead of dividing by their pivots
+			inv[lane] = ok[lane] ? 1/pivot[lane] : 0;
+		}
+		
+		for(size_t row:lower[k]) {
+			double *l = &lu[(row*n + k)*stride];
+			for(size_t b = 0; b < stride; b += block)
+				product(l + b, inv + b);
+			
+			for(size_t col:upper[k]) {
+				double *a = &lu[(row*n + col)*stride];
+				const double *u = &lu[(k*n + col)*stride];
+				for(size_t b = 0; b < stride; b += block)
+					sub_product(a + b, l + b, u + b);
+			}
+		}
+	}
+}
+
+bool LaneLU::lane_ok(size_t lane) const {
+	return ok.at(lane);
+}
+
+void LaneLU::solve(double *rhs) const {
+	// Rows in pivot order, with padding lanes
+	std::fill(x.begin(), x.end(), 0.0);
+	for(size_t row = 0; row < n; row++)
+		std::copy(rhs + row*lanes, rhs + (row + 1)*lanes, &x[row_pos[row]*stride]);
+	
+	// Forward substitution (L has a unit diagonal)
+	for(size_t k = 0; k < n; k++) {
+		const double *xk = &x[k*stride];
+		for(size_t row:lower[k]) {
+			double *xr = &x[row*stride];
+			const double *l = &lu[(row*n + k)*stride];
+			for(size_t b = 0; b < stride; b += block)
+				sub_product(xr + b, l + b, xk + b);
+		}
+	}
+	
+	// Back substitution
+	for(size_t k = n; k-- > 0;) {
+		double *xk = &x[k*stride];
+		for(size_t col:upper[k]) {
+			const double *xc = &x[col*stride];
+			const double *u = &lu[(k*n + col)*stride];
+			for(size_t b = 0; b < stride; b += block)
+				sub_product(xk + b, u + b, xc + b);
+		}
+		
+		const double *inv = &inv_pivots[k*stride];
+		for(size_t b = 0; b < stride; b += block)
+			product(xk + b, inv + b);
+	}
+	
+	for(size_t row = 0; row < n; row++)
+		std::copy(&x[row*stride], &x[row*stride] + lanes, rhs + row*lanes);
+}
+
+}
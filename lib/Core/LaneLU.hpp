@@ -0,0 +1,78 @@
+/*
+	LU factorization of many matrices with the same sparsity pattern at once
+	The matrices share one pivot order and fill-in pattern, and are stored interleaved
+	(entry by entry, one lane per matrix) so every operation runs across all lanes
+	in fixed-width blocks, which the compiler vectorizes at -O2
+	Build with LIBSPICE_NATIVE to use the widest vectors of the build machine
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-but-set-variable"
+#include <Eigen/Sparse>
+#pragma clang diagnostic pop
+
+namespace spice {
+
+class LaneLU {
+private:
+	size_t lanes;
+	
+	// Lanes rounded up to whole blocks
+	size_t stride;
+	
+	size_t n = 0;
+	bool _analyzed = false;
+	
+	// Position of each row of the matrices in the pivot order
+	std::vector<size_t> row_pos;
+	
+	// Where each stored entry of the pattern (in compressed order) goes in the dense factors
+	std::vector<size_t> slots;
+	
+	// For each pivot, the rows below it with an entry in its column
+	// and the columns right of it with an entry in its row (including fill-in)
+	std::vector<std::vector<size_t>> lower, upper;
+	
+	// Entries of the factors, including fill-in (row*n + col)
+	std::vector<size_t> pattern;
+	
+	// Dense factors: entry (row, col) of lane l at (row*n + col)*stride + l
+	std::vector<double> lu;
+	
+	// Inverse of each lane's pivots: pivot k of lane l at k*stride + l
+	std::vector<double> inv_pivots;
+	
+	// Largest entry below the current pivot in each lane
+	std::vector<double> largest;
+	
+	// Lanes whose factorization is usable
+	std::vector<char> ok;
+	
+	// Solution being substituted: row r (in pivot order) of lane l at r*stride + l
+	mutable std::vector<double> x;
+
+public:
+	LaneLU(size_t lanes);
+	
+	// Smallest pivot, relative to the largest entry below it, a lane accepts (threshold pivoting)
+	double pivot_threshold = 1e-3;
+	
+	// Choose the pivot order from a matrix (partial pivoting) and find the fill-in of its pattern
+	void analyze(const Eigen::SparseMatrix<double> &mat);
+	bool analyzed() const;
+	
+	// Factorize one matrix per lane with the analyzed pattern, given each lane's values in compressed order
+	// A lane that needs pivots other than the shared ones is marked as failed
+	void factorize(const std::vector<const double*> &values);
+	bool lane_ok(size_t lane) const;
+	
+	// Solve in place for the right-hand side of every lane: row r of lane l at r*lanes + l
+	void solve(double *rhs) const;
+};
+
+}
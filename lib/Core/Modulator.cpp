@@ -1,6 +1,8 @@
 #include "Core/Modulator.hpp"
+#include "Core/CloneMap.hpp"
 
 #include <limits>
+#include <stdexcept>
 
 namespace spice {
 
@@ -16,6 +18,19 @@ bool Modulator::continuous() const {
 	return true;
 }
 
+Modulator *Modulator::clone() const {
+	throw std::logic_error("Modulator type can't be cloned");
+}
+
+void Modulator::rebind(Circuit *c, const CloneMap &map) {
+	parent_circuit = c;
+	
+	std::unordered_map<double*, int> old_controlled;
+	old_controlled.swap(controlled);
+	for(auto &ctrl:old_controlled)
+		controlled[map.value(ctrl.first)] = ctrl.second;
+}
+
 double Modulator::next_change_time() {
 	return std::numeric_limits<double>::max();
 }
@@ -10,6 +10,7 @@
 namespace spice {
 
 class Circuit;
+class CloneMap;
 
 class Modulator {
 protected:
@@ -31,6 +32,13 @@ protected:
 	// apply() will be called in the RK integration substeps if true
 	virtual bool continuous() const;
 	
+	// Copy of this modulator (with its state) for a clone of the circuit (see Circuit::clone())
+	// Throws std::logic_error for modulator types that can't be cloned
+	virtual Modulator *clone() const;
+	
+	// Point a clone at the clone's circuit and the values of the cloned components
+	virtual void rebind(Circuit *c, const CloneMap &map);
+	
 public:
 	virtual ~Modulator() {}
 	
@@ -40,6 +48,7 @@ public:
 	
 	friend class Circuit;
 	friend class TwoTerminalComponent;
+	friend class CircuitGroup;
 };
 
 }
@@ -30,12 +30,12 @@ TwoTerminalComponent *Node::to(TwoTerminalComponent *c) {
 	if(parent_circuit != c->parent_circuit)
 		throw std::invalid_argument("Component not in the same circuit");
 	
-	// Circuit topology changed...
-	parent_circuit->topology_changed();
-	
 	// Tell component about this node
 	if(c->node_top)
 		throw std::invalid_argument("Component already connected");
+	
+	// This node's connections changed...
+	parent_circuit->connections_changed({this});
 	c->node_top = this;
 	
 	// Current exiting this node
@@ -55,6 +55,7 @@ public:
 	
 	friend class Circuit;
 	friend class TwoTerminalComponent;
+	friend class TransmissionLine;
 };
 
 }
@@ -0,0 +1,47 @@
+#include "Core/NonlinearComponent.hpp"
+#include "Core/Node.hpp"
+
+#include <cmath>
+
+namespace spice {
+
+double NonlinearComponent::limit_voltage(double v_new, double) const {
+	return v_new;
+}
+
+bool NonlinearComponent::linearize(bool update_jacobian, double bypass_tol) {
+	const double v_solved = voltage();
+	
+	// Bypass: model already linearized close enough to this voltage
+	if(std::abs(v_solved - v_lin) < bypass_tol && !update_jacobian)
+		return false;
+	
+	const double v = limit_voltage(v_solved, v_lin);
+	
+	double i, g;
+	eval(v, i, g);
+	
+	if(update_jacobian)
+		G = g;
+	
+	// Companion current source so the linear model passes through (v, i) with slope G
+	Ieq = i - G*v;
+	v_lin = v;
+	
+	return v != v_solved;
+}
+
+std::complex<double> NonlinearComponent::ac_admittance(double) const {
+	double i, g;
+	eval(voltage(), i, g);
+	return g;
+}
+
+Expression NonlinearComponent::dc_i_expr() const {
+	// I = G*(Vtop - Vbottom) + Ieq
+	return {{ 1, {&G, node_top->v()}},
+	        {-1, {&G, node_bot->v()}},
+	        { 1, {&Ieq}}};
+}
+
+}
@@ -0,0 +1,47 @@
+/*
+	Generic class for a two-terminal component with a nonlinear V/I relationship
+	solved with Newton-Raphson iteration
+*/
+
+#pragma once
+
+#include "Core/TwoTerminalComponent.hpp"
+
+namespace spice {
+
+class NonlinearComponent: public TwoTerminalComponent {
+protected:
+	// Linearized (companion) model around v_lin: I = G*(Vtop - Vbottom) + Ieq
+	// Referenced by the circuit matrix expressions, updated by linearize()
+	double G = 0;
+	double Ieq = 0;
+	
+	// Voltage the model was last linearized around
+	double v_lin = 0;
+	
+	// Device equation: current and its derivative with respect to voltage at v
+	virtual void eval(double v, double &i, double &g) const = 0;
+	
+	// Limit the change of voltage between Newton iterations to keep the iteration from diverging
+	// Return the voltage the model should be linearized around
+	virtual double limit_voltage(double v_new, double v_old) const;
+	
+	// Linearize the model around the present solution
+	// Keeps G from the previous linearization unless update_jacobian is set (modified Newton),
+	// and skips evaluating the model entirely when the voltage moved less than bypass_tol
+	// Return true if the voltage had to be limited
+	bool linearize(bool update_jacobian, double bypass_tol);
+	
+	virtual Expression dc_i_expr() const;
+	
+	// Small-signal conductance at the present voltage
+	virtual std::complex<double> ac_admittance(double omega) const;
+	
+public:
+	// Inherit constructors
+	using TwoTerminalComponent::TwoTerminalComponent;
+	
+	friend class Circuit;
+};
+
+}
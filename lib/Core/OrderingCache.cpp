@@ -0,0 +1,140 @@
+#include "Core/OrderingCache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <random>
+
+namespace spice {
+
+std::mutex OrderingCache::mutex;
+std::unordered_map<uint64_t, std::vector<int>> OrderingCache::orderings;
+std::string OrderingCache::directory;
+unsigned long OrderingCache::n_hits = 0, OrderingCache::n_misses = 0;
+
+std::string OrderingCache::path(uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ord", (unsigned long long)key);
+	return (std::filesystem::path(directory) / name).string();
+}
+
+uint64_t OrderingCache::fingerprint(int64_t rows, int64_t cols, const int *outer, const int *inner) {
+	// FNV-1a over the dimensions, column starts and row indices
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&](uint64_t val) {
+		for(int byte = 0; byte < 8; byte++) {
+			hash ^= (val >> (8*byte)) & 0xff;
+			hash *= 0x100000001b3ull;
+		}
+	};
+	
+	mix(rows);
+	mix(cols);
+	for(int64_t col = 0; col <= cols; col++)
+		mix(outer[col]);
+	for(int ind = 0; ind < outer[cols]; ind++)
+		mix(inner[ind]);
+	
+	return hash;
+}
+
+bool OrderingCache::find(uint64_t key, size_t n, std::vector<int> &perm) {
+	std::lock_guard<std::mutex> lock(mutex);
+	
+	auto it = orderings.find(key);
+	if(it != orderings.end() && it->second.size() == n) {
+		perm = it->second;
+		n_hits++;
+		return true;
+	}
+	
+	if(!directory.empty()) {
+		std::ifstream file(path(key), std::ios::binary);
+		uint64_t size = 0;
+		
+		if(file.read((char*)&size, sizeof(size)) && size == n) {
+			perm.resize(n);
+			file.read((char*)perm.data(), n*sizeof(int));
+			
+			// Only trust files that hold a whole permutation
+			std::vector<bool> seen(n, false);
+			bool valid = (bool)file;
+			for(size_t ind = 0; valid && ind < n; ind++) {
+				valid = perm[ind] >= 0 && (size_t)perm[ind] < n && !seen[perm[ind]];
+				if(valid)
+					seen[perm[ind]] = true;
+			}
+			
+			if(valid) {
+				orderings[key] = perm;
+				n_hits++;
+				return true;
+			}
+		}
+	}
+	
+	n_misses++;
+	return false;
+}
+
+void OrderingCache::store(uint64_t key, const std::vector<int> &perm) {
+	std::lock_guard<std::mutex> lock(mutex);
+	orderings[key] = perm;
+	
+	if(directory.empty())
+		return;
+	
+	// Written under a unique name and renamed, so other processes never read a partial file
+	// Failing to write only means it's computed again next time
+	const std::string final_path = path(key);
+	const std::string tmp_path = final_path + "." + std::to_string(std::random_device()()) + ".tmp";
+	
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		const uint64_t size = perm.size();
+		file.write((const char*)&size, sizeof(size));
+		file.write((const char*)perm.data(), perm.size()*sizeof(int));
+		
+		if(!file) {
+			file.close();
+			std::remove(tmp_path.c_str());
+			return;
+		}
+	}
+	
+	std::error_code err;
+	std::filesystem::rename(tmp_path, final_path, err);
+	if(err)
+		std::remove(tmp_path.c_str());
+}
+
+void OrderingCache::set_directory(const std::string &dir) {
+	std::lock_guard<std::mutex> lock(mutex);
+	
+	if(!dir.empty()) {
+		std::error_code err;
+		std::filesystem::create_directories(dir, err);
+		if(err || !std::filesystem::is_directory(dir))
+			throw std::runtime_error("Can't use ordering cache directory " + dir + ": " + err.message());
+	}
+	
+	directory = dir;
+}
+
+void OrderingCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	orderings.clear();
+}
+
+unsigned long OrderingCache::hits() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return n_hits;
+}
+
+unsigned long OrderingCache::misses() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return n_misses;
+}
+
+}
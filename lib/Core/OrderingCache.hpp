@@ -0,0 +1,87 @@
+/*
+	Process-wide cache of fill-reducing column orderings for sparse LU factorization,
+	keyed by a fingerprint of the sparsity pattern and optionally persisted to a directory
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include <Eigen/Core>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-but-set-variable"
+#include <Eigen/Sparse>
+#include <Eigen/OrderingMethods>
+#pragma clang diagnostic pop
+
+namespace spice {
+
+class OrderingCache {
+private:
+	static std::mutex mutex;
+	static std::unordered_map<uint64_t, std::vector<int>> orderings;
+	static std::string directory;
+	static unsigned long n_hits, n_misses;
+	
+	// File an ordering is persisted to
+	static std::string path(uint64_t key);
+
+public:
+	// Hash of a compressed column-major pattern (dimensions and the row indices of each column)
+	// Circuits built the same way have the same matrix pattern, and so the same fingerprint
+	static uint64_t fingerprint(int64_t rows, int64_t cols, const int *outer, const int *inner);
+	
+	// Look up the column permutation for a pattern, in memory or in the cache directory
+	// Return false if it isn't cached (or the cached one isn't a permutation of size n)
+	static bool find(uint64_t key, size_t n, std::vector<int> &perm);
+	
+	// Remember a column permutation, writing it to the cache directory if there is one
+	static void store(uint64_t key, const std::vector<int> &perm);
+	
+	// Persist orderings as files in a directory (created if needed), and look for them there
+	// Empty to only keep them in memory
+	static void set_directory(const std::string &dir);
+	
+	// Forget the orderings held in memory
+	static void clear();
+	
+	// Number of lookups that found an ordering or didn't
+	static unsigned long hits();
+	static unsigned long misses();
+};
+
+// Drop-in replacement for Eigen::COLAMDOrdering that only runs COLAMD on patterns
+// not seen before (in this process or, with a cache directory, any other)
+// Any column permutation gives a correct factorization, so a fingerprint collision
+// can only cost fill-in
+template<typename StorageIndex> class CachedOrdering {
+public:
+	typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, StorageIndex> PermutationType;
+	
+	template<typename MatrixType> void operator()(const MatrixType &mat, PermutationType &perm) {
+		if(!mat.isCompressed() || sizeof(StorageIndex) != sizeof(int)) {
+			Eigen::COLAMDOrdering<StorageIndex>()(mat, perm);
+			return;
+		}
+		
+		const uint64_t key = OrderingCache::fingerprint(mat.rows(), mat.cols(), (const int*)mat.outerIndexPtr(), (const int*)mat.innerIndexPtr());
+		
+		std::vector<int> indices;
+		if(OrderingCache::find(key, mat.cols(), indices)) {
+			perm.resize(mat.cols());
+			for(Eigen::Index ind = 0; ind < mat.cols(); ind++)
+				perm.indices()(ind) = indices[ind];
+			return;
+		}
+		
+		Eigen::COLAMDOrdering<StorageIndex>()(mat, perm);
+		OrderingCache::store(key, std::vector<int>(perm.indices().data(), perm.indices().data() + perm.size()));
+	}
+};
+
+}
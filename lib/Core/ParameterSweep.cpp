@@ -0,0 +1,266 @@
+#include "Core/ParameterSweep.hpp"
+#include "Core/Circuit.hpp"
+#include "Core/CloneMap.hpp"
+#include "Core/Node.hpp"
+#include "Core/TwoTerminalComponent.hpp"
+#include "Core/ThreadPool.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace spice {
+
+ParameterSweep::ParameterSweep(const Circuit &prototype): prototype(prototype) {}
+
+ParameterSweep::ParameterSweep(const Circuit &prototype, Factory factory): prototype(prototype), factory(std::move(factory)) {}
+
+size_t ParameterSweep::add_param(const TwoTerminalComponent *comp, std::vector<double> values) {
+	return add_param([comp](Circuit&, const CloneMap &map, double value) {
+		map.component(comp)->set_value(value);
+	}, std::move(values));
+}
+
+size_t ParameterSweep::add_param(Setter set, std::vector<double> values) {
+	if(values.empty())
+		throw std::invalid_argument("Parameter needs at least one value");
+	
+	params.push_back({std::move(set), std::move(values)});
+	return params.size() - 1;
+}
+
+size_t ParameterSweep::add_voltage(const Node *n) {
+	return add_output([n](const Circuit&, const CloneMap &map) {
+		return map.node(n)->voltage();
+	});
+}
+
+size_t ParameterSweep::add_voltage(const TwoTerminalComponent *comp) {
+	return add_output([comp](const Circuit&, const CloneMap &map) {
+		return map.component(comp)->voltage();
+	});
+}
+
+size_t ParameterSweep::add_current(const TwoTerminalComponent *comp) {
+	return add_output([comp](const Circuit&, const CloneMap &map) {
+		return map.component(comp)->current();
+	});
+}
+
+size_t ParameterSweep::add_output(Output output) {
+	outputs.push_back(std::move(output));
+	return outputs.size() - 1;
+}
+
+size_t ParameterSweep::n_variants() const {
+	size_t n = 1;
+	for(const Param &p:params)
+		n *= p.values.size();
+	return n;
+}
+
+ParameterSweepResult ParameterSweep::gen_result() const {
+	const size_t n = n_variants();
+	const size_t n_params = params.size();
+	ParameterSweepResult result(n, n_params, outputs.size());
+	
+	// Parameter values of each variant (last axis varying fastest)
+	for(size_t variant = 0; variant < n; variant++) {
+		size_t rest = variant;
+		for(size_t ind = n_params; ind-- > 0;) {
+			const std::vector<double> &values = params[ind].values;
+			result._params[variant*n_params + ind] = values[rest % values.size()];
+			rest /= values.size();
+		}
+	}
+	
+	return result;
+}
+
+ParameterSweepResult ParameterSweep::run(double stop) {
+	if(prototype.instances.size())
+		throw std::logic_error("Circuits with subcircuit instances can't be swept in parallel");
+	
+	ParameterSweepResult result = gen_result();
+	const size_t n = result.size();
+	const size_t n_params = params.size(), n_outputs = outputs.size();
+	
+	// A transient state can only be restored by cloning the prototype again
+	const bool clone_each = !factory && prototype.simulation_mode == Circuit::TRANSIENT_ANALYSIS;
+	
+	ThreadPool pool(n_threads);
+	
+	// Circuit of each thread and its counterparts of the prototype's parts
+	struct Worker {
+		std::unique_ptr<Circuit> circuit;
+		CloneMap map;
+	};
+	
+	std::vector<Worker> workers(pool.size());
+	
+	pool.parallel_tasks(n, [&](size_t variant, unsigned int thread) {
+		Worker &w = workers[thread];
+		double *out = &result._outputs[variant*n_outputs];
+		
+		try {
+			if(clone_each || !w.circuit) {
+				w.circuit.reset();
+				if(factory) {
+					w.circuit = factory();
+					prototype.map_parts(*w.circuit, w.map);
+				}
+				else
+					w.circuit = prototype.clone(&w.map);
+				
+				w.circuit->n_threads = 1;
+			}
+			else
+				w.circuit->reset();
+			
+			Circuit &c = *w.circuit;
+			for(size_t ind = 0; ind < n_params; ind++)
+				params[ind].set(c, w.map, result._params[variant*n_params + ind]);
+			
+			c.sim_to_time(stop);
+			
+			for(size_t ind = 0; ind < n_outputs; ind++)
+				out[ind] = outputs[ind](c, w.map);
+		}
+		catch(const std::exception &e) {
+			result._errors[variant] = *e.what() ? e.what() : "Variant failed";
+			std::fill(out, out + n_outputs, std::numeric_limits<double>::quiet_NaN());
+			
+			// The circuit could have been left in any state
+			w.circuit.reset();
+		}
+	});
+	
+	return result;
+}
+
+ParameterSweepResult ParameterSweep::run_processes(Circuit &c, double stop) {
+	if(&c != &prototype)
+		throw std::invalid_argument("Processes must run the sweep's own prototype");
+	
+	ParameterSweepResult result = gen_result();
+	const size_t n = result.size();
+	const size_t n_params = params.size(), n_outputs = outputs.size();
+	
+	// Area shared with the workers: each variant's outputs, then its error message
+	static const size_t error_len = 256;
+	const size_t output_bytes = n*n_outputs*sizeof(double);
+	const size_t bytes = output_bytes + n*error_len;
+	
+	void *area = mmap(nullptr, std::max<size_t>(bytes, 1), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(area == MAP_FAILED)
+		throw std::runtime_error(std::string("Can't map sweep results: ") + strerror(errno));
+	
+	double *shared_outputs = (double*)area;
+	char *shared_errors = (char*)area + output_bytes;
+	
+	// Every process has its own copy of the prototype, so it's changed in place there
+	CloneMap map;
+	prototype.map_parts(c, map);
+	
+	// A forked process only has the thread that forked it, so the prototype's pool
+	// is replaced by one without workers first
+	const unsigned int saved_threads = c.n_threads;
+	c.n_threads = 1;
+	c.thread_pool();
+	
+	const size_t max_workers = n_processes ? n_processes : std::max(1u, std::thread::hardware_concurrency());
+	std::unordered_map<pid_t, size_t> running;
+	
+	auto fail = [&](size_t variant, const std::string &error) {
+		result._errors[variant] = error;
+		std::fill(&result._outputs[variant*n_outputs], &result._outputs[(variant + 1)*n_outputs], std::numeric_limits<double>::quiet_NaN());
+	};
+	
+	// Wait for any worker to finish and collect its variant
+	auto reap = [&]() {
+		int status;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if(pid < 0) {
+			if(errno == EINTR)
+				return;
+			
+			// Someone else reaped the workers
+			for(auto &r:running)
+				fail(r.second, "Worker process status lost");
+			running.clear();
+			return;
+		}
+		
+		auto it = running.find(pid);
+		if(it == running.end())
+			return;
+		
+		const size_t variant = it->second;
+		running.erase(it);
+		
+		if(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			std::copy(&shared_outputs[variant*n_outputs], &shared_outputs[(variant + 1)*n_outputs], &result._outputs[variant*n_outputs]);
+		else if(WIFEXITED(status) && shared_errors[variant*error_len])
+			fail(variant, &shared_errors[variant*error_len]);
+		else if(WIFEXITED(status))
+			fail(variant, "Worker process exited with status " + std::to_string(WEXITSTATUS(status)));
+		else if(WIFSIGNALED(status))
+			fail(variant, "Worker process terminated by signal " + std::to_string(WTERMSIG(status)));
+		else
+			fail(variant, "Worker process failed");
+	};
+	
+	for(size_t variant = 0; variant < n; variant++) {
+		while(running.size() >= max_workers)
+			reap();
+		
+		const pid_t pid = fork();
+		
+		if(pid < 0) {
+			fail(variant, std::string("Can't start worker process: ") + strerror(errno));
+			continue;
+		}
+		
+		// Worker: apply the variant's parameters and continue from the prototype's state
+		// (_exit so nothing of the parent's, like buffered output, is flushed twice)
+		if(pid == 0) {
+			int code = 0;
+			
+			try {
+				for(size_t ind = 0; ind < n_params; ind++)
+					params[ind].set(c, map, result._params[variant*n_params + ind]);
+				
+				c.sim_to_time(stop);
+				
+				for(size_t ind = 0; ind < n_outputs; ind++)
+					shared_outputs[variant*n_outputs + ind] = outputs[ind](c, map);
+			}
+			catch(const std::exception &e) {
+				strncpy(&shared_errors[variant*error_len], *e.what() ? e.what() : "Variant failed", error_len - 1);
+				code = 1;
+			}
+			
+			_exit(code);
+		}
+		
+		running[pid] = variant;
+	}
+	
+	while(running.size())
+		reap();
+	
+	munmap(area, std::max<size_t>(bytes, 1));
+	c.n_threads = saved_threads;
+	
+	return result;
+}
+
+}
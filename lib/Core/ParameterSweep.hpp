@@ -0,0 +1,102 @@
+/*
+	Simulate every combination of a grid of parameter values for copies of a circuit
+	on a pool of threads (or in forked processes), recording chosen outputs of each variant
+*/
+
+#pragma once
+
+#include "Core/ParameterSweepResult.hpp"
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace spice {
+
+class Circuit;
+class CloneMap;
+class Node;
+class TwoTerminalComponent;
+
+class ParameterSweep {
+public:
+	// Change a circuit for a parameter value, or read an output after a variant ran
+	// The map gives the circuit's counterparts of the prototype's parts
+	typedef std::function<void(Circuit&, const CloneMap&, double)> Setter;
+	typedef std::function<double(const Circuit&, const CloneMap&)> Output;
+	
+	typedef std::function<std::unique_ptr<Circuit>()> Factory;
+
+private:
+	const Circuit &prototype;
+	Factory factory;
+	
+	struct Param {
+		Setter set;
+		std::vector<double> values;
+	};
+	
+	std::vector<Param> params;
+	std::vector<Output> outputs;
+	
+	// Result with every variant's parameter values filled in
+	ParameterSweepResult gen_result() const;
+
+public:
+	// Variants are clones of the prototype in its present state, so they can share an operating
+	// point or a warm-up transient (each variant gets its own clone if the prototype is in a transient
+	// simulation; otherwise each thread re-uses one, reset between variants)
+	// The prototype must not change while the sweep runs
+	ParameterSweep(const Circuit &prototype);
+	
+	// Each thread builds its own circuit with the factory (called concurrently) and re-uses it,
+	// reset between variants; the factory has to build circuits the same way as the prototype,
+	// whose parts parameters and outputs refer to
+	ParameterSweep(const Circuit &prototype, Factory factory);
+	
+	// Number of threads (0 for one per hardware thread)
+	// Each variant's circuit uses a single thread itself
+	unsigned int n_threads = 0;
+	
+	// Add a parameter axis, setting a component's value or anything else
+	// Variants are all combinations of the axes' values, with the last axis varying fastest
+	// Return the parameter's index in the results
+	size_t add_param(const TwoTerminalComponent *comp, std::vector<double> values);
+	size_t add_param(Setter set, std::vector<double> values);
+	
+	// Add an output recorded at the end of each variant: a node voltage,
+	// a component voltage or current, or anything else
+	// Return the output's index in the results
+	size_t add_voltage(const Node *n);
+	size_t add_voltage(const TwoTerminalComponent *comp);
+	size_t add_current(const TwoTerminalComponent *comp);
+	size_t add_output(Output output);
+	
+	// Number of combinations of the parameter values
+	size_t n_variants() const;
+	
+	// Simulate every variant to time stop (0 for just the DC operating point)
+	// Variants run in any order on a work-stealing pool, since their run times can differ widely
+	// A variant that throws is recorded as failed, with NaN outputs
+	// Throws std::logic_error for circuits with subcircuit instances, which share their definitions
+	ParameterSweepResult run(double stop);
+	
+	// Number of worker processes for run_processes() (0 for one per hardware thread)
+	unsigned int n_processes = 0;
+	
+	// Simulate every variant to time stop in a process of its own, forked from this one, so it starts
+	// from the prototype's memory as it is (shared copy-on-write) instead of a clone: an expensive
+	// shared prefix (operating point and warm-up transient) is run once on the prototype beforehand,
+	// and neither repeated nor copied for every variant
+	// Setters change the prototype itself in the variant's process (with an identity map), and
+	// outputs come back through a shared memory area; a variant that throws or whose process
+	// dies is recorded as failed, with NaN outputs; factories aren't used
+	// The prototype is passed again, non-const, since its thread pool is replaced for the forks
+	// (and restored afterwards); throws std::invalid_argument for any other circuit
+	// The calling process must have no other threads running: a forked worker only has the calling
+	// thread, and would deadlock on any lock another thread held at the fork
+	// Workers are reaped with waitpid(-1), so the calling process shouldn't be waiting for other children meanwhile
+	ParameterSweepResult run_processes(Circuit &prototype, double stop);
+};
+
+}
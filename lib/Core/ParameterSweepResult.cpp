@@ -0,0 +1,42 @@
+#include "Core/ParameterSweepResult.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace spice {
+
+ParameterSweepResult::ParameterSweepResult(size_t n_variants, size_t n_params, size_t n_outputs):
+	n_variants(n_variants), n_params(n_params), n_outputs(n_outputs),
+	_params(n_variants*n_params), _outputs(n_variants*n_outputs, std::numeric_limits<double>::quiet_NaN()),
+	_errors(n_variants) {}
+
+size_t ParameterSweepResult::size() const {
+	return n_variants;
+}
+
+double ParameterSweepResult::param(size_t variant, size_t ind) const {
+	if(variant >= n_variants || ind >= n_params)
+		throw std::out_of_range("No such variant or parameter");
+	
+	return _params[variant*n_params + ind];
+}
+
+double ParameterSweepResult::output(size_t variant, size_t ind) const {
+	if(variant >= n_variants || ind >= n_outputs)
+		throw std::out_of_range("No such variant or output");
+	
+	return _outputs[variant*n_outputs + ind];
+}
+
+const std::string &ParameterSweepResult::error(size_t variant) const {
+	return _errors.at(variant);
+}
+
+size_t ParameterSweepResult::n_failed() const {
+	return std::count_if(_errors.begin(), _errors.end(), [](const std::string &e) {
+		return !e.empty();
+	});
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+	Parameter values and outputs of every variant of a parameter sweep
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace spice {
+
+class ParameterSweepResult {
+private:
+	size_t n_variants = 0, n_params = 0, n_outputs = 0;
+	
+	// One row per variant, allocated before the sweep runs so
+	// each variant writes its own row without locking
+	std::vector<double> _params;
+	std::vector<double> _outputs;
+	std::vector<std::string> _errors;
+	
+	ParameterSweepResult(size_t n_variants, size_t n_params, size_t n_outputs);
+
+public:
+	// Number of variants
+	size_t size() const;
+	
+	double param(size_t variant, size_t ind) const;
+	double output(size_t variant, size_t ind) const;
+	
+	// Why a variant failed (its outputs are NaN), or empty if it didn't
+	const std::string &error(size_t variant) const;
+	size_t n_failed() const;
+	
+	friend class ParameterSweep;
+};
+
+}
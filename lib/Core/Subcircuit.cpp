@@ -0,0 +1,79 @@
+#include "Core/Subcircuit.hpp"
+
+#include <stdexcept>
+
+namespace spice {
+
+Subcircuit::Subcircuit(Circuit *c, const std::vector<TwoTerminalComponent*> &comps): parent_circuit(c), comps(comps) {}
+
+void Subcircuit::condense(const double *values) {
+	bool changed = !solver_analyzed || condensed_values.size() != entries.size();
+	condensed_values.resize(entries.size());
+	
+	for(size_t ind = 0; ind < entries.size(); ind++) {
+		changed |= condensed_values[ind] != values[entries[ind].offset];
+		condensed_values[ind] = values[entries[ind].offset];
+	}
+	
+	if(!changed)
+		return;
+	
+	std::vector<Eigen::Triplet<double>> ii_trip, ic_trip, ri_trip;
+	
+	for(const BlockEntry &e:entries) {
+		auto &trip = e.block == &A_ii ? ii_trip : (e.block == &A_ic ? ic_trip : ri_trip);
+		trip.emplace_back(e.row, e.col, values[e.offset]);
+	}
+	
+	A_ii.resize(int_vars.size(), int_vars.size());
+	A_ic.resize(int_vars.size(), col_vars.size());
+	A_ri.resize(row_vars.size(), int_vars.size());
+	A_ii.setFromTriplets(ii_trip.begin(), ii_trip.end());
+	A_ic.setFromTriplets(ic_trip.begin(), ic_trip.end());
+	A_ri.setFromTriplets(ri_trip.begin(), ri_trip.end());
+	
+	// Pattern stays the same until the matrix is re-generated
+	if(!solver_analyzed) {
+		solver.analyzePattern(A_ii);
+		solver_analyzed = true;
+	}
+	
+	solver.factorize(A_ii);
+	if(solver.info() != Eigen::Success)
+		throw std::runtime_error("Subcircuit SparseLU factorize: " + solver.lastErrorMessage());
+	
+	int_from_col = solver.solve(Eigen::MatrixXd(A_ic));
+	row_from_int = Eigen::MatrixXd(solver.transpose().solve(Eigen::MatrixXd(A_ri.transpose()))).transpose();
+	schur = A_ri*int_from_col;
+}
+
+Eigen::MatrixXd Subcircuit::eliminate(const Eigen::MatrixXd &rhs, bool transposed, Eigen::MatrixXd &y) {
+	if(transposed) {
+		y = solver.transpose().solve(rhs);
+		return A_ic.transpose()*y;
+	}
+	
+	y = solver.solve(rhs);
+	return A_ri*y;
+}
+
+Eigen::MatrixXd Subcircuit::recover(const Eigen::MatrixXd &y, const Eigen::MatrixXd &x, bool transposed) const {
+	if(transposed)
+		return y - row_from_int.transpose()*x;
+	else
+		return y - int_from_col*x;
+}
+
+const std::vector<TwoTerminalComponent*> &Subcircuit::components() const {
+	return comps;
+}
+
+const std::vector<Node*> &Subcircuit::internal_nodes() const {
+	return internal;
+}
+
+const std::vector<Node*> &Subcircuit::boundary_nodes() const {
+	return boundary;
+}
+
+}
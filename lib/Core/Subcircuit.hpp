@@ -0,0 +1,100 @@
+/*
+	Group of components whose internal nodes are eliminated from the
+	circuit matrix by static condensation (Schur complement)
+*/
+
+#pragma once
+
+#include "Core/OrderingCache.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+#include <Eigen/Core>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-but-set-variable"
+#include <Eigen/Sparse>
+#include <Eigen/SparseLU>
+#pragma clang diagnostic pop
+
+namespace spice {
+
+class Circuit;
+class Node;
+class TwoTerminalComponent;
+
+class Subcircuit {
+private:
+	// Circuit we're part of
+	Circuit *parent_circuit;
+	
+	std::vector<TwoTerminalComponent*> comps;
+	
+	// Nodes only connected to our components, and the rest of the nodes they connect to
+	// (found when the matrix is generated)
+	std::vector<Node*> internal, boundary;
+	
+	// Circuit variables that are eliminated (internal node voltages and currents of
+	// voltage-defined components touching them), other variables whose rows reference them,
+	// and other variables referenced by their rows
+	std::vector<size_t> int_vars, row_vars, col_vars;
+	
+	// Where eval_mat values (by offset into its value array) go in the blocks below
+	struct BlockEntry {
+		size_t offset;
+		Eigen::SparseMatrix<double> *block;
+		size_t row, col;
+	};
+	
+	std::vector<BlockEntry> entries;
+	
+	// Block values at the last condensation, so it can be skipped when nothing changed
+	std::vector<double> condensed_values;
+	
+	// Circuit matrix blocks: internal rows and columns, internal rows and col_vars columns,
+	// and row_vars rows and internal columns
+	Eigen::SparseMatrix<double> A_ii, A_ic, A_ri;
+	
+	Eigen::SparseLU<Eigen::SparseMatrix<double>, CachedOrdering<int>> solver;
+	bool solver_analyzed = false;
+	
+	// A_ii^-1 A_ic and A_ri A_ii^-1
+	Eigen::MatrixXd int_from_col, row_from_int;
+	
+	// A_ri A_ii^-1 A_ic, subtracted from the condensed matrix at (row_vars, col_vars)
+	Eigen::MatrixXd schur;
+	
+	// Offset of each schur entry's value in the condensed matrix (column-major)
+	std::vector<size_t> schur_slots;
+	
+	Subcircuit(Circuit *c, const std::vector<TwoTerminalComponent*> &comps);
+	
+	// No copy constructor
+	Subcircuit(const Subcircuit&) = delete;
+	
+	// Fill the blocks from eval_mat values, factorize A_ii, and compute schur
+	// Nothing is done if the values are the same as last time
+	void condense(const double *values);
+	
+	// Solve the internal block for the internal right-hand sides (y = A_ii^-1 rhs)
+	// and return their contribution to row_vars rows (A_ri y)
+	// For the transposed system, y = A_ii^-T rhs contributes A_ic^T y to col_vars rows
+	Eigen::MatrixXd eliminate(const Eigen::MatrixXd &rhs, bool transposed, Eigen::MatrixXd &y);
+	
+	// Internal variables given y from eliminate() and the solution at col_vars: y - A_ii^-1 A_ic x
+	// (or at row_vars for the transposed system: y - A_ii^-T A_ri^T x)
+	Eigen::MatrixXd recover(const Eigen::MatrixXd &y, const Eigen::MatrixXd &x, bool transposed) const;
+
+public:
+	const std::vector<TwoTerminalComponent*> &components() const;
+	
+	// Nodes eliminated from the circuit matrix, and nodes connecting the subcircuit
+	// to the rest of the circuit (as of the last matrix generation)
+	const std::vector<Node*> &internal_nodes() const;
+	const std::vector<Node*> &boundary_nodes() const;
+	
+	friend class Circuit;
+};
+
+}
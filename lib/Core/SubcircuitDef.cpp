@@ -0,0 +1,19 @@
+#include "Core/SubcircuitDef.hpp"
+
+namespace spice {
+
+SubcircuitDef::SubcircuitDef() {}
+
+Circuit &SubcircuitDef::circuit() {
+	return cell;
+}
+
+void SubcircuitDef::add_port(Node *n) {
+	ports.push_back(n);
+}
+
+const std::vector<Node*> &SubcircuitDef::port_nodes() const {
+	return ports;
+}
+
+}
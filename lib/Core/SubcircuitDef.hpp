@@ -0,0 +1,40 @@
+/*
+	Definition of a cell that can be instantiated many times in a circuit
+	Instances share the cell's matrix stamps and only keep their own ports and parameters
+*/
+
+#pragma once
+
+#include "Core/Circuit.hpp"
+
+#include <vector>
+
+namespace spice {
+
+class Node;
+
+class SubcircuitDef {
+private:
+	// Cell netlist (linear components only); its ground is the ground of the circuit it's instantiated in
+	Circuit cell;
+	
+	std::vector<Node*> ports;
+
+public:
+	SubcircuitDef();
+	
+	// No copy constructor
+	SubcircuitDef(const SubcircuitDef&) = delete;
+	
+	// Circuit to build the cell in
+	Circuit &circuit();
+	
+	// Make a free node of the cell the next port
+	void add_port(Node *n);
+	
+	const std::vector<Node*> &port_nodes() const;
+	
+	friend class Circuit;
+};
+
+}
@@ -0,0 +1,22 @@
+#include "Core/SubcircuitInstance.hpp"
+#include "Core/Circuit.hpp"
+
+namespace spice {
+
+SubcircuitInstance::SubcircuitInstance(Circuit *c, SubcircuitDef *def, const std::vector<Node*> &ports,
+                                       const std::vector<std::pair<TwoTerminalComponent*, double>> &overrides):
+	parent_circuit(c), def(def), ports(ports), overrides(overrides) {}
+
+SubcircuitDef *SubcircuitInstance::definition() const {
+	return def;
+}
+
+const std::vector<Node*> &SubcircuitInstance::port_nodes() const {
+	return ports;
+}
+
+double SubcircuitInstance::voltage(const Node *cell_node) const {
+	return parent_circuit->cell_voltage(this, cell_node);
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+	Instance of a SubcircuitDef in a circuit
+*/
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace spice {
+
+class Circuit;
+class Node;
+class TwoTerminalComponent;
+class SubcircuitDef;
+
+class SubcircuitInstance {
+private:
+	// Circuit we're part of
+	Circuit *parent_circuit;
+	
+	SubcircuitDef *def;
+	
+	// Nodes of the circuit connected to each port of the definition
+	std::vector<Node*> ports;
+	
+	// Values replacing the values of the definition's components (sorted)
+	std::vector<std::pair<TwoTerminalComponent*, double>> overrides;
+	
+	// Set when the matrix is generated: index of the instance's parameter set in the circuit,
+	// first state in the circuit's deq_state, and where the admittance between each
+	// pair of ports goes in eval_mat (-1 for fixed nodes)
+	size_t variant = 0;
+	size_t state_offset = 0;
+	std::vector<ssize_t> slots;
+	
+	// Initial condition of every IntegratingComponent of the cell from the DC solution
+	std::vector<double> ic_values;
+	
+	SubcircuitInstance(Circuit *c, SubcircuitDef *def, const std::vector<Node*> &ports,
+	                   const std::vector<std::pair<TwoTerminalComponent*, double>> &overrides);
+	
+	// No copy constructor
+	SubcircuitInstance(const SubcircuitInstance&) = delete;
+
+public:
+	SubcircuitDef *definition() const;
+	const std::vector<Node*> &port_nodes() const;
+	
+	// Present voltage of a node of the definition's cell in this instance
+	double voltage(const Node *cell_node) const;
+	
+	friend class Circuit;
+};
+
+}
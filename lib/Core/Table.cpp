@@ -0,0 +1,131 @@
+#include "Core/Table.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace spice {
+
+Table::Table(std::vector<double> xs, std::vector<double> ys): xs(std::move(xs)), ys(std::move(ys)) {
+	if(this->xs.empty() || this->xs.size() != this->ys.size())
+		throw std::invalid_argument("Table needs the same nonzero number of x and y values");
+	
+	if(!std::is_sorted(this->xs.begin(), this->xs.end()))
+		throw std::invalid_argument("Table x values must be nondecreasing");
+	
+	// A single point is a constant
+	if(this->xs.size() == 1) {
+		this->xs.push_back(this->xs[0]);
+		this->ys.push_back(this->ys[0]);
+	}
+	
+	slopes.resize(this->xs.size() - 1);
+	for(size_t ind = 0; ind < slopes.size(); ind++) {
+		const double dx = this->xs[ind + 1] - this->xs[ind];
+		slopes[ind] = dx > 0 ? (this->ys[ind + 1] - this->ys[ind])/dx : 0;
+	}
+}
+
+size_t Table::segment(double x) const {
+	const size_t last = slopes.size() - 1;
+	
+	// Same segment as last time, or the next one
+	if(xs[cursor] <= x) {
+		if(cursor == last || x < xs[cursor + 1])
+			return cursor;
+		
+		if(cursor + 1 == last || x < xs[cursor + 2])
+			return ++cursor;
+	}
+	
+	// Moved backward (RK substeps) or jumped ahead
+	const size_t after = std::upper_bound(xs.begin(), xs.end(), x) - xs.begin();
+	cursor = std::min(after ? after - 1 : 0, last);
+	return cursor;
+}
+
+double Table::at(double x) const {
+	if(x < xs.front())
+		return ys.front();
+	if(x >= xs.back())
+		return ys.back();
+	
+	const size_t seg = segment(x);
+	return ys[seg] + (x - xs[seg])*slopes[seg];
+}
+
+void Table::at(const double *x, double *y, size_t n) const {
+	const double *x0 = xs.data(), *y0 = ys.data(), *slope = slopes.data();
+	const double lo = xs.front(), hi = xs.back();
+	
+	// Chunks small enough for the segment indices to stay in cache
+	constexpr size_t chunk = 256;
+	size_t seg[chunk];
+	double cx[chunk];
+	
+	for(size_t begin = 0; begin < n; begin += chunk) {
+		const size_t len = std::min(chunk, n - begin);
+		
+		for(size_t ind = 0; ind < len; ind++) {
+			cx[ind] = std::min(std::max(x[begin + ind], lo), hi);
+			seg[ind] = segment(cx[ind]);
+		}
+		
+		// Gathers and a multiply-add without branches
+		for(size_t ind = 0; ind < len; ind++)
+			y[begin + ind] = y0[seg[ind]] + (cx[ind] - x0[seg[ind]])*slope[seg[ind]];
+		
+		// Past the end holds the last value (the last segment could be vertical)
+		for(size_t ind = 0; ind < len; ind++)
+			if(x[begin + ind] >= hi)
+				y[begin + ind] = ys.back();
+	}
+}
+
+double Table::slope(double x) const {
+	if(x < xs.front() || x >= xs.back())
+		return 0;
+	
+	return slopes[segment(x)];
+}
+
+double Table::next_x(double x) const {
+	auto it = std::upper_bound(xs.begin(), xs.end(), x);
+	if(it == xs.end())
+		return std::numeric_limits<double>::max();
+	return *it;
+}
+
+const std::vector<double> &Table::x_values() const {
+	return xs;
+}
+
+const std::vector<double> &Table::y_values() const {
+	return ys;
+}
+
+double Table::lookup(const double *pairs, size_t n_pairs, double x) {
+	if(!n_pairs)
+		return 0;
+	
+	if(x <= pairs[0])
+		return pairs[1];
+	if(x >= pairs[2*(n_pairs - 1)])
+		return pairs[2*n_pairs - 1];
+	
+	// Last pair at or before x
+	size_t lo = 0, hi = n_pairs - 1;
+	while(hi - lo > 1) {
+		const size_t mid = (lo + hi)/2;
+		if(pairs[2*mid] <= x)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	
+	const double x0 = pairs[2*lo], y0 = pairs[2*lo + 1];
+	const double x1 = pairs[2*hi], y1 = pairs[2*hi + 1];
+	return y0 + (x - x0)*(y1 - y0)/(x1 - x0);
+}
+
+}
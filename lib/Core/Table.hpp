@@ -0,0 +1,51 @@
+/*
+	Piecewise-linear lookup table
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace spice {
+
+class Table {
+private:
+	std::vector<double> xs, ys;
+	
+	// Slope of each segment (0 for vertical ones)
+	std::vector<double> slopes;
+	
+	// Segment found by the last lookup, where the next one most likely is when x only moves forward
+	mutable size_t cursor = 0;
+	
+	// Segment containing x: the last one starting at or before it (clamped to the first and last)
+	size_t segment(double x) const;
+
+public:
+	// x values must be nondecreasing; a repeated x makes a vertical step
+	Table(std::vector<double> xs, std::vector<double> ys);
+	
+	// Linear interpolation, holding the first and last values outside the table
+	// Amortized constant time for nondecreasing x, logarithmic otherwise
+	// (the cursor makes lookups on one table not thread-safe)
+	double at(double x) const;
+	
+	// Interpolate n values at once
+	// Segments are found first (quickly if x is sorted), then evaluated in a loop the compiler vectorizes
+	void at(const double *x, double *y, size_t n) const;
+	
+	// Derivative at x (0 outside the table)
+	double slope(double x) const;
+	
+	// First x in the table after the given one (DBL_MAX if there is none)
+	double next_x(double x) const;
+	
+	const std::vector<double> &x_values() const;
+	const std::vector<double> &y_values() const;
+	
+	// Interpolate in interleaved (x, y) pairs without building a table
+	static double lookup(const double *pairs, size_t n_pairs, double x);
+};
+
+}
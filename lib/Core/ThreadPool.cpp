@@ -0,0 +1,168 @@
+#include "Core/ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace spice {
+
+ThreadPool::ThreadPool(unsigned int n_threads) {
+	if(!n_threads)
+		n_threads = std::max(1u, std::thread::hardware_concurrency());
+	
+	// Calling thread runs the first chunk itself
+	for(unsigned int ind = 1; ind < n_threads; ind++)
+		workers.emplace_back(&ThreadPool::worker_loop, this, ind);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	
+	start_cv.notify_all();
+	for(auto &w:workers)
+		w.join();
+}
+
+unsigned int ThreadPool::size() const {
+	return workers.size() + 1;
+}
+
+void ThreadPool::run_chunk(unsigned int chunk_ind) {
+	try {
+		(*job)(chunks[chunk_ind].first, chunks[chunk_ind].second, chunk_ind);
+	}
+	catch(...) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!error)
+			error = std::current_exception();
+	}
+}
+
+void ThreadPool::worker_loop(unsigned int thread_ind) {
+	unsigned long seen_generation = 0;
+	
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start_cv.wait(lock, [&]{ return stopping || generation != seen_generation; });
+			
+			if(stopping)
+				return;
+			
+			seen_generation = generation;
+			
+			// Fewer chunks than threads this time
+			if(thread_ind >= chunks.size())
+				continue;
+		}
+		
+		run_chunk(thread_ind);
+		
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending--;
+		}
+		done_cv.notify_one();
+	}
+}
+
+void ThreadPool::parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t, unsigned int)> &func) {
+	if(!n)
+		return;
+	
+	const size_t n_chunks = std::min<size_t>(size(), std::max<size_t>(1, n/std::max<size_t>(grain, 1)));
+	
+	// Not worth waking anyone up
+	if(n_chunks == 1) {
+		func(0, n, 0);
+		return;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		
+		chunks.clear();
+		for(size_t ind = 0; ind < n_chunks; ind++)
+			chunks.emplace_back(n*ind/n_chunks, n*(ind + 1)/n_chunks);
+		
+		job = &func;
+		error = nullptr;
+		pending = n_chunks - 1;
+		generation++;
+	}
+	start_cv.notify_all();
+	
+	run_chunk(0);
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cv.wait(lock, [&]{ return pending == 0; });
+	job = nullptr;
+	
+	if(error)
+		std::rethrow_exception(error);
+}
+
+void ThreadPool::parallel_tasks(size_t n, const std::function<void(size_t, unsigned int)> &func) {
+	struct Share {
+		std::mutex mutex;
+		size_t begin, end;
+	};
+	
+	const size_t n_shares = std::min<size_t>(size(), n);
+	std::vector<Share> shares(n_shares);
+	for(size_t ind = 0; ind < n_shares; ind++) {
+		shares[ind].begin = n*ind/n_shares;
+		shares[ind].end = n*(ind + 1)/n_shares;
+	}
+	
+	// One chunk (and so one share) per thread
+	parallel_for(n_shares, 1, [&](size_t, size_t, unsigned int thread) {
+		Share &own = shares[thread];
+		
+		while(true) {
+			size_t ind;
+			{
+				std::lock_guard<std::mutex> lock(own.mutex);
+				ind = own.begin < own.end ? own.begin++ : n;
+			}
+			
+			if(ind < n) {
+				func(ind, thread);
+				continue;
+			}
+			
+			// Out of work: take the upper half of the largest share left
+			Share *victim = nullptr;
+			size_t most = 0;
+			for(Share &other:shares) {
+				std::lock_guard<std::mutex> lock(other.mutex);
+				if(other.end - other.begin > most) {
+					most = other.end - other.begin;
+					victim = &other;
+				}
+			}
+			
+			if(!victim)
+				return;
+			
+			size_t begin, end;
+			{
+				std::lock_guard<std::mutex> lock(victim->mutex);
+				
+				// Someone else got to it first
+				if(victim->begin >= victim->end)
+					continue;
+				
+				end = victim->end;
+				begin = victim->end = victim->begin + (victim->end - victim->begin)/2;
+			}
+			
+			std::lock_guard<std::mutex> lock(own.mutex);
+			own.begin = begin;
+			own.end = end;
+		}
+	});
+}
+
+}
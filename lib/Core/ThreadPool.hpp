@@ -0,0 +1,57 @@
+/*
+	Fixed-size pool of worker threads for splitting loops over a range
+*/
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace spice {
+
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	
+	// Current job, incremented generation wakes up workers
+	const std::function<void(size_t, size_t, unsigned int)> *job = nullptr;
+	std::vector<std::pair<size_t, size_t>> chunks;
+	unsigned long generation = 0;
+	unsigned int pending = 0;
+	bool stopping = false;
+	
+	// First exception thrown by a chunk, rethrown by parallel_for
+	std::exception_ptr error;
+	
+	void worker_loop(unsigned int thread_ind);
+	void run_chunk(unsigned int chunk_ind);
+	
+public:
+	// Number of threads including the calling thread (0 for one per hardware thread)
+	ThreadPool(unsigned int n_threads);
+	~ThreadPool();
+	
+	ThreadPool(const ThreadPool&) = delete;
+	
+	unsigned int size() const;
+	
+	// Run func(begin, end, chunk) over [0, n) split into contiguous chunks of at least grain
+	// elements, at most one per thread, and wait for all of them to finish
+	// Chunk boundaries only depend on n, grain, and the pool size, so results collected per chunk
+	// and combined in chunk order are independent of scheduling
+	void parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t, unsigned int)> &func);
+	
+	// Run func(ind, thread) for every ind in [0, n), for tasks whose run times differ widely
+	// Each thread starts on its own contiguous share of the range, and once it runs out,
+	// steals the upper half of the largest share left
+	void parallel_tasks(size_t n, const std::function<void(size_t, unsigned int)> &func);
+};
+
+}
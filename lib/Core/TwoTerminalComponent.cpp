@@ -2,6 +2,7 @@
 #include "Core/Circuit.hpp"
 #include "Core/Node.hpp"
 #include "Core/Modulator.hpp"
+#include "Core/CloneMap.hpp"
 
 #include <stdexcept>
 
@@ -57,6 +58,17 @@ void TwoTerminalComponent::remove_mod() {
 	}
 }
 
+void TwoTerminalComponent::rebind(Circuit *c, const CloneMap &map) {
+	Component::rebind(c, map);
+	node_top = map.node(node_top);
+	node_bot = map.node(node_bot);
+	mod = map.modulator(mod);
+	
+	// Generated again with the clone's matrix
+	circuit_v_expr.clear();
+	circuit_i_expr.clear();
+}
+
 const std::vector<double> &TwoTerminalComponent::v_hist() {
 	return _v_hist;
 }
@@ -132,6 +144,23 @@ Expression TwoTerminalComponent::tran_i_expr() const {
 	return dc_i_expr();
 }
 
+// Default to an open circuit in AC analysis
+bool TwoTerminalComponent::ac_voltage_defined() const {
+	return false;
+}
+
+std::complex<double> TwoTerminalComponent::ac_admittance(double) const {
+	return 0;
+}
+
+std::complex<double> TwoTerminalComponent::ac_impedance(double) const {
+	return 0;
+}
+
+std::complex<double> TwoTerminalComponent::ac_source() const {
+	return 0;
+}
+
 Node *TwoTerminalComponent::to(Node *n) {
 	if(parent_circuit != n->parent_circuit)
 		throw std::invalid_argument("Node not in the same circuit");
@@ -139,12 +168,12 @@ Node *TwoTerminalComponent::to(Node *n) {
 	if(node_top == n)
 		throw std::invalid_argument("Both ends connected to same node");
 	
-	// Circuit topology changed...
-	parent_circuit->topology_changed();
-	
 	// Remember our connections
 	if(node_bot)
 		throw std::invalid_argument("Component already connected");
+	
+	// The node's connections changed...
+	parent_circuit->connections_changed({n});
 	node_bot = n;
 	
 	// Current entering the node
@@ -160,8 +189,8 @@ TwoTerminalComponent *TwoTerminalComponent::to(TwoTerminalComponent *c) {
 }
 
 void TwoTerminalComponent::flip() {
-	// Circuit topology changed...
-	parent_circuit->topology_changed();
+	// Connections of both nodes changed...
+	parent_circuit->connections_changed({node_top, node_bot});
 	
 	// Flip component direction
 	Node *temp = node_bot;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <vector>
+#include <complex>
 
 #include "Core/Component.hpp"
 #include "Core/Expression.hpp"
@@ -39,6 +40,14 @@ protected:
 	virtual Expression tran_v_expr() const;
 	virtual Expression tran_i_expr() const;
 	
+	// Small-signal model for AC analysis, linearized around the present operating point
+	// Admittance-defined components: I = Y*V + ac_source()
+	// Voltage-defined components get their own current variable: V = Z*I + ac_source()
+	virtual bool ac_voltage_defined() const;
+	virtual std::complex<double> ac_admittance(double omega) const;
+	virtual std::complex<double> ac_impedance(double omega) const;
+	virtual std::complex<double> ac_source() const;
+	
 	// Expressions that represent this component's voltage and current values in the circuit
 	// Set by the Circuit class
 	Expression circuit_v_expr;
@@ -56,8 +65,10 @@ protected:
 	TwoTerminalComponent(Circuit *parent, Modulator *m, Node *top, Node *bottom);
 	TwoTerminalComponent(Circuit *parent, Modulator *m, int flags, Node *top, Node *bottom);
 	
-	// No copy constructor
-	TwoTerminalComponent(const TwoTerminalComponent&) = delete;
+	// Only copied by clone()
+	TwoTerminalComponent(const TwoTerminalComponent&) = default;
+	
+	virtual void rebind(Circuit *c, const CloneMap &map);
 	
 public:
 	virtual ~TwoTerminalComponent() {}
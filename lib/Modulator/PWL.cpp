@@ -0,0 +1,31 @@
+#include "Modulator/PWL.hpp"
+#include "Core/Circuit.hpp"
+
+namespace spice {
+
+PWL::PWL(Circuit *parent_circuit, std::vector<double> times, std::vector<double> values):
+	Modulator(parent_circuit), table(std::move(times), std::move(values)) {}
+
+void PWL::apply() {
+	double value = table.at(parent_circuit->time());
+	for(auto &c:controlled)
+		*c.first = value;
+}
+
+bool PWL::continuous() const {
+	return true;
+}
+
+double PWL::next_change_time() {
+	return table.next_x(parent_circuit->time() + EPSILON);
+}
+
+const Table &PWL::get_table() const {
+	return table;
+}
+
+Modulator *PWL::clone() const {
+	return new PWL(*this);
+}
+
+}
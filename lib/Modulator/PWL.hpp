@@ -0,0 +1,35 @@
+/*
+	Modulate circuit parameters with a piecewise-linear waveform
+*/
+
+#pragma once
+
+#include "Core/Modulator.hpp"
+#include "Core/Table.hpp"
+
+#include <vector>
+
+namespace spice {
+
+class PWL: public Modulator {
+private:
+	// Times must be nondecreasing; a repeated time makes a step
+	// The first and last values are held outside the given times
+	PWL(Circuit *parent_circuit, std::vector<double> times, std::vector<double> values);
+	
+	Table table;
+	
+	virtual void apply();
+	virtual bool continuous() const;
+	virtual Modulator *clone() const;
+	
+public:
+	// Corners of the waveform are breakpoints, so steps don't cut across them
+	virtual double next_change_time();
+	
+	const Table &get_table() const;
+	
+	friend class Circuit;
+};
+
+}
@@ -88,4 +88,8 @@ void PWM::set_phase(double p) {
 	cached_nct = 0;
 }
 
+Modulator *PWM::clone() const {
+	return new PWM(*this);
+}
+
 }
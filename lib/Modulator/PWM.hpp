@@ -20,6 +20,7 @@ private:
 	virtual void reset();
 	virtual void apply();
 	virtual bool continuous() const;
+	virtual Modulator *clone() const;
 	
 	void _apply(bool state);
 	
@@ -0,0 +1,259 @@
+#include "Modulator/SampleStream.hpp"
+#include "Core/Circuit.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace spice {
+
+static const char sample_magic[8] = {'S', 'P', 'I', 'C', 'E', 'S', 'M', 'P'};
+
+static size_t type_size(uint32_t type) {
+	switch(type) {
+		case SampleStream::Int16:   return 2;
+		case SampleStream::Int32:   return 4;
+		case SampleStream::Float32: return 4;
+		case SampleStream::Float64: return 8;
+		default:                    return 0;
+	}
+}
+
+void SampleStream::write_file(const std::string &path, const std::vector<double> &samples, double sample_rate,
+                              Type type, double start_time, double scale, double offset) {
+	if(!type_size(type) || sample_rate <= 0 || scale == 0)
+		throw std::invalid_argument("Invalid sample file parameters");
+	
+	Header h;
+	memcpy(h.magic, sample_magic, sizeof(h.magic));
+	h.type = type;
+	h.reserved = 0;
+	h.sample_rate = sample_rate;
+	h.start_time = start_time;
+	h.scale = scale;
+	h.offset = offset;
+	
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write((const char*)&h, sizeof(h));
+	
+	for(double s:samples) {
+		const double raw = (s - offset)/scale;
+		
+		switch(type) {
+			case Int16: {
+				const int16_t v = std::lround(std::min(std::max(raw, -32768.0), 32767.0));
+				file.write((const char*)&v, sizeof(v));
+				break;
+			}
+			
+			case Int32: {
+				const int32_t v = std::lround(std::min(std::max(raw, -2147483648.0), 2147483647.0));
+				file.write((const char*)&v, sizeof(v));
+				break;
+			}
+			
+			case Float32: {
+				const float v = raw;
+				file.write((const char*)&v, sizeof(v));
+				break;
+			}
+			
+			case Float64:
+				file.write((const char*)&raw, sizeof(raw));
+				break;
+		}
+	}
+	
+	if(!file)
+		throw std::runtime_error("Can't write sample file " + path);
+}
+
+SampleStream::SampleStream(Circuit *parent_circuit, const std::string &path): Modulator(parent_circuit) {
+	fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		throw std::runtime_error("Can't open sample file " + path + ": " + strerror(errno));
+	
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header)) {
+		close(fd);
+		throw std::runtime_error("Sample file " + path + " is too short");
+	}
+	
+	map_size = st.st_size;
+	map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error("Can't map sample file " + path + ": " + strerror(errno));
+	}
+	
+	memcpy(&header, map, sizeof(header));
+	sample_size = type_size(header.type);
+	
+	if(memcmp(header.magic, sample_magic, sizeof(sample_magic)) || !sample_size || !(header.sample_rate > 0)) {
+		munmap(map, map_size);
+		close(fd);
+		throw std::runtime_error(path + " isn't a sample file");
+	}
+	
+	samples = (const unsigned char*)map + sizeof(Header);
+	n_samples = (map_size - sizeof(Header))/sample_size;
+	
+	if(!n_samples) {
+		munmap(map, map_size);
+		close(fd);
+		throw std::runtime_error("Sample file " + path + " has no samples");
+	}
+	
+	// Read front to back, so the kernel can read ahead and drop pages behind
+	madvise(map, map_size, MADV_SEQUENTIAL);
+}
+
+SampleStream::SampleStream(const SampleStream &other):
+	Modulator(other), header(other.header), map_size(other.map_size),
+	n_samples(other.n_samples), sample_size(other.sample_size),
+	sample_breakpoints(other.sample_breakpoints), prefetch_samples(other.prefetch_samples) {
+	
+	fd = dup(other.fd);
+	if(fd < 0)
+		throw std::runtime_error(std::string("Can't duplicate sample file descriptor: ") + strerror(errno));
+	
+	map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error(std::string("Can't map sample file: ") + strerror(errno));
+	}
+	
+	samples = (const unsigned char*)map + sizeof(Header);
+	madvise(map, map_size, MADV_SEQUENTIAL);
+}
+
+SampleStream::~SampleStream() {
+	munmap(map, map_size);
+	close(fd);
+}
+
+double SampleStream::sample(size_t ind) const {
+	const unsigned char *p = samples + ind*sample_size;
+	double raw;
+	
+	switch(header.type) {
+		case Int16: {
+			int16_t v;
+			memcpy(&v, p, sizeof(v));
+			raw = v;
+			break;
+		}
+		
+		case Int32: {
+			int32_t v;
+			memcpy(&v, p, sizeof(v));
+			raw = v;
+			break;
+		}
+		
+		case Float32: {
+			float v;
+			memcpy(&v, p, sizeof(v));
+			raw = v;
+			break;
+		}
+		
+		default:
+			memcpy(&raw, p, sizeof(raw));
+	}
+	
+	return header.scale*raw + header.offset;
+}
+
+void SampleStream::prefetch(size_t ind) {
+	// Only when the simulation gets halfway through the prefetched range
+	if(ind >= prefetched_begin && ind + prefetch_samples/2 < prefetched_end)
+		return;
+	
+	const size_t page = sysconf(_SC_PAGESIZE);
+	auto page_start = [&](size_t sample_ind) {
+		return (sizeof(Header) + std::min(sample_ind, n_samples)*sample_size)/page*page;
+	};
+	
+	// Release what's more than one prefetch window behind (substeps only go back one step)
+	const size_t keep = ind > prefetch_samples ? ind - prefetch_samples : 0;
+	if(page_start(keep) > page_start(prefetched_begin))
+		madvise((char*)map + page_start(prefetched_begin), page_start(keep) - page_start(prefetched_begin), MADV_DONTNEED);
+	
+	const size_t end = std::min(n_samples, ind + prefetch_samples);
+	madvise((char*)map + page_start(ind), sizeof(Header) + end*sample_size - page_start(ind), MADV_WILLNEED);
+	
+	prefetched_begin = keep;
+	prefetched_end = end;
+}
+
+void SampleStream::reset() {
+	prefetched_begin = prefetched_end = 0;
+}
+
+double SampleStream::value_at(double t) const {
+	const double pos = (t - header.start_time)*header.sample_rate;
+	if(!(pos > 0))
+		return sample(0);
+	if(pos >= n_samples - 1)
+		return sample(n_samples - 1);
+	
+	const size_t ind = pos;
+	const double frac = pos - ind;
+	return sample(ind) + frac*(sample(ind + 1) - sample(ind));
+}
+
+void SampleStream::apply() {
+	const double t = parent_circuit->time();
+	const double pos = (t - header.start_time)*header.sample_rate;
+	prefetch(pos > 0 ? std::min<size_t>(pos, n_samples - 1) : 0);
+	
+	const double value = value_at(t);
+	for(auto &c:controlled)
+		*c.first = value;
+}
+
+bool SampleStream::continuous() const {
+	return true;
+}
+
+Modulator *SampleStream::clone() const {
+	return new SampleStream(*this);
+}
+
+double SampleStream::next_change_time() {
+	if(!sample_breakpoints)
+		return std::numeric_limits<double>::max();
+	
+	// Next sample time after now (nothing changes outside the recording)
+	const double t = parent_circuit->time();
+	const double pos = (t + EPSILON - header.start_time)*header.sample_rate;
+	const double next = pos < 0 ? 0 : std::floor(pos) + 1;
+	if(next > n_samples - 1)
+		return std::numeric_limits<double>::max();
+	
+	return header.start_time + next/header.sample_rate;
+}
+
+size_t SampleStream::size() const {
+	return n_samples;
+}
+
+double SampleStream::sample_rate() const {
+	return header.sample_rate;
+}
+
+double SampleStream::start_time() const {
+	return header.start_time;
+}
+
+}
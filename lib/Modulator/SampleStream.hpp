@@ -0,0 +1,94 @@
+/*
+	Modulate circuit parameters with a recorded waveform streamed from a memory-mapped file
+*/
+
+#pragma once
+
+#include "Core/Modulator.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace spice {
+
+class SampleStream: public Modulator {
+public:
+	// Sample formats
+	enum Type: uint32_t {
+		Int16 = 0,
+		Int32 = 1,
+		Float32 = 2,
+		Float64 = 3
+	};
+	
+	// File layout: this header, then the samples (native byte order)
+	// Sample k is at start_time + k/sample_rate, with the value scale*sample + offset
+	struct Header {
+		char magic[8];
+		Type type;
+		uint32_t reserved;
+		double sample_rate;
+		double start_time;
+		double scale;
+		double offset;
+	};
+	
+	// Write a sample file (samples are rounded for integer types)
+	static void write_file(const std::string &path, const std::vector<double> &samples, double sample_rate,
+	                       Type type = Float32, double start_time = 0, double scale = 1, double offset = 0);
+
+private:
+	// Throw if the file can't be mapped or isn't a sample file
+	SampleStream(Circuit *parent_circuit, const std::string &path);
+	
+	// Copy for a clone of the circuit, with its own mapping of the same file
+	SampleStream(const SampleStream &other);
+	
+	Header header;
+	
+	int fd = -1;
+	void *map = nullptr;
+	size_t map_size = 0;
+	
+	const unsigned char *samples = nullptr;
+	size_t n_samples = 0;
+	size_t sample_size = 0;
+	
+	// Sample range paged in ahead of the simulation, and the first sample still mapped in
+	size_t prefetched_begin = 0, prefetched_end = 0;
+	
+	// Scaled value of a sample
+	double sample(size_t ind) const;
+	
+	// Page in the samples ahead of ind and release the ones well behind it
+	void prefetch(size_t ind);
+	
+	virtual void reset();
+	virtual void apply();
+	virtual bool continuous() const;
+	virtual Modulator *clone() const;
+
+public:
+	virtual ~SampleStream();
+	
+	// Report every sample time as a breakpoint so steps land on them
+	bool sample_breakpoints = false;
+	
+	// Number of samples paged in ahead of the simulation time at once
+	size_t prefetch_samples = 1 << 20;
+	
+	virtual double next_change_time();
+	
+	// Value at a time (linear interpolation, holding the first and last samples outside the recording)
+	double value_at(double t) const;
+	
+	size_t size() const;
+	double sample_rate() const;
+	double start_time() const;
+	
+	friend class Circuit;
+};
+
+}
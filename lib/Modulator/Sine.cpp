@@ -18,4 +18,8 @@ bool Sine::continuous() const {
 	return true;
 }
 
+Modulator *Sine::clone() const {
+	return new Sine(*this);
+}
+
 }
@@ -14,6 +14,7 @@ private:
 	
 	virtual void apply();
 	virtual bool continuous() const;
+	virtual Modulator *clone() const;
 	
 public:
 	double freq;
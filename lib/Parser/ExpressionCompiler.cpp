@@ -0,0 +1,246 @@
+#include "Parser/ExpressionCompiler.hpp"
+#include "Parser/Parser.hpp"
+#include "Parser/Nodes/ASTExpression.hpp"
+#include "Parser/Nodes/ASTNumericLiteral.hpp"
+#include "Parser/Nodes/ASTIdentifier.hpp"
+#include "Parser/Nodes/ASTExprParentheses.hpp"
+#include "Parser/Nodes/ASTExprOperator.hpp"
+#include "Parser/Nodes/ASTFunction.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <cctype>
+#include <cmath>
+
+namespace spice {
+namespace parser {
+
+// Expression children of a node (operands or arguments)
+static std::vector<const ASTNode*> operands(const ASTNode *node) {
+	std::vector<const ASTNode*> ret;
+	for(auto &child:node->children)
+		if(dynamic_cast<const ASTExpression*>(child.get()))
+			ret.push_back(child.get());
+	return ret;
+}
+
+ExpressionCompiler::ExpressionCompiler(const std::unordered_map<std::string, double> &params) {
+	for(auto &p:params) {
+		std::string name = p.first;
+		Parser::tolower(name);
+		this->params[name] = p.second;
+	}
+}
+
+size_t ExpressionCompiler::node_input(const std::string &name) {
+	auto it = std::find(nodes.begin(), nodes.end(), name);
+	if(it == nodes.end())
+		it = nodes.insert(nodes.end(), name);
+	
+	return it - nodes.begin() + 1;
+}
+
+std::string ExpressionCompiler::node_name(const ASTNode *node) {
+	if(auto *id = dynamic_cast<const ASTIdentifier*>(node))
+		return id->get_name();
+	
+	// Numbered nodes
+	if(auto *num = dynamic_cast<const ASTNumericLiteral*>(node)) {
+		std::ostringstream ss;
+		ss << num->get_number();
+		return ss.str();
+	}
+	
+	throw SyntaxException(node->pos, "Expected a node name");
+}
+
+uint32_t ExpressionCompiler::compile_node(const ASTNode *node) {
+	if(auto *num = dynamic_cast<const ASTNumericLiteral*>(node))
+		return code.constant_reg(num->get_number());
+	
+	if(auto *id = dynamic_cast<const ASTIdentifier*>(node)) {
+		std::string name = id->get_name();
+		Parser::tolower(name);
+		
+		if(name == "time")
+			return code.input(0);
+		if(name == "pi")
+			return code.constant_reg(M_PI);
+		
+		auto p = params.find(name);
+		if(p == params.end())
+			throw SyntaxException(node->pos, "Unknown parameter " + id->get_name());
+		
+		return code.constant_reg(p->second);
+	}
+	
+	const std::vector<const ASTNode*> args = operands(node);
+	
+	if(dynamic_cast<const ASTExprParentheses*>(node)) {
+		if(args.size() != 1)
+			throw SyntaxException(node->pos, "Expected one expression in parentheses");
+		
+		return compile_node(args[0]);
+	}
+	
+	if(auto *op = dynamic_cast<const ASTExprOperator*>(node)) {
+		static const Bytecode::Op op_lut[ASTExprOperator::OP_MAX] = {
+			Bytecode::AND,
+			Bytecode::OR,
+			Bytecode::XOR,
+			Bytecode::GREATER,
+			Bytecode::LESS,
+			Bytecode::GREATER_EQUALS,
+			Bytecode::LESS_EQUALS,
+			Bytecode::ADD,
+			Bytecode::SUB,
+			Bytecode::MUL,
+			Bytecode::DIV,
+			Bytecode::POW
+		};
+		
+		if(args.size() != 2)
+			throw SyntaxException(node->pos, "Expected two operands");
+		
+		const uint32_t a = compile_node(args[0]);
+		const uint32_t b = compile_node(args[1]);
+		return code.emit(op_lut[op->get_op_type()], a, b);
+	}
+	
+	if(auto *func = dynamic_cast<const ASTFunction<false>*>(node)) {
+		static const std::unordered_map<std::string, Bytecode::Op> func_lut{
+			{"sin", Bytecode::SIN}, {"cos", Bytecode::COS}, {"tan", Bytecode::TAN},
+			{"arcsin", Bytecode::ASIN}, {"asin", Bytecode::ASIN},
+			{"arccos", Bytecode::ACOS}, {"acos", Bytecode::ACOS},
+			{"arctan", Bytecode::ATAN}, {"atan", Bytecode::ATAN},
+			{"atan2", Bytecode::ATAN2}, {"hypot", Bytecode::HYPOT},
+			{"sinh", Bytecode::SINH}, {"cosh", Bytecode::COSH}, {"tanh", Bytecode::TANH},
+			{"exp", Bytecode::EXP}, {"ln", Bytecode::LOG}, {"log", Bytecode::LOG}, {"log10", Bytecode::LOG10},
+			{"sgn", Bytecode::SGN}, {"abs", Bytecode::ABS}, {"sqrt", Bytecode::SQRT}, {"square", Bytecode::SQUARE},
+			{"pow", Bytecode::POW}, {"pwr", Bytecode::PWR}, {"pwrs", Bytecode::PWRS},
+			{"round", Bytecode::ROUND}, {"_int", Bytecode::INT}, {"floor", Bytecode::FLOOR}, {"ceil", Bytecode::CEIL},
+			{"min", Bytecode::MIN}, {"max", Bytecode::MAX},
+			{"limit", Bytecode::LIMIT}, {"uplim", Bytecode::UPLIM}, {"dnlim", Bytecode::DNLIM},
+			{"uramp", Bytecode::URAMP}, {"stp", Bytecode::STP}, {"u", Bytecode::STP},
+			{"buf", Bytecode::BUF}, {"inv", Bytecode::INV},
+			{"if", Bytecode::IF}
+		};
+		
+		std::string name = func->get_name();
+		Parser::tolower(name);
+		
+		// Node voltage or voltage difference
+		if(name == "v") {
+			if(args.size() < 1 || args.size() > 2)
+				throw SyntaxException(node->pos, "Expected one or two nodes for V()");
+			
+			const uint32_t top = code.input(node_input(node_name(args[0])));
+			if(args.size() == 1)
+				return top;
+			
+			return code.emit(Bytecode::SUB, top, code.input(node_input(node_name(args[1]))));
+		}
+		
+		// Points of a table have to be known now
+		if(name == "table") {
+			if(args.size() < 3 || args.size() % 2 == 0)
+				throw SyntaxException(node->pos, "Expected x followed by pairs of x and y values for table()");
+			
+			const uint32_t x = compile_node(args[0]);
+			
+			std::vector<double> xs, ys;
+			for(size_t ind = 1; ind < args.size(); ind++) {
+				const uint32_t reg = compile_node(args[ind]);
+				if(!code.is_constant(reg))
+					throw SyntaxException(args[ind]->pos, "Table points must be constant");
+				
+				(ind % 2 ? xs : ys).push_back(code.value(reg));
+			}
+			
+			try {
+				return code.emit_table(x, std::move(xs), std::move(ys));
+			} catch(const std::invalid_argument &e) {
+				throw SyntaxException(node->pos, e.what());
+			}
+		}
+		
+		auto f = func_lut.find(name);
+		if(f == func_lut.end())
+			throw SyntaxException(node->pos, "Unknown function " + func->get_name());
+		
+		if(args.size() != Bytecode::arity(f->second))
+			throw SyntaxException(node->pos, "Expected " + std::to_string(Bytecode::arity(f->second)) + " arguments for " + func->get_name() + "()");
+		
+		uint32_t regs[3] = {};
+		for(size_t ind = 0; ind < args.size(); ind++)
+			regs[ind] = compile_node(args[ind]);
+		
+		return code.emit(f->second, regs[0], regs[1], regs[2]);
+	}
+	
+	throw SyntaxException(node->pos, "Expected expression");
+}
+
+Bytecode ExpressionCompiler::compile(const std::string &expr) {
+	code = Bytecode();
+	nodes.clear();
+	
+	try {
+		// Parse the expression the same way the parser does an expression in a file
+		NodePos np{0, 0};
+		ASTNode root;
+		ASTNode *current_node = root.add_child(new ASTEmptyExpression(np)).get();
+		
+		const char * const start = expr.c_str();
+		const char * const end = start + expr.length();
+		const char *ptr = start;
+		
+		while(ptr < end) {
+			np.character = ptr - start;
+			
+			if(std::isspace(*ptr)) {
+				ptr++;
+				continue;
+			}
+			
+			ASTNode *inserted_node = nullptr;
+			while(current_node && !inserted_node) {
+				inserted_node = current_node->consume(current_node, np, ptr, false);
+				
+				if(!inserted_node)
+					current_node = current_node->parent;
+			}
+			
+			if(!inserted_node)
+				throw SyntaxException(np, "Invalid syntax");
+		}
+		
+		std::vector<SyntaxException> error_list;
+		root.all_verify(error_list);
+		if(error_list.size())
+			throw error_list[0];
+		
+		code.set_result(compile_node(root.children.front().get()));
+	}
+	
+	catch(const SyntaxException &se) {
+		std::ostringstream ss;
+		ss << "Error in expression at column " << (se.pos.character + 1) << ": " << se.error << std::endl;
+		ss << expr << std::endl;
+		for(size_t x = 0; x < se.pos.character; x++)
+			ss << " ";
+		ss << "^";
+		
+		throw std::invalid_argument(ss.str());
+	}
+	
+	return std::move(code);
+}
+
+const std::vector<std::string> &ExpressionCompiler::node_names() const {
+	return nodes;
+}
+
+}
+}
@@ -0,0 +1,52 @@
+/*
+	Compile a behavioral expression string into bytecode through the parser's expression AST
+*/
+
+#pragma once
+
+#include "Parser/ASTNode.hpp"
+#include "Core/Bytecode.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace spice {
+namespace parser {
+
+class ExpressionCompiler {
+private:
+	// Parameter values by lowercase name
+	std::unordered_map<std::string, double> params;
+	
+	// Node names referenced with V(), in input order
+	std::vector<std::string> nodes;
+	
+	Bytecode code;
+	
+	// Input index for a node name, adding it if it's new
+	size_t node_input(const std::string &name);
+	
+	// Emit code for an expression node and return the register holding its value
+	// Throws SyntaxException at the offending node
+	uint32_t compile_node(const ASTNode *node);
+	
+	// Node name given as a V() argument
+	static std::string node_name(const ASTNode *node);
+
+public:
+	// Identifiers in expressions can refer to these parameters (case-insensitive)
+	ExpressionCompiler(const std::unordered_map<std::string, double> &params = {});
+	
+	// Parse and compile an expression like "2*V(in)*table(V(a, b), 0, 0, 1, 5)" or "sin(6.28*1k*time)"
+	// V(n) is a node voltage and V(a, b) a voltage difference; time is the simulation time
+	// Throws std::invalid_argument describing the error and where it is
+	Bytecode compile(const std::string &expr);
+	
+	// Input 0 of the compiled code is the simulation time,
+	// and input ind + 1 is the voltage of node_names()[ind]
+	const std::vector<std::string> &node_names() const;
+};
+
+}
+}
@@ -69,19 +69,26 @@ ASTNode *ASTExpression::consume(ASTNode *&current_node, NodePos &current_pos, co
 				our_shared_ptr.reset(op);
 			}
 			
-			// If we are lower or the same precedence, add our entire parent op as a child to the new op,
-			// and swap out our grandparent's reference to our parent op for the new op
-			// e.g. 5*3+
+			// If we are lower or the same precedence, add our entire parent op (or the highest enclosing op
+			// that doesn't have a lower precedence) as a child to the new op, and swap out its parent's reference to it for the new op
+			// e.g. 5*3+ or 2*5**3+
 			// We're in the 3, just consumed the +
 			else {
-				// Add our entire parent op as a child to the new op
-				auto *grandparent = parent->parent;
-				auto &parents_shared_ptr = grandparent->get_shared_ptr(parent);
-				op->add_child(parents_shared_ptr);
+				ASTNode *operand = parent;
+				while(ASTExprOperator *up = dynamic_cast<ASTExprOperator*>(operand->parent)) {
+					if(op->get_op_type() > up->get_op_type())
+						break;
+					operand = up;
+				}
 				
-				// Swap out our grandparent's reference to our parent op for the new op
+				// Add the op as a child to the new op
+				auto *grandparent = operand->parent;
+				auto &operand_shared_ptr = grandparent->get_shared_ptr(operand);
+				op->add_child(operand_shared_ptr);
+				
+				// Swap out its parent's reference to it for the new op
 				op->parent = grandparent;
-				parents_shared_ptr.reset(op);
+				operand_shared_ptr.reset(op);
 			}
 		}
 		
@@ -8,13 +8,37 @@
 #include "Core/Component.hpp"
 #include "Core/TwoTerminalComponent.hpp"
 #include "Core/IntegratingComponent.hpp"
+#include "Core/NonlinearComponent.hpp"
 #include "Core/Modulator.hpp"
+#include "Core/ThreadPool.hpp"
+#include "Core/ACResult.hpp"
+#include "Core/DCSweepResult.hpp"
+#include "Core/Subcircuit.hpp"
+#include "Core/SubcircuitDef.hpp"
+#include "Core/SubcircuitInstance.hpp"
+#include "Core/OrderingCache.hpp"
+#include "Core/Table.hpp"
+#include "Core/Bytecode.hpp"
+#include "Core/BehavioralComponent.hpp"
+#include "Core/CloneMap.hpp"
+#include "Core/ParameterSweepResult.hpp"
+#include "Core/ParameterSweep.hpp"
+#include "Core/CircuitGroup.hpp"
+#include "Core/LaneLU.hpp"
+#include "Core/Ensemble.hpp"
+#include "Core/Batch.hpp"
 
 #include "Component/Resistor.hpp"
 #include "Component/Capacitor.hpp"
 #include "Component/Inductor.hpp"
 #include "Component/VSource.hpp"
 #include "Component/ISource.hpp"
+#include "Component/Diode.hpp"
+#include "Component/TransmissionLine.hpp"
+#include "Component/BVSource.hpp"
+#include "Component/BISource.hpp"
 
 #include "Modulator/PWM.hpp"
 #include "Modulator/Sine.hpp"
+#include "Modulator/PWL.hpp"
+#include "Modulator/SampleStream.hpp"